@@ -5,7 +5,7 @@
  * @file tmotor.hpp
  * @author Toprak Efe Akkılıç (efe.akkilic@ozu.edu.tr)
  * @brief An async C++ interface for controlling AK motors over CAN bus for Linux.
- * @note This library only supports servo mode for AK motors.
+ * @note This library supports the servo and MIT (motion control) modes of AK motors.
  * @version 0.1
  * @date 2024-02-22
  *
@@ -21,14 +21,25 @@
 #include <sys/ioctl.h>
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <poll.h>
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <functional>
+#include <future>
 
-#define TMOTOR_AK_POLE_PAIRS 21
+#include <tmotor_clock.hpp>
+
+#define TMOTOR_AK_POLE_PAIRS 21 // default of AKManager, AKMotor takes the pole pairs of its model (tmotor_models.hpp)
+#define TMOTOR_AK_FEEDBACK_ID 0x00002900
+#define TMOTOR_RAD_TO_DEG 57.29577951f
+#define TMOTOR_RADS_TO_RPM 9.549296586f
+#define TMOTOR_RPM_TO_RADS 0.104719755f
 
 namespace TMotor
 {
@@ -59,8 +70,506 @@ enum MotorFault {
   HARDWARE
 };
 
+/**
+ * @brief Names of the motor faults indexed by their code, usable from real-time threads.
+ */
+constexpr const char *fault_names[] = {
+  "None",
+  "Overtemperature",
+  "Overcurrent",
+  "Overvoltage",
+  "Undervoltage",
+  "Encoder",
+  "Hardware"
+};
+
+/**
+ * @brief Get the name of a motor fault without allocating.
+ */
+constexpr const char *fault_to_cstr(MotorFault fault) {
+  return (unsigned) fault < sizeof(fault_names) / sizeof(fault_names[0]) ? fault_names[fault] : "INVALID FAULT";
+}
+
 std::string fault_to_string(MotorFault &fault);
 
+/**
+ * @brief Lock the current and future pages of the process into memory, so real-time threads never page fault.
+ * 
+ * @return Whether the memory could be locked, it needs CAP_IPC_LOCK or a large enough RLIMIT_MEMLOCK.
+ */
+bool lockMemory();
+
+/**
+ * @brief Touch the given amount of stack of the calling thread, so later calls do not fault it in.
+ * 
+ * @param bytes The stack depth to prefault.
+ */
+void prefaultStack(size_t bytes);
+
+/**
+ * @brief Signals the bus reader derives from the feedback of a motor, updated on every decoded frame.
+ */
+struct DerivedSignals {
+  float velocity;            // rpm, low-pass filtered
+  float acceleration;        // rpm/s, low-pass filtered derivative of the filtered velocity
+  float power;               // W, electrical power drawn by the motor, see DerivedConfig
+  float temperature_rate;    // C/s, trend of the low-pass filtered temperature
+};
+
+/**
+ * @brief A consistent snapshot of the last feedback frame received from a motor.
+ *
+ * The sequence number is incremented on every decoded feedback frame, consumers can compare it
+ * against the last value they have seen to detect new telemetry.
+ */
+struct MotorState {
+  float current;             // A
+  float velocity;            // rpm
+  float position;            // deg
+  int8_t temperature;        // C
+  MotorFault motor_fault;    // motor fault type
+  uint32_t sequence;         // number of feedback frames decoded so far
+  std::chrono::steady_clock::time_point timestamp; // receive time of the frame
+  DerivedSignals derived;
+};
+
+/**
+ * @brief Settings of the derived signals of a motor.
+ *
+ * The electrical power is the mechanical power torque_constant * current * shaft speed plus the copper losses
+ * resistance * current^2, so it stays zero until the motor constants are given. A cutoff of 0 disables the filter.
+ */
+struct DerivedConfig {
+  float velocity_cutoff;     // Hz
+  float acceleration_cutoff; // Hz
+  float temperature_cutoff;  // Hz, of the temperature and of its trend
+  float torque_constant;     // Nm/A
+  float resistance;          // Ohm, phase resistance
+  float pole_pairs;          // the reported velocity divided by it is the shaft rpm, 1 if it already is
+
+  DerivedConfig() :
+    velocity_cutoff(20.0f),
+    acceleration_cutoff(10.0f),
+    temperature_cutoff(0.05f),
+    torque_constant(0.0f),
+    resistance(0.0f),
+    pole_pairs(1.0f)
+  {}
+};
+
+/**
+ * @brief Incremental filters computing the DerivedSignals of one motor.
+ *
+ * Each filter is a first order low-pass discretized with the actual interval between two receive timestamps,
+ * so irregular or dropped feedback does not distort the derivatives. An update costs a few multiplications
+ * and divisions and never allocates.
+ */
+class DerivedSignalFilter {
+protected:
+  DerivedConfig _config;
+  float _velocity_tau;       // s
+  float _acceleration_tau;   // s
+  float _temperature_tau;    // s
+  bool _primed;
+  std::chrono::steady_clock::time_point _last;
+  float _temperature;        // C, filtered
+  DerivedSignals _signals;
+
+public:
+  DerivedSignalFilter();
+
+  explicit DerivedSignalFilter(const DerivedConfig &config);
+
+  const DerivedConfig &config() const;
+
+  /**
+   * @brief Forget the filter history, the next update starts from its sample.
+   */
+  void reset();
+
+  /**
+   * @brief Filter a new sample, samples with the timestamp of the previous one only update the power.
+   */
+  const DerivedSignals &update(const MotorState &state);
+};
+
+/**
+ * @brief Ranges of the MIT mode fixed-point fields, they must match the motor firmware.
+ *
+ * The defaults are the ranges of the AK80-9. The torque constant converts the torque reported in the MIT replies
+ * into the current of the MotorState, 0 stores the torque as it is.
+ */
+struct MITLimits {
+  float position_max;        // rad, position is in [-position_max, position_max]
+  float velocity_max;        // rad/s
+  float torque_max;          // Nm
+  float kp_max;              // Nm/rad, kp is in [0, kp_max]
+  float kd_max;              // Nm*s/rad
+  float torque_constant;     // Nm/A
+
+  MITLimits() :
+    position_max(12.5f),
+    velocity_max(50.0f),
+    torque_max(18.0f),
+    kp_max(500.0f),
+    kd_max(5.0f),
+    torque_constant(0.0f)
+  {}
+};
+
+/**
+ * @brief Clamps and wire scaling of the servo mode commands of a motor.
+ *
+ * The defaults are limits valid for any servo firmware, the models of "tmotor_models.hpp" tailor them to a
+ * variant. Every conversion is constexpr so AKMotor evaluates them at compile time for constant arguments.
+ */
+struct ServoLimits {
+  int pole_pairs;
+  float current_max;         // A, current loop
+  float brake_current_max;   // A, brake
+  int32_t erpm_max;          // electrical rpm, velocity loop
+  float position_max;        // deg, position loop
+  int16_t acceleration_max;  // position-velocity loop
+
+  constexpr ServoLimits() :
+    pole_pairs(TMOTOR_AK_POLE_PAIRS),
+    current_max(60.0f),
+    brake_current_max(60.0f),
+    erpm_max(100000),
+    position_max(36000.0f),
+    acceleration_max(200)
+  {}
+
+  static constexpr float clamp(float value, float low, float high) {
+    return value < low ? low : (value > high ? high : value);
+  }
+
+  /**
+   * @brief Current loop command, 0.01 A.
+   */
+  constexpr int32_t current(float amps) const {
+    return (int32_t) (clamp(amps, -current_max, current_max) * 100.0f);
+  }
+
+  /**
+   * @brief Brake command, 0.001 A.
+   */
+  constexpr int32_t brake(float amps) const {
+    return (int32_t) (clamp(amps, 0.0f, brake_current_max) * 1000.0f);
+  }
+
+  /**
+   * @brief Velocity loop command, electrical rpm from the rotor rpm.
+   */
+  constexpr int32_t erpm(float rpm) const {
+    return (int32_t) (((int64_t) rpm) * pole_pairs < -erpm_max ? -erpm_max :
+                      (((int64_t) rpm) * pole_pairs > erpm_max ? erpm_max : ((int64_t) rpm) * pole_pairs));
+  }
+
+  /**
+   * @brief Position loop command, deg.
+   */
+  constexpr int32_t position(float degrees) const {
+    return (int32_t) clamp(degrees, -position_max, position_max);
+  }
+
+  /**
+   * @brief Position of the position-velocity loop, 0.0001 deg.
+   */
+  constexpr int32_t profilePosition(float degrees) const {
+    return (int32_t) (degrees * 10000.0f);
+  }
+
+  constexpr int16_t acceleration(int16_t acc) const {
+    return acc < 0 ? 0 : (acc > acceleration_max ? acceleration_max : acc);
+  }
+};
+
+/**
+ * @brief A MIT mode command, the motor applies torque = kp*(position error) + kd*(velocity error) + torque.
+ */
+struct MITCommand {
+  float position;            // rad
+  float velocity;            // rad/s
+  float kp;                  // Nm/rad
+  float kd;                  // Nm*s/rad
+  float torque;              // Nm, feedforward
+};
+
+/**
+ * @brief A decoded MIT mode reply.
+ */
+struct MITReply {
+  uint8_t motor_id;
+  float position;            // rad
+  float velocity;            // rad/s
+  float torque;              // Nm
+  int8_t temperature;        // C, only sent by 8 byte replies
+  uint8_t error;             // MotorFault code, only sent by 8 byte replies
+};
+
+/**
+ * @brief Fixed-point codec of the packed MIT mode frames.
+ *
+ * A command packs a 16-bit position and 12-bit velocity, kp, kd and torque fields into one 8 byte standard frame
+ * addressed to the motor ID. The scale factors are computed once per set of limits, so packing and unpacking is
+ * a handful of multiplications.
+ */
+class MITCodec {
+protected:
+  MITLimits _limits;
+  float _position_scale;
+  float _velocity_scale;
+  float _torque_scale;
+  float _kp_scale;
+  float _kd_scale;
+
+public:
+  MITCodec();
+
+  explicit MITCodec(const MITLimits &limits);
+
+  const MITLimits &limits() const;
+
+  /**
+   * @brief Encode a command, values outside of the limits are clamped.
+   */
+  void pack(uint8_t motor_id, const MITCommand &command, struct can_frame &frame) const;
+
+  /**
+   * @brief Decode a reply, returns false if the frame is too short.
+   */
+  bool unpack(const struct can_frame &frame, MITReply &reply) const;
+
+  /**
+   * @brief Convert a reported torque into current using the torque constant of the limits.
+   */
+  float torqueToCurrent(float torque) const;
+
+  /**
+   * @brief Encode one of the special frames, 0xFC enters MIT mode, 0xFD exits it and 0xFE zeroes the position.
+   */
+  static void packSpecial(uint8_t motor_id, uint8_t last, struct can_frame &frame);
+};
+
+/**
+ * @brief A motor found on the bus by AKBus::discover().
+ */
+struct DiscoveredMotor {
+  uint8_t motor_id;
+  MotorState state;          // the first feedback received during the scan
+};
+
+/**
+ * @brief Lock-free ring of feedback samples with a single producer.
+ *
+ * The bus reader pushes every decoded frame of a motor, any number of consumers pull the samples they have not
+ * seen yet through their own cursor without ever blocking the reader. A consumer that falls behind by more than
+ * the capacity silently skips the overwritten samples.
+ */
+class SampleBuffer {
+protected:
+  struct Slot {
+    std::atomic<uint64_t> sequence;  // 2*index+1 while being written, 2*index+2 once complete
+    MotorState state;
+  };
+  std::unique_ptr<Slot[]> _slots;
+  size_t _mask;
+  std::atomic<uint64_t> _head;       // number of samples pushed so far
+
+public:
+  /**
+   * @brief Constructor for the SampleBuffer class.
+   * 
+   * @param capacity The number of samples to keep, rounded up to a power of two.
+   */
+  explicit SampleBuffer(size_t capacity);
+
+  /**
+   * @brief Get the number of samples the buffer keeps.
+  */
+  size_t capacity();
+
+  /**
+   * @brief Get the number of samples pushed so far, a cursor at this value has no pending samples.
+  */
+  uint64_t head();
+
+  /**
+   * @brief Append a sample, must only be called from a single thread.
+   * 
+   * @param state The sample to append.
+  */
+  void push(const MotorState &state);
+
+  /**
+   * @brief Copy the samples pushed since the cursor, oldest first.
+   * 
+   * @param cursor The index of the next sample to read, advanced past the returned samples.
+   * 
+   * @param out The array to copy the samples into.
+   * 
+   * @param max The size of the output array.
+   * 
+   * @return The number of samples copied.
+  */
+  size_t pull(uint64_t &cursor, MotorState *out, size_t max);
+};
+
+/**
+ * @brief Latest-value mailbox readable and writable without locks.
+ *
+ * A sequence lock, the writer never waits and readers retry while a write is in progress. Meant for a single
+ * writer per mailbox, e.g. the thread planning the motion of one motor.
+ */
+template <typename T> class Mailbox {
+protected:
+  std::atomic<uint32_t> _sequence;  // odd while a write is in progress
+  T _value;
+
+public:
+  Mailbox() : _sequence(0), _value() {}
+
+  explicit Mailbox(const T &value) : _sequence(0), _value(value) {}
+
+  void store(const T &value) {
+    uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+    _sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    _value = value;
+    _sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  T load() {
+    while (true) {
+      uint32_t before = _sequence.load(std::memory_order_acquire);
+      T value = _value;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint32_t after = _sequence.load(std::memory_order_relaxed);
+      if (before == after && (before & 1) == 0) {
+        return value;
+      }
+    }
+  }
+};
+
+/**
+ * @brief Worst case number of bits a CAN data frame occupies on the wire.
+ * 
+ * Includes the maximum number of stuff bits and the interframe space, so that loads computed from it are
+ * upper bounds. An extended frame with 8 data bytes takes 160 bits.
+ * 
+ * @param extended Whether the frame has a 29-bit identifier.
+ * 
+ * @param dlc The number of data bytes.
+ */
+uint32_t frameBits(bool extended, uint8_t dlc);
+
+/**
+ * @brief Frame and byte counters of a single motor ID.
+ */
+struct TrafficCounters {
+  uint64_t rx_frames;
+  uint64_t rx_bytes;
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+};
+
+/**
+ * @brief A snapshot of the traffic a bus has seen since it was connected.
+ *
+ * Only the frames passing the socket filter and the frames written through the bus are counted, so the
+ * load of other nodes is not included unless the bus receives every feedback ID.
+ */
+struct BusStatistics {
+  std::chrono::steady_clock::time_point timestamp;
+  uint32_t bitrate;          // bit/s the load is computed against
+  uint64_t rx_frames;
+  uint64_t rx_bytes;
+  uint64_t tx_frames;
+  uint64_t tx_bytes;
+  uint64_t bits;             // worst case bits on the wire, see frameBits()
+  uint64_t error_frames;
+  uint64_t tx_failures;
+  uint64_t rx_dropped;       // frames the kernel dropped because the receive queue was full
+  TrafficCounters motors[256]; // indexed by the low byte of the CAN ID
+
+  /**
+   * @brief Compute the bus utilization between an earlier snapshot and this one.
+   * 
+   * @param previous The earlier snapshot.
+   * 
+   * @return The utilization in percent of the bitrate.
+   */
+  float utilization(const BusStatistics &previous) const;
+};
+
+/**
+ * @brief What AKBus::emergencyStop() commands the servo mode motors, motors in MIT mode are always sent a zero
+ * torque command with zero gains.
+ */
+enum class StopAction {
+  ZERO_CURRENT,              // current loop at 0 A, the motor coasts
+  BRAKE                      // brake current, the motor resists movement
+};
+
+/**
+ * @brief Conditions the bus reader reacts to on its own, checked on every decoded frame of the motor.
+ */
+struct ReflexConfig {
+  float current_limit;       // A, magnitude of the current that trips the reflex, 0 disables
+  uint32_t current_samples;  // consecutive feedback frames above the current limit needed to trip
+  int temperature_limit;     // C, temperature that trips the reflex, 0 disables
+  bool on_fault;             // trip on any fault code other than NONE
+  StopAction action;         // command sent to a servo mode motor, MIT mode motors get zero gains and torque
+  float brake_current;       // A, current of the BRAKE action, clamped to the brake limit of the motor
+  bool stop_bus;             // emergency stop every registered motor instead of only this one
+
+  ReflexConfig() :
+    current_limit(0.0f),
+    current_samples(1),
+    temperature_limit(0),
+    on_fault(false),
+    action(StopAction::ZERO_CURRENT),
+    brake_current(0.0f),
+    stop_bus(false)
+  {}
+};
+
+/**
+ * @brief The condition that tripped a reflex.
+ */
+enum class ReflexTrigger {
+  CURRENT,
+  TEMPERATURE,
+  FAULT
+};
+
+/**
+ * @brief Socket settings applied by AKBus::connect().
+ */
+struct BusOptions {
+  int receive_buffer;        // SO_RCVBUF in bytes, 0 keeps the system default
+  int send_buffer;           // SO_SNDBUF in bytes, 0 keeps the system default
+  int attempts;              // tries of each transiently failing socket call
+  std::chrono::milliseconds initial_backoff; // sleep after the first failure, doubled after each retry
+  int mit_reply_id;          // standard CAN ID the MIT mode replies are sent to, -1 ignores MIT replies
+  bool lock_memory;          // mlockall() the process before the reader starts, connecting fails if it cannot
+  size_t prefault_stack;     // bytes of stack the reader thread prefaults before its first read, 0 for none
+  bool reader_thread;        // decode on a thread of the bus, false leaves it to processIncoming() calls
+
+  BusOptions() :
+    receive_buffer(0),
+    send_buffer(0),
+    attempts(5),
+    initial_backoff(1),
+    mit_reply_id(-1),
+    lock_memory(false),
+    prefault_stack(0),
+    reader_thread(true)
+  {}
+};
+
 class CANSocketException : public std::exception {
 public:
   CANSocketException(const char *msg) :
@@ -75,28 +584,427 @@ private:
   const char *_msg;
 };
 
+/**
+ * @brief Shared AK Motors CAN Bus
+ * This class owns a single CAN socket and a single reader thread which decodes the feedback frames of every
+ * motor on the interface into a table of states indexed by motor ID. Any number of AKManager objects and
+ * monitoring tools can share one bus, so watching many motors costs one socket and one thread.
+ */
+class AKBus {
+protected:
+  int _can_fd;
+  std::atomic<bool> _shutdown;
+  MotorState _states[256];
+  std::shared_ptr<SampleBuffer> _samples[256];
+  uint32_t _sequence;        // feedback frames decoded on the bus
+  std::mutex _mutex;
+  std::condition_variable _update_cv;
+  std::thread _can_reader;
+
+  /* traffic counters, updated without locks and read by getStatistics() */
+  struct AtomicCounters {
+    std::atomic<uint64_t> rx_frames;
+    std::atomic<uint64_t> rx_bytes;
+    std::atomic<uint64_t> tx_frames;
+    std::atomic<uint64_t> tx_bytes;
+  };
+  AtomicCounters _traffic[256];
+  std::atomic<uint64_t> _rx_frames;
+  std::atomic<uint64_t> _rx_bytes;
+  std::atomic<uint64_t> _tx_frames;
+  std::atomic<uint64_t> _tx_bytes;
+  std::atomic<uint64_t> _bits;
+  std::atomic<uint64_t> _error_frames;
+  std::atomic<uint64_t> _tx_failures;
+  std::atomic<uint64_t> _rx_dropped;
+  std::atomic<uint32_t> _bitrate;
+  uint32_t _kernel_dropped;  // last SO_RXQ_OVFL value reported by the kernel
+  std::function<void(uint32_t)> _drop_callback;
+  int _mit_reply_id;
+  MITCodec _mit_codecs[256];
+  ServoLimits _servo_limits[256];        // guarded by _mutex
+  std::atomic<int32_t> _brake_limits[256]; // brake_current_max of each motor in mA, read by emergencyStop()
+  DerivedSignalFilter _derived[256];
+  Mailbox<MotorState> _snapshots[256]; // copies of the states readable without the mutex
+  std::atomic<uint32_t> _stop_motors[8]; // motors commanded by emergencyStop(), one bit per ID
+  std::atomic<uint32_t> _stop_mit[8];    // the registered motors in MIT mode
+  std::atomic<uint64_t> _mit_stop[256];  // data of the zero MIT command of each motor, packed when its limits are set
+  std::atomic<int> _stop_action;
+  std::atomic<int32_t> _stop_brake;      // brake current in the units of the brake frame
+  std::atomic<bool> _stopped;
+  ReflexConfig _reflexes[256];           // guarded by _mutex, which the reader holds while decoding
+  uint32_t _reflex_counts[256];          // consecutive feedback frames above the current limit
+  std::atomic<uint32_t> _tripped[8];     // motors stopped by a reflex, send() refuses their commands
+  ReflexTrigger _reflex_triggers[256];
+  uint32_t _reflex_pending[8];           // trips not yet reported to the callback, reader only
+  std::function<void(uint8_t, ReflexTrigger)> _reflex_callback;
+  uint32_t _updated[8];                  // motors decoded in the current wakeup, reader only
+  std::function<void(uint8_t)> _update_callback;
+  size_t _prefault_stack;
+  std::shared_ptr<Clock> _clock;
+
+  void __read_motor_messages();
+  size_t __drain();
+  bool __decode_servo(const struct can_frame &rframe);
+  bool __decode_mit(const struct can_frame &rframe);
+  void __publish(uint8_t motor_id);
+  void __check_reflexes(uint8_t motor_id);
+  void __report_reflexes();
+  void __stop_frame(uint8_t motor_id, StopAction action, int32_t brake, struct can_frame &frame);
+  bool __transmit(const struct can_frame &frame);
+  void __check_refused(uint8_t motor_id);
+  void __count_dropped(uint32_t kernel_dropped);
+  void __fail_connect(const char *msg);
+  void __disconnect();
+  void __start_reader();
+
+public:
+
+  /**
+   * @brief Default constructor for the AKBus class.
+   *
+   * The bus is not connected until connect() or open() is called.
+   */
+  AKBus();
+
+  AKBus(const AKBus&) = delete;
+  AKBus& operator=(const AKBus&) = delete;
+
+  /**
+   * @brief Destructor for the AKBus class.
+   *
+   * Stops the reader thread and closes the socket.
+   */
+  ~AKBus();
+
+  /**
+   * @brief Connect to the CAN interface, receiving the feedback of every motor.
+   * 
+   * @param can_interface The CAN interface to connect to. ("vcan0", "can0", etc.)
+   */
+  void connect(const char *can_interface);
+
+  /**
+   * @brief Connect to the CAN interface, receiving only the feedback of the given motors.
+   * 
+   * @param can_interface The CAN interface to connect to. ("vcan0", "can0", etc.)
+   * 
+   * @param motor_ids The IDs of the motors to receive feedback from, every motor if empty.
+   * 
+   * @param options The socket buffer sizes and retry policy to use.
+   */
+  void connect(const char *can_interface, const std::vector<uint8_t> &motor_ids, const BusOptions &options = BusOptions());
+
+  /**
+   * @brief Connect to the CAN interface on a separate thread.
+   * 
+   * @param can_interface The CAN interface to connect to. ("vcan0", "can0", etc.)
+   * 
+   * @param motor_ids The IDs of the motors to receive feedback from, every motor if empty.
+   * 
+   * @param options The socket buffer sizes and retry policy to use.
+   * 
+   * @return A future that becomes ready once connected, rethrowing the CANSocketException on failure.
+   */
+  std::future<void> connectAsync(const char *can_interface, const std::vector<uint8_t> &motor_ids = std::vector<uint8_t>(),
+                                 const BusOptions &options = BusOptions());
+
+  /**
+   * @brief Use an already configured socket instead of opening a new one.
+   * 
+   * @param fd A socket delivering whole struct can_frame datagrams, the bus takes its ownership.
+   * 
+   * @param options Only the MIT reply ID is used, the socket is expected to be configured already.
+   */
+  void open(int fd, const BusOptions &options = BusOptions());
+
+  /**
+   * @brief Check whether the bus has an open socket.
+  */
+  bool isConnected();
+
+  /**
+   * @brief Get the socket of the bus, to watch for POLLIN/EPOLLIN in an event loop when connected with
+   * BusOptions::reader_thread off.
+   * 
+   * @return The socket, -1 if not connected.
+  */
+  int getFd();
+
+  /**
+   * @brief Receive and decode every pending frame without blocking, for buses connected with
+   * BusOptions::reader_thread off.
+   * 
+   * Does the work of one wakeup of the reader thread on the calling thread: decodes the frames, runs the reflexes
+   * and wakes the waiters. Must only be called from one thread at a time, waitForUpdate() on that same thread
+   * would wait for frames it cannot decode.
+   * 
+   * @return The number of frames received, throws std::runtime_error if the bus has a reader thread.
+  */
+  size_t processIncoming();
+
+  /**
+   * @brief Get the last decoded state of a motor.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @return A snapshot of the motor state, its sequence is zero if no feedback has been received yet.
+  */
+  MotorState getState(uint8_t motor_id);
+
+  /**
+   * @brief Get the last decoded state of a motor without taking the lock of the reader.
+   * 
+   * Meant for monitoring threads polling many motors, the call retries while the reader is publishing a frame
+   * of the same motor instead of making the reader wait.
+   * 
+   * @param motor_id The motor ID.
+  */
+  MotorState peekState(uint8_t motor_id);
+
+  /**
+   * @brief Get the number of feedback frames decoded on the bus so far.
+  */
+  uint32_t getSequence();
+
+  /**
+   * @brief Block until any feedback frame newer than the given bus sequence number arrives.
+   * 
+   * @param sequence The last bus sequence number the caller has seen.
+   * 
+   * @param timeout The maximum duration to wait for.
+   * 
+   * @return The current bus sequence number, equal to the input if the wait has timed out.
+  */
+  uint32_t waitForUpdate(uint32_t sequence, std::chrono::milliseconds timeout);
+
+  /**
+   * @brief Block until a feedback frame of the given motor newer than the given sequence number arrives.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param sequence The last motor sequence number the caller has seen.
+   * 
+   * @param timeout The maximum duration to wait for.
+   * 
+   * @return The current motor sequence number, equal to the input if the wait has timed out.
+  */
+  uint32_t waitForUpdate(uint8_t motor_id, uint32_t sequence, std::chrono::milliseconds timeout);
+
+  /**
+   * @brief Set the MIT mode ranges used to decode the replies of a motor.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param limits The ranges the motor firmware uses.
+  */
+  void setMITLimits(uint8_t motor_id, const MITLimits &limits);
+
+  /**
+   * @brief Get the MIT mode ranges of a motor, the defaults until they are set.
+  */
+  MITLimits getMITLimits(uint8_t motor_id);
+
+  /**
+   * @brief Set the servo mode limits of a motor, AKManager::connect() registers those of its manager.
+   * 
+   * The managers connected afterwards without limits of their own, such as the channels of the controllers,
+   * pollers and identifiers, adopt them, and the brake of emergencyStop() and of the reflexes is clamped to
+   * them.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param limits The limits of the motor model.
+  */
+  void setServoLimits(uint8_t motor_id, const ServoLimits &limits);
+
+  /**
+   * @brief Get the servo mode limits of a motor, the defaults until they are set.
+  */
+  ServoLimits getServoLimits(uint8_t motor_id);
+
+  /**
+   * @brief Set the filters and motor constants of the derived signals of a motor, its filters restart.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param config The settings to use.
+  */
+  void setDerivedConfig(uint8_t motor_id, const DerivedConfig &config);
+
+  /**
+   * @brief Record every feedback frame of a motor into a sample buffer from the reader thread.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param buffer The buffer to push the samples into, nullptr to stop recording.
+  */
+  void setSampleBuffer(uint8_t motor_id, std::shared_ptr<SampleBuffer> buffer);
+
+  /**
+   * @brief Set the bitrate of the bus, used to compute its utilization.
+   * 
+   * @param bitrate The bitrate in bit/s, 1 Mbit/s by default.
+  */
+  void setBitrate(uint32_t bitrate);
+
+  /**
+   * @brief Get a snapshot of the traffic counters, without blocking the reader or the writers.
+  */
+  BusStatistics getStatistics();
+
+  /**
+   * @brief Get notified when the kernel drops received frames because the reader fell behind.
+   * 
+   * @param callback Called from the reader thread with the number of newly dropped frames, must not block.
+   * 
+   * @note Must be set before connect() or open().
+  */
+  void setDropCallback(std::function<void(uint32_t)> callback);
+
+  /**
+   * @brief Set the clock timestamping the feedback and pacing the connection retries, controllers and pollers
+   * on the bus use it as well.
+   * 
+   * @param clock The clock, Clock::system() by default.
+   * 
+   * @note Must be set before connect() or open().
+  */
+  void setClock(std::shared_ptr<Clock> clock);
+
+  std::shared_ptr<Clock> getClock();
+
+  /**
+   * @brief Find every motor sending feedback on the bus.
+   * 
+   * Listens once on the bus socket for feedback from all 256 IDs, in servo mode the motors report their state
+   * periodically so a window longer than the feedback period finds all of them. No command is sent.
+   * 
+   * @param window How long to listen for, measured on the clock of the bus, the call returns once it has passed.
+   * 
+   * @return The responding motors sorted by ID, with the first state received from each.
+   * 
+   * @note The bus must be connected without a motor ID filter.
+  */
+  std::vector<DiscoveredMotor> discover(std::chrono::milliseconds window = std::chrono::milliseconds(200));
+
+  /**
+   * @brief Write a frame to the bus.
+   * 
+   * @param frame The frame to write.
+   * 
+   * @note Throws CANSocketException if the write fails, if the bus is emergency stopped or if a reflex stopped
+   * the motor the frame is sent to. A stop latched while the frame is written is followed by the stop frame of
+   * the motor again, so the command never outlives the stop, and throws as well.
+  */
+  void send(const struct can_frame &frame);
+
+  /**
+   * @brief Add a motor to the ones emergencyStop() commands, AKManager::connect() registers its motor.
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param mit_mode Whether the motor is in MIT mode, AKManager::enterMITMode() and exitMITMode() update it.
+  */
+  void registerMotor(uint8_t motor_id, bool mit_mode = false);
+
+  /**
+   * @brief Set the command emergencyStop() sends to the servo mode motors.
+   * 
+   * @param action Zero current by default.
+   * 
+   * @param brake_current The current of the BRAKE action, clamped for each motor to the brake limit of its ServoLimits.
+  */
+  void setStopAction(StopAction action, float brake_current = 0.0f);
+
+  /**
+   * @brief Stop every registered motor.
+   * 
+   * Latches the bus into the stopped state, in which send() refuses every command so controllers, pollers and
+   * players cannot move the motors again, then writes the stop frames of all registered motors with a single
+   * sendmmsg() per 64 motors. Frames already queued in the kernel are sent before them.
+   * 
+   * Only uses atomics, sendmmsg() and poll() and never throws or allocates, so it may be called from a signal
+   * handler or a watchdog thread at any time, including while other threads are sending.
+   * 
+   * @return The number of frames written, -1 if the bus is not connected.
+  */
+  int emergencyStop();
+
+  /**
+   * @brief Check whether the bus is emergency stopped.
+  */
+  bool isStopped();
+
+  /**
+   * @brief Leave the stopped state, send() accepts commands again.
+  */
+  void clearStop();
+
+  /**
+   * @brief Make the reader stop a motor itself as soon as a decoded frame meets a condition.
+   * 
+   * The stop frame is written by the reader in the wakeup that decoded the offending frame, without waiting for
+   * any other thread. The motor is then latched tripped, send() refuses its commands until clearReflex().
+   * 
+   * @param motor_id The motor ID.
+   * 
+   * @param config The conditions and the reaction, a default ReflexConfig disables the reflexes of the motor.
+  */
+  void setReflex(uint8_t motor_id, const ReflexConfig &config);
+
+  /**
+   * @brief Check whether a reflex stopped a motor.
+  */
+  bool isTripped(uint8_t motor_id);
+
+  /**
+   * @brief Accept the commands of a tripped motor again and restart its sample count.
+  */
+  void clearReflex(uint8_t motor_id);
+
+  /**
+   * @brief Get notified when a reflex trips, after the stop frame has been written.
+   * 
+   * @param callback Called from the reader thread once its pending frames are decoded, must not block.
+   * 
+   * @note Must be set before connect() or open().
+  */
+  void setReflexCallback(std::function<void(uint8_t, ReflexTrigger)> callback);
+
+  /**
+   * @brief Get notified of the motors whose state changed, once per motor and wakeup of the reader.
+   * 
+   * @param callback Called from the reader, or from processIncoming(), after the pending frames are decoded and
+   * without holding the lock, so it may read the states. The reader decodes nothing while it runs.
+   * 
+   * @note Must be set before connect() or open().
+  */
+  void setUpdateCallback(std::function<void(uint8_t)> callback);
+};
+
 /**
  * @brief AK Motors CAN Interface
  * This class is used to communicate with the AK60 & AK70 motors via CAN bus. Accepted IDs are uint8_t types.
  * The class is designed to be used with a single instance. It is not thread-safe. After the appropriate control mode is selected,
  * members can be directly changed to control the motor. The class will handle the rest. Create one object for each motor.
+ * Each object either opens its own bus on connect(), or attaches to a bus shared with other motors.
  * 
  * @note Only tested with AK60 and AK70s.
  */
 class AKManager {
 protected:
-  int _can_fd;
-  std::atomic<bool> _shutdown;
+  std::shared_ptr<AKBus> _bus;
   uint8_t _motor_id;
-  float _current;            // A   [-60, 60]
-  float _velocity;           // rpm [-320000, 320000] 
-  float _position;           // deg [-3200, 3200]
-  int8_t _temperature;       // C   [-20, 127]
-  MotorFault _motor_fault;   // motor fault type
-  std::mutex _mutex;
-  std::thread _can_reader;
+  MITCodec _mit_codec;
+  ServoLimits _servo_limits;
+  bool _mit_limits_set;      // set explicitly, registered on the bus instead of adopted from it
+  bool _servo_limits_set;
+  std::shared_ptr<Clock> _clock;
+  StopToken _connected;      // requested once a bus is attached, wakes the waits that found none
 
-  void __read_motor_message();
+  void __send_int32(MotorModeID mode, int32_t value, bool big_endian);
+  void __send_profile(int32_t position, int16_t velocity, int16_t acceleration);
 
 public:
 
@@ -127,7 +1035,7 @@ public:
   /**
    * @brief Destructor for the AKManager class.
    *
-   * This destructor sets the _shutdown flag to true and closes the _can_fd file descriptor.
+   * This destructor releases the bus, which is closed once no other manager shares it.
    */
   ~AKManager();
 
@@ -180,12 +1088,66 @@ public:
   */
   MotorFault getFault();
 
+  /**
+   * @brief Get all of the motor telemetry at once.
+   * 
+   * @return A snapshot of the motor state, taken under a single lock.
+  */
+  MotorState getState();
+
+  /**
+   * @brief Block until a feedback frame newer than the given sequence number arrives.
+   * 
+   * @param sequence The last sequence number the caller has seen.
+   * 
+   * @param timeout The maximum duration to wait for.
+   * 
+   * @return The current sequence number, equal to the input if the wait has timed out. Without a bus the wait
+   * sleeps on the clock of the manager and returns early once a bus is attached.
+  */
+  uint32_t waitForUpdate(uint32_t sequence, std::chrono::milliseconds timeout);
+
+  /**
+   * @brief Set the clock waitForUpdate() sleeps on while no bus is attached, connect() creates its bus with it.
+   * 
+   * @param clock The clock, Clock::system() by default.
+  */
+  void setClock(std::shared_ptr<Clock> clock);
+
   /**
    * @brief Connect to the CAN interface.
    * 
    * @param can_interface The CAN interface to connect to. ("vcan0", "can0", etc.)
+   * 
+   * @param options The socket buffer sizes and retry policy to use.
    */
-  void connect(const char *can_interface);
+  void connect(const char *can_interface, const BusOptions &options = BusOptions());
+
+  /**
+   * @brief Connect to the CAN interface on a separate thread, so that many motors can connect in parallel.
+   * 
+   * @param can_interface The CAN interface to connect to. ("vcan0", "can0", etc.)
+   * 
+   * @param options The socket buffer sizes and retry policy to use.
+   * 
+   * @return A future that becomes ready once connected, rethrowing the CANSocketException on failure.
+   */
+  std::future<void> connectAsync(const char *can_interface, const BusOptions &options = BusOptions());
+
+  /**
+   * @brief Attach to a bus shared with other motors.
+   * 
+   * The MIT and servo limits set on the manager are registered on the bus, a manager without limits of its own
+   * adopts those registered for its motor, e.g. by the AKMotor of its model.
+   * 
+   * @param bus The bus to send commands and receive feedback through.
+   */
+  void connect(std::shared_ptr<AKBus> bus);
+
+  /**
+   * @brief Get the bus the motor is attached to, nullptr before connect().
+  */
+  std::shared_ptr<AKBus> getBus();
 
   /**
    * @warning This function is not tested with.
@@ -202,7 +1164,8 @@ public:
   /**
    * @warning This function is not tested with.
    * 
-   * @param current The current value the motor will draw, between -60 and 60A.
+   * @param current The current value the motor will draw, clamped to the servo limits, between -60 and 60A
+   * unless the limits of a model apply.
    * 
    * @note The torque applied is equal to the current multiplied by the torque constant of the motor, which is 1/kv.
   */
@@ -211,7 +1174,7 @@ public:
   /**
    * @warning This function is not tested with.
    * 
-   * @param current The current value the motor will draw, between 0 and 60A.
+   * @param current The current value the motor will draw, between 0 and the brake limit, 60A by default.
    * 
    * @brief Stops the motor at the current position, it will try to resist movement with up to the specified current.
   */
@@ -244,6 +1207,49 @@ public:
   */
   void sendPositionVelocityAcceleration(float pose, int16_t vel, int16_t acc);
 
+  /**
+   * @brief Set the MIT mode ranges of the motor, used to pack the commands and decode the replies.
+   * 
+   * @param limits The ranges the motor firmware uses, the AK80-9 ranges by default.
+  */
+  void setMITLimits(const MITLimits &limits);
+
+  /**
+   * @brief Set the clamps and pole pairs of the servo mode commands, registered on the bus for the motor.
+   * 
+   * @param limits The limits of the motor model, AKMotor sets those of its model.
+  */
+  void setServoLimits(const ServoLimits &limits);
+
+  /**
+   * @brief Get the servo mode limits the commands are clamped to.
+  */
+  ServoLimits getServoLimits();
+
+  /**
+   * @brief Switch the motor into MIT mode.
+   * 
+   * @note The replies are only decoded if the bus was connected with BusOptions::mit_reply_id set.
+  */
+  void enterMITMode();
+
+  /**
+   * @brief Switch the motor out of MIT mode.
+  */
+  void exitMITMode();
+
+  /**
+   * @brief Make the current position the MIT mode zero.
+  */
+  void setMITOrigin();
+
+  /**
+   * @brief Sends a MIT mode command, the motor replies to every command with its state.
+   * 
+   * @param command The setpoint and gains, in SI units, clamped to the MIT limits.
+  */
+  void sendMIT(const MITCommand &command);
+
 };
 
 } // namespace TMotor
@@ -0,0 +1,209 @@
+#ifndef H_TMOTOR_ARCHIVE_HPP
+#define H_TMOTOR_ARCHIVE_HPP
+
+/**
+ * @file tmotor_archive.hpp
+ * @brief Columnar, delta-encoded per-motor telemetry archive with block statistics for fast scans.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief The columns of an archive, the feedback fields are kept in the fixed-point units of the 0x2900 frames.
+ */
+enum ArchiveColumn {
+  COLUMN_TIME = 0,         // us since the Unix epoch
+  COLUMN_POSITION,         // 0.1 deg
+  COLUMN_VELOCITY,         // rpm
+  COLUMN_CURRENT,          // 0.01 A
+  COLUMN_TEMPERATURE,      // C
+  COLUMN_FAULT,            // MotorFault
+  COLUMN_COUNT
+};
+
+/**
+ * @brief Aggregates of one column over one block, scans use them instead of decoding whole blocks.
+ */
+struct ColumnStats {
+  int64_t min;
+  int64_t max;
+  int64_t sum;
+  int64_t sum_sq;
+};
+
+/**
+ * @brief Index entry of a block of samples of one motor, stored field by field in little-endian.
+ */
+struct ArchiveBlock {
+  uint64_t offset;           // file offset of the first column
+  uint32_t count;            // samples in the block
+  uint32_t column_offset[COLUMN_COUNT]; // offset of every column from the block offset
+  ColumnStats stats[COLUMN_COUNT];
+};
+
+/**
+ * @brief Largest encoded size of a column of count values.
+ */
+size_t maxEncodedSize(size_t count);
+
+/**
+ * @brief Encode a column, the first value followed by the zigzag deltas bit-packed at the width of the largest
+ * into little-endian words.
+ *
+ * @return The number of bytes written.
+ */
+size_t encodeColumn(const int64_t *values, size_t count, uint8_t *out);
+
+/**
+ * @brief Decode a column written by encodeColumn().
+ *
+ * @return The number of bytes read.
+ */
+size_t decodeColumn(const uint8_t *in, size_t count, int64_t *out);
+
+/**
+ * @brief Writes feedback frames into an archive
+ * Samples are buffered per motor and written as soon as a block is full, so converting a capture only keeps one
+ * block per motor in memory. The block index is written by close().
+ */
+class ArchiveWriter {
+protected:
+  struct Stream {
+    std::vector<int64_t> columns[COLUMN_COUNT];
+    std::vector<ArchiveBlock> blocks;
+    uint64_t samples;
+  };
+
+  FILE *_file;
+  size_t _block_size;
+  uint64_t _offset;
+  std::unique_ptr<Stream> _streams[256];
+  std::vector<uint8_t> _buffer;
+
+  void __flush(uint8_t motor_id);
+  void __write(const void *data, size_t size);
+
+public:
+
+  /**
+   * @brief Constructor for the ArchiveWriter class, throws std::runtime_error if the file cannot be created.
+   *
+   * @param path The archive to create.
+   *
+   * @param block_size The samples per block, 4096 by default.
+   */
+  ArchiveWriter(const char *path, size_t block_size = 4096);
+
+  ArchiveWriter(const ArchiveWriter&) = delete;
+  ArchiveWriter& operator=(const ArchiveWriter&) = delete;
+
+  /**
+   * @brief Destructor for the ArchiveWriter class, closes the archive if close() was not called.
+   */
+  ~ArchiveWriter();
+
+  /**
+   * @brief Append a captured frame, frames other than the servo feedback are ignored.
+   *
+   * @param time_us The capture time in microseconds since the Unix epoch.
+   *
+   * @return Whether the frame was archived.
+   */
+  bool append(int64_t time_us, const struct can_frame &frame);
+
+  /**
+   * @brief Write the remaining samples and the index, throws std::runtime_error on a write error.
+   */
+  void close();
+};
+
+/**
+ * @brief A fault reported continuously between two samples.
+ */
+struct FaultInterval {
+  int64_t start_us;
+  int64_t end_us;            // time of the first sample without the fault, or of the last sample
+  MotorFault fault;
+};
+
+/**
+ * @brief Aggregates of one motor over a time range, in physical units.
+ */
+struct MotorSummary {
+  uint8_t motor_id;
+  uint64_t samples;
+  int64_t first_us;
+  int64_t last_us;
+  float position_min, position_max, position_mean; // deg
+  float velocity_min, velocity_max, velocity_mean; // rpm
+  float current_min, current_max, current_mean, current_rms; // A
+  int temperature_max;       // C
+  int64_t temperature_max_us; // first time the peak temperature was reached
+  double hot_seconds;        // time at or above the hot threshold
+  std::vector<FaultInterval> faults;
+  uint64_t blocks_scanned;   // blocks answered from their statistics
+  uint64_t blocks_decoded;   // blocks that had to be decoded, besides the lookup of the peak time
+};
+
+/**
+ * @brief Memory-maps an archive and answers aggregate queries
+ * Blocks completely inside the queried range contribute through their stored statistics, only blocks crossing
+ * the range limits, holding hot samples or faults are decoded. The time of a temperature peak found in the
+ * statistics is looked up by decoding two columns of its block.
+ */
+class ArchiveReader {
+protected:
+  struct Motor {
+    uint8_t motor_id;
+    uint64_t samples;
+    uint32_t block_count;
+    const uint8_t *blocks;   // block index entries in the mapping
+  };
+
+  const uint8_t *_data;
+  size_t _size;
+  std::vector<Motor> _motors;
+
+public:
+
+  /**
+   * @brief Constructor for the ArchiveReader class, throws std::runtime_error if the archive is invalid.
+   */
+  explicit ArchiveReader(const char *path);
+
+  ArchiveReader(const ArchiveReader&) = delete;
+  ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+  ~ArchiveReader();
+
+  /**
+   * @brief Get the IDs of the motors in the archive.
+   */
+  std::vector<uint8_t> motors() const;
+
+  /**
+   * @brief Summarize a motor over a time range.
+   *
+   * @param motor_id The motor ID, throws std::runtime_error if it is not archived.
+   *
+   * @param from_us The start of the range in microseconds since the Unix epoch, inclusive.
+   *
+   * @param to_us The end of the range, inclusive.
+   *
+   * @param hot_threshold The temperature counted as hot, in C.
+   */
+  MotorSummary summarize(uint8_t motor_id, int64_t from_us = INT64_MIN, int64_t to_us = INT64_MAX,
+                         int hot_threshold = 80) const;
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_ARCHIVE_HPP
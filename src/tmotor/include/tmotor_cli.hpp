@@ -0,0 +1,54 @@
+#ifndef H_TMOTOR_CLI_HPP
+#define H_TMOTOR_CLI_HPP
+
+/**
+ * @file tmotor_cli.hpp
+ * @brief Argument parsing shared by the command line tools.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdint.h>
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace TMotor
+{
+
+/**
+ * @brief Parse a comma separated list of hexadecimal motor IDs and ID ranges, e.g. "1,2,a-f".
+ *
+ * @param arg The list.
+ *
+ * @param motor_ids The IDs are appended to it in order.
+ *
+ * @return Whether the list is valid and not empty.
+ */
+inline bool parse_motor_ids(const std::string &arg, std::vector<uint8_t> &motor_ids) {
+  std::stringstream ss(arg);
+  std::string token;
+  while (std::getline(ss, token, ',')) {
+    size_t dash = token.find('-');
+    try {
+      int first = std::stoi(token.substr(0, dash), nullptr, 16);
+      int last = dash == std::string::npos ? first : std::stoi(token.substr(dash+1), nullptr, 16);
+      if (first < 0 || last > 0xFF || first > last) return false;
+      for (int id = first; id <= last; id++) {
+        motor_ids.push_back(id);
+      }
+    } catch (std::exception &e) {
+      return false;
+    }
+  }
+  return !motor_ids.empty();
+}
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_CLI_HPP
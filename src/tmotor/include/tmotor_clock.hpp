@@ -0,0 +1,181 @@
+#ifndef H_TMOTOR_CLOCK_HPP
+#define H_TMOTOR_CLOCK_HPP
+
+/**
+ * @file tmotor_clock.hpp
+ * @brief Clock abstraction used by the timers and schedulers of the library, with a virtual-time implementation.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <condition_variable>
+
+namespace TMotor
+{
+
+/**
+ * @brief Stop request of one loop
+ * A loop passes its token to every sleep, Clock::requestStop() then wakes that loop alone, the other threads
+ * sleeping on the same clock keep sleeping until their deadline.
+ */
+class StopToken {
+protected:
+  std::atomic<bool> _requested;
+
+public:
+  StopToken() :
+    _requested(false)
+  {}
+
+  StopToken(const StopToken&) = delete;
+  StopToken& operator=(const StopToken&) = delete;
+
+  bool stopRequested() const {
+    return _requested.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Clear the request before the loop is started again.
+   */
+  void reset() {
+    _requested.store(false, std::memory_order_release);
+  }
+
+  friend class Clock;
+};
+
+/**
+ * @brief Source of time and sleeps
+ * Time points are steady_clock time points so they can be stored in MotorState timestamps whatever the clock is.
+ * A sleep only returns before its deadline once the stop of its token is requested.
+ */
+class Clock {
+protected:
+  static void __request(StopToken &token) {
+    token._requested.store(true, std::memory_order_release);
+  }
+
+public:
+  typedef std::chrono::steady_clock::time_point time_point;
+  typedef std::chrono::steady_clock::duration duration;
+
+  virtual ~Clock() {}
+
+  virtual time_point now() = 0;
+
+  /**
+   * @brief Block the calling thread until the deadline or until the stop of the token is requested.
+   *
+   * @param token The stop token of the calling loop, nullptr to always sleep until the deadline.
+   */
+  virtual void sleepUntil(time_point deadline, const StopToken *token) = 0;
+
+  /**
+   * @brief Request the stop of a loop and wake it if it sleeps on the clock.
+   */
+  virtual void requestStop(StopToken &token) = 0;
+
+  /**
+   * @brief Tell the clock the calling thread will not sleep on it anymore, called by loops on exit.
+   */
+  virtual void leave() {}
+
+  void sleepUntil(time_point deadline) {
+    sleepUntil(deadline, nullptr);
+  }
+
+  void sleepFor(duration timeout, const StopToken *token = nullptr) {
+    sleepUntil(now() + timeout, token);
+  }
+
+  /**
+   * @brief Get the shared wall clock, the default clock of every bus.
+   */
+  static std::shared_ptr<Clock> system();
+};
+
+/**
+ * @brief Clock following std::chrono::steady_clock.
+ */
+class SystemClock : public Clock {
+protected:
+  std::mutex _mutex;
+  std::condition_variable _cv;
+
+public:
+  using Clock::sleepUntil;
+
+  time_point now() override;
+  void sleepUntil(time_point deadline, const StopToken *token) override;
+  void requestStop(StopToken &token) override;
+};
+
+/**
+ * @brief Clock whose time only moves when advanced
+ * Threads sleeping on the clock take part in lockstep: advance() moves the time to each pending deadline in turn,
+ * wakes the threads due and waits until every one of them is asleep again (or has left) before moving on. A
+ * controller and a simulated motor driven this way run as fast as the CPU allows and produce the same sequence of
+ * events on every run.
+ */
+class VirtualClock : public Clock {
+protected:
+  struct Sleeper {
+    time_point deadline;
+    const StopToken *token;
+    bool released;
+    bool advanced;           // released by advance() rather than by requestStop()
+  };
+
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  time_point _now;
+  std::vector<Sleeper*> _sleepers;
+  size_t _running;           // threads woken by advance() that have not slept again yet
+
+  void __settle(std::unique_lock<std::mutex> &lock);
+
+public:
+
+  /**
+   * @brief Constructor for the VirtualClock class.
+   *
+   * @param start The initial time, one second after the steady_clock epoch by default.
+   */
+  explicit VirtualClock(time_point start = time_point(std::chrono::seconds(1)));
+
+  using Clock::sleepUntil;
+
+  time_point now() override;
+  void sleepUntil(time_point deadline, const StopToken *token) override;
+  void requestStop(StopToken &token) override;
+  void leave() override;
+
+  /**
+   * @brief Move the time forward, stepping through every deadline on the way.
+   */
+  void advance(duration step);
+
+  /**
+   * @brief Move the time forward to a time point, stepping through every deadline on the way.
+   */
+  void advanceTo(time_point target);
+
+  /**
+   * @brief Wait in real time until the given number of threads sleep on the clock.
+   *
+   * @return Whether they did within the timeout.
+   */
+  bool waitForSleepers(size_t count, std::chrono::milliseconds timeout);
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_CLOCK_HPP
@@ -0,0 +1,181 @@
+#ifndef H_TMOTOR_CONTROLLER_HPP
+#define H_TMOTOR_CONTROLLER_HPP
+
+/**
+ * @file tmotor_controller.hpp
+ * @brief High-rate impedance (PD) control of AK motors on top of the current loop.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+#include <tmotor_metrics.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief Gains of the impedance law, current = kp*(position error) + kd*(velocity error) + feedforward.
+ */
+struct ImpedanceGains {
+  float kp;                  // A/deg
+  float kd;                  // A per feedback velocity unit (rpm)
+  float current_limit;       // A, the commanded current is clamped to +-current_limit
+};
+
+/**
+ * @brief Setpoint of the impedance law.
+ */
+struct ImpedanceTarget {
+  float position;            // deg
+  float velocity;            // rpm, in the feedback velocity unit
+  float feedforward;         // A
+};
+
+/**
+ * @brief Timing of the control loop since it was started.
+ */
+struct LoopStatistics {
+  uint64_t ticks;
+  uint64_t overruns;         // ticks that ended after the next deadline
+  uint64_t stale;            // motor ticks skipped because the feedback was too old
+  double wake_mean_us;       // mean lateness of the wake up against the deadline
+  double wake_max_us;
+  double jitter_us;          // standard deviation of the wake up lateness
+  double latency_mean_us;    // mean time from the deadline to the last command written
+  double latency_max_us;
+};
+
+/**
+ * @brief Impedance controller engine
+ * Runs a PD loop for every registered motor on a single thread at a fixed rate. Each tick reads the freshest
+ * feedback of the motor from the bus and writes a current command, gains and targets can be changed from any
+ * thread without locks. When the feedback of a motor is older than the feedback timeout it is commanded zero
+ * current instead. No command is sent while the bus is emergency stopped or to a motor stopped by a reflex.
+ */
+class ImpedanceController {
+protected:
+  struct Channel {
+    AKManager manager;
+    Mailbox<ImpedanceGains> gains;
+    Mailbox<ImpedanceTarget> target;
+    std::atomic<bool> enabled;
+
+    Channel(uint8_t motor_id, const ImpedanceGains &gains) :
+      manager(motor_id),
+      gains(gains),
+      target(),
+      enabled(true)
+    {}
+  };
+
+  std::shared_ptr<AKBus> _bus;
+  std::shared_ptr<Clock> _clock;
+  std::chrono::nanoseconds _period;
+  std::chrono::nanoseconds _feedback_timeout;
+  std::vector<std::unique_ptr<Channel>> _channels;
+  Channel *_channels_by_id[256];
+  StopToken _stop;
+  std::thread _loop;
+
+  /* statistics, only written by the loop thread */
+  std::atomic<uint64_t> _ticks;
+  std::atomic<uint64_t> _overruns;
+  std::atomic<uint64_t> _stale;
+  std::atomic<double> _wake_sum;
+  std::atomic<double> _wake_sq_sum;
+  std::atomic<double> _wake_max;
+  std::atomic<double> _latency_sum;
+  std::atomic<double> _latency_max;
+  std::shared_ptr<LatencyHistogram> _wake_histogram;
+  std::shared_ptr<LatencyHistogram> _latency_histogram;
+
+  void __tick();
+  void __run();
+
+public:
+
+  /**
+   * @brief Constructor for the ImpedanceController class.
+   *
+   * @param bus The connected bus the motors are on, the loop runs on the clock of the bus.
+   *
+   * @param period The control period, 1 ms by default.
+   */
+  ImpedanceController(std::shared_ptr<AKBus> bus, std::chrono::nanoseconds period = std::chrono::milliseconds(1));
+
+  ImpedanceController(const ImpedanceController&) = delete;
+  ImpedanceController& operator=(const ImpedanceController&) = delete;
+
+  /**
+   * @brief Destructor for the ImpedanceController class, stops the loop.
+   */
+  ~ImpedanceController();
+
+  /**
+   * @brief Register a motor, must be called before start().
+   *
+   * @param motor_id The motor ID.
+   *
+   * @param gains The initial gains, the initial target is zero.
+   */
+  void addMotor(uint8_t motor_id, const ImpedanceGains &gains);
+
+  /**
+   * @brief Set how old the feedback of a motor may be before it is commanded zero current.
+   *
+   * @param timeout The maximum feedback age, 50 ms by default.
+   */
+  void setFeedbackTimeout(std::chrono::nanoseconds timeout);
+
+  /**
+   * @brief Change the gains of a registered motor, lock-free.
+   */
+  void setGains(uint8_t motor_id, const ImpedanceGains &gains);
+
+  /**
+   * @brief Change the target of a registered motor, lock-free.
+   */
+  void setTarget(uint8_t motor_id, const ImpedanceTarget &target);
+
+  /**
+   * @brief Enable or disable the control of a registered motor, disabled motors are not sent any command.
+   */
+  void setEnabled(uint8_t motor_id, bool enabled);
+
+  /**
+   * @brief Start the control loop thread.
+   *
+   * @param priority The SCHED_FIFO priority of the loop thread, 0 keeps the default scheduler.
+   *
+   * @note Throws std::runtime_error if the real-time priority cannot be set.
+   */
+  void start(int priority = 0);
+
+  /**
+   * @brief Stop the control loop thread, the motors keep their last command.
+   */
+  void stop();
+
+  /**
+   * @brief Get the loop timing since start().
+   */
+  LoopStatistics getStatistics();
+
+  /**
+   * @brief Get the histogram of the wake up lateness against the deadlines, the scheduling jitter of the loop.
+   */
+  std::shared_ptr<const LatencyHistogram> getWakeHistogram();
+
+  /**
+   * @brief Get the histogram of the time from the deadlines to the last command written.
+   */
+  std::shared_ptr<const LatencyHistogram> getLatencyHistogram();
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_CONTROLLER_HPP
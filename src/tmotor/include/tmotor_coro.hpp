@@ -0,0 +1,340 @@
+#ifndef H_TMOTOR_CORO_HPP
+#define H_TMOTOR_CORO_HPP
+
+/**
+ * @file tmotor_coro.hpp
+ * @brief Optional C++20 coroutine layer sequencing motions on the feedback decoded by the bus reader.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#if !defined(__cpp_impl_coroutine)
+#error "tmotor_coro.hpp needs C++20 coroutines, compile the including sources with -std=c++20"
+#endif
+
+#include <tmotor.hpp>
+
+#include <cmath>
+#include <coroutine>
+#include <exception>
+#include <stdexcept>
+
+namespace TMotor
+{
+
+/**
+ * @brief A motion sequence, a coroutine that starts running as soon as it is called.
+ *
+ * It runs on the calling thread until its first co_await, then on the reader thread of the bus each time it is
+ * resumed. The task owns the coroutine, so it must outlive the sequence, destroying it earlier cancels the
+ * sequence at its pending co_await. The task may be destroyed from any thread: off the reader it first waits
+ * for the reader to finish resuming, so a running coroutine is never destroyed.
+ */
+class MotionTask {
+public:
+  struct promise_type {
+    std::exception_ptr exception;
+    std::atomic<bool> finished{false};
+    std::shared_ptr<std::recursive_mutex> lock; // of the CoroutineBus resuming it, set at the first suspension
+
+    /* Flags the task done once the coroutine is suspended for good, so it can be destroyed from any thread. */
+    struct FinalAwaiter {
+      bool await_ready() noexcept { return false; }
+      void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        handle.promise().finished.store(true, std::memory_order_release);
+      }
+      void await_resume() noexcept {}
+    };
+
+    MotionTask get_return_object() {
+      return MotionTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { exception = std::current_exception(); }
+  };
+
+  MotionTask(MotionTask &&other) noexcept :
+    _handle(other._handle)
+  {
+    other._handle = nullptr;
+  }
+
+  MotionTask& operator=(MotionTask &&other) noexcept {
+    if (this != &other) {
+      __destroy();
+      _handle = other._handle;
+      other._handle = nullptr;
+    }
+    return *this;
+  }
+
+  MotionTask(const MotionTask&) = delete;
+  MotionTask& operator=(const MotionTask&) = delete;
+
+  ~MotionTask() {
+    __destroy();
+  }
+
+  /**
+   * @brief Check whether the sequence has returned or thrown, safe from any thread.
+   */
+  bool done() const {
+    return _handle && _handle.promise().finished.load(std::memory_order_acquire);
+  }
+
+  /**
+   * @brief Rethrow the exception that ended a done sequence, if any.
+   */
+  void rethrow() const {
+    if (done() && _handle.promise().exception) {
+      std::rethrow_exception(_handle.promise().exception);
+    }
+  }
+
+private:
+  std::coroutine_handle<promise_type> _handle;
+
+  explicit MotionTask(std::coroutine_handle<promise_type> handle) :
+    _handle(handle)
+  {}
+
+  void __destroy() {
+    if (!_handle) return;
+    // the lock never changes once the task has been returned, and the reader holds it while resuming
+    std::shared_ptr<std::recursive_mutex> lock = _handle.promise().lock;
+    if (lock) {
+      std::lock_guard<std::recursive_mutex> guard(*lock);
+      _handle.destroy();
+    } else {
+      _handle.destroy();
+    }
+    _handle = nullptr;
+  }
+};
+
+/**
+ * @brief Awaitables resumed directly by the reader of a bus
+ * Each awaitable waits in an intrusive list of its motor, the reader resumes the ones whose condition the new
+ * state meets right after decoding, on its own thread and in the same wakeup. Hundreds of sequences waiting on
+ * the bus cost no thread and no allocation besides their coroutine frames.
+ *
+ * Must be constructed before the bus is connected, it installs the update callback of the bus, and the bus must
+ * not be connected to another CoroutineBus. The awaitables can only be awaited from MotionTask coroutines, and a
+ * sequence must wait on a single CoroutineBus.
+ */
+class CoroutineBus {
+public:
+  struct WaitLists;
+
+  /**
+   * @brief Link of the doubly linked, circular list of the waiters of a motor.
+   */
+  struct WaitLink {
+    WaitLink *prev;
+    WaitLink *next;
+
+    WaitLink() :
+      prev(this),
+      next(this)
+    {}
+
+    void insertAfter(WaitLink *position) {
+      prev = position;
+      next = position->next;
+      next->prev = this;
+      position->next = this;
+    }
+
+    void unlink() {
+      prev->next = next;
+      next->prev = prev;
+      prev = this;
+      next = this;
+    }
+  };
+
+  /**
+   * @brief A suspended coroutine waiting for a state of one motor.
+   */
+  struct Waiter : WaitLink {
+    std::shared_ptr<WaitLists> lists;
+    uint8_t motor_id;
+    std::coroutine_handle<> handle;
+    MotorState state;
+    bool waiting;
+
+    Waiter(std::shared_ptr<WaitLists> lists, uint8_t motor_id) :
+      WaitLink(),
+      lists(lists),
+      motor_id(motor_id),
+      handle(nullptr),
+      state(),
+      waiting(false)
+    {}
+
+    Waiter(const Waiter&) = delete;
+    Waiter& operator=(const Waiter&) = delete;
+
+    virtual ~Waiter();
+
+    /**
+     * @brief Whether the state ends the wait.
+     */
+    virtual bool ready(const MotorState &state) const = 0;
+
+    void await_suspend(std::coroutine_handle<MotionTask::promise_type> awaiting);
+    MotorState await_resume() { return state; }
+  };
+
+  /**
+   * @brief Waits for the next decoded frame of a motor.
+   */
+  struct SampleAwaiter : Waiter {
+    using Waiter::Waiter;
+
+    bool await_ready() { return false; }
+    bool ready(const MotorState &) const override { return true; }
+  };
+
+  /**
+   * @brief Waits until a motor reports a position close enough to a target.
+   */
+  struct PositionAwaiter : Waiter {
+    float target;            // deg
+    float tolerance;         // deg
+
+    PositionAwaiter(std::shared_ptr<WaitLists> lists, uint8_t motor_id, float target, float tolerance) :
+      Waiter(lists, motor_id),
+      target(target),
+      tolerance(tolerance)
+    {}
+
+    bool await_ready();
+    bool ready(const MotorState &state) const override {
+      return state.sequence > 0 && std::fabs(state.position - target) <= tolerance;
+    }
+  };
+
+  /**
+   * @brief The waiters of every motor, shared with the update callback so it never outlives them.
+   */
+  struct WaitLists {
+    std::shared_ptr<AKBus> bus;
+    std::recursive_mutex mutex; // held while resuming, the resumed coroutines wait again from the same thread
+    WaitLink heads[256];        // sentinels of the lists
+
+    void resume(uint8_t motor_id);
+  };
+
+  /**
+   * @brief Constructor for the CoroutineBus class.
+   *
+   * @param bus The bus whose reader resumes the coroutines, not connected yet.
+   */
+  explicit CoroutineBus(std::shared_ptr<AKBus> bus) :
+    _lists(std::make_shared<WaitLists>())
+  {
+    _lists->bus = bus;
+    std::weak_ptr<WaitLists> lists = _lists;
+    bus->setUpdateCallback([lists](uint8_t motor_id) {
+      std::shared_ptr<WaitLists> locked = lists.lock();
+      if (locked) locked->resume(motor_id);
+    });
+  }
+
+  CoroutineBus(const CoroutineBus&) = delete;
+  CoroutineBus& operator=(const CoroutineBus&) = delete;
+
+  /**
+   * @brief Wait for the next feedback of a motor, co_await returns its state.
+   */
+  SampleAwaiter nextSample(uint8_t motor_id) {
+    return SampleAwaiter(_lists, motor_id);
+  }
+
+  /**
+   * @brief Command a position and wait until the motor reports it, co_await returns the state reaching it.
+   *
+   * @param motor The motor, connected to the bus.
+   *
+   * @param position The target in degrees, sent with AKManager::sendPosition().
+   *
+   * @param tolerance The largest position error in degrees that ends the wait.
+   *
+   * @note Throws CANSocketException from the call if the command cannot be sent.
+   */
+  PositionAwaiter moveTo(AKManager &motor, float position, float tolerance) {
+    motor.sendPosition(position);
+    return PositionAwaiter(_lists, motor.getMotorID(), position, tolerance);
+  }
+
+  /**
+   * @brief Wait until a motor reports a position close enough to a target, without commanding it.
+   */
+  PositionAwaiter reach(uint8_t motor_id, float position, float tolerance) {
+    return PositionAwaiter(_lists, motor_id, position, tolerance);
+  }
+
+protected:
+  std::shared_ptr<WaitLists> _lists;
+};
+
+inline CoroutineBus::Waiter::~Waiter() {
+  std::lock_guard<std::recursive_mutex> lock(lists->mutex);
+  if (waiting) {
+    // the coroutine is destroyed while suspended, unlink it so the reader never resumes it
+    unlink();
+  }
+}
+
+inline void CoroutineBus::Waiter::await_suspend(std::coroutine_handle<MotionTask::promise_type> awaiting) {
+  MotionTask::promise_type &promise = awaiting.promise();
+  if (!promise.lock) {
+    // the first suspension returns the task to its caller, the lock is fixed before anyone can destroy it
+    promise.lock = std::shared_ptr<std::recursive_mutex>(lists, &lists->mutex);
+  } else if (promise.lock.get() != &lists->mutex) {
+    throw std::runtime_error("A motion sequence must wait on a single CoroutineBus.");
+  }
+  std::lock_guard<std::recursive_mutex> lock(lists->mutex);
+  handle = awaiting;
+  waiting = true;
+  insertAfter(&lists->heads[motor_id]);
+}
+
+inline bool CoroutineBus::PositionAwaiter::await_ready() {
+  state = lists->bus->peekState(motor_id);
+  return ready(state);
+}
+
+inline void CoroutineBus::WaitLists::resume(uint8_t motor_id) {
+  std::lock_guard<std::recursive_mutex> lock(mutex);
+  WaitLink *head = &heads[motor_id];
+  if (head->next == head) return;
+  MotorState current = bus->peekState(motor_id);
+  // a cursor in the list marks the waiters left to visit, so the resumed coroutines may destroy any waiter
+  // and wait again, in front of the cursor, without breaking the walk
+  WaitLink cursor;
+  cursor.insertAfter(head);
+  while (cursor.next != head) {
+    Waiter *waiter = static_cast<Waiter *>(cursor.next);
+    if (waiter->ready(current)) {
+      waiter->unlink();
+      waiter->state = current;
+      waiter->waiting = false;
+      waiter->handle.resume();
+    } else {
+      cursor.unlink();
+      cursor.insertAfter(waiter);
+    }
+  }
+  cursor.unlink();
+}
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_CORO_HPP
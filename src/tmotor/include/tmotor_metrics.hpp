@@ -0,0 +1,154 @@
+#ifndef H_TMOTOR_METRICS_HPP
+#define H_TMOTOR_METRICS_HPP
+
+/**
+ * @file tmotor_metrics.hpp
+ * @brief Lock-free latency histograms and a Prometheus text format exporter of the bus and loop metrics.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief Upper bounds of the LatencyHistogram buckets in microseconds, a last bucket counts everything above.
+ */
+constexpr double histogram_bounds_us[] = {
+  5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000
+};
+constexpr size_t histogram_buckets = sizeof(histogram_bounds_us) / sizeof(histogram_bounds_us[0]) + 1;
+
+/**
+ * @brief A copy of the buckets of a histogram, the counts are per bucket and not cumulative.
+ */
+struct HistogramSnapshot {
+  uint64_t buckets[histogram_buckets];
+  uint64_t count;            // sum of the buckets
+  double sum_us;
+};
+
+/**
+ * @brief Fixed-bucket histogram of durations with a single writer.
+ *
+ * The writer updates relaxed atomics without read-modify-write instructions, readers take snapshots at any time
+ * without ever blocking it. A snapshot taken during a record() may miss that sample in some of its fields.
+ */
+class LatencyHistogram {
+protected:
+  std::atomic<uint64_t> _buckets[histogram_buckets];
+  std::atomic<double> _sum_us;
+
+public:
+  LatencyHistogram();
+
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+  /**
+   * @brief Count a duration, must only be called from a single thread.
+   *
+   * @param us The duration in microseconds.
+   */
+  void record(double us);
+
+  /**
+   * @brief Zero the histogram, must only be called by the writer or while it is stopped.
+   */
+  void reset();
+
+  HistogramSnapshot snapshot() const;
+};
+
+/**
+ * @brief Serves the metrics of a bus in the Prometheus text format
+ * A low-priority thread answers HTTP GET requests on a Unix socket or on a localhost TCP port. Every scrape reads
+ * the traffic counters, the motor states through AKBus::peekState() and the registered histograms, which are all
+ * lock-free, so scraping never makes the reader, the writers or the control loops wait.
+ */
+class MetricsExporter {
+protected:
+  struct Histogram {
+    std::string name;
+    std::string help;
+    std::string labels;
+    std::shared_ptr<const LatencyHistogram> histogram;
+  };
+
+  std::shared_ptr<AKBus> _bus;
+  std::mutex _mutex;         // guards the registered histograms against the serving thread
+  std::vector<Histogram> _histograms;
+  int _listen_fd;
+  std::string _unix_path;
+  std::atomic<bool> _shutdown;
+  std::thread _server;
+
+  void __listen(int fd, const struct sockaddr *addr, socklen_t addr_len);
+  void __serve();
+  void __answer(int fd);
+
+public:
+
+  /**
+   * @brief Constructor for the MetricsExporter class, nothing is served until listenUnix() or listenTCP().
+   *
+   * @param bus The bus to export the traffic and motor states of.
+   */
+  explicit MetricsExporter(std::shared_ptr<AKBus> bus);
+
+  MetricsExporter(const MetricsExporter&) = delete;
+  MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+  /**
+   * @brief Destructor for the MetricsExporter class, stops serving and removes the Unix socket.
+   */
+  ~MetricsExporter();
+
+  /**
+   * @brief Export a histogram, in seconds as Prometheus expects.
+   *
+   * @param name The metric name, e.g. "tmotor_poll_rtt_seconds".
+   *
+   * @param help The description of the metric.
+   *
+   * @param labels Labels of this histogram without braces, e.g. "motor=\"0x01\"", histograms sharing a name are
+   * exported as one metric.
+   */
+  void addHistogram(const std::string &name, const std::string &help, const std::string &labels,
+                    std::shared_ptr<const LatencyHistogram> histogram);
+
+  /**
+   * @brief Serve on a Unix stream socket, throws std::runtime_error if it cannot be bound.
+   *
+   * @param path The socket path, an existing socket file is replaced.
+   */
+  void listenUnix(const char *path);
+
+  /**
+   * @brief Serve on a TCP port of the loopback interface, throws std::runtime_error if it cannot be bound.
+   *
+   * @param port The port, 0 picks a free one.
+   *
+   * @return The port listened on.
+   */
+  uint16_t listenTCP(uint16_t port);
+
+  /**
+   * @brief Stop serving.
+   */
+  void stop();
+
+  /**
+   * @brief Render the metrics in the Prometheus text exposition format, as served.
+   */
+  std::string render();
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_METRICS_HPP
@@ -0,0 +1,208 @@
+#ifndef H_TMOTOR_MODELS_HPP
+#define H_TMOTOR_MODELS_HPP
+
+/**
+ * @file tmotor_models.hpp
+ * @brief Compile-time traits of the AK motor variants and managers clamping and scaling commands per model.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief Limits AKManager has always applied, valid for any servo firmware but not tailored to a motor.
+ *
+ * A model is a struct with the same static constexpr members, any other variant can be described the same way.
+ * The current limits are the peak torque divided by the torque constant, the MIT ranges those of the firmware
+ * of the variant.
+ */
+struct AKGeneric {
+  static constexpr int pole_pairs = TMOTOR_AK_POLE_PAIRS;
+  static constexpr float gear_ratio = 1.0f;
+  static constexpr float torque_constant = 0.0f;     // Nm/A at the output, 0 if unknown
+  static constexpr float current_max = 60.0f;        // A, current loop
+  static constexpr float brake_current_max = 60.0f;  // A, brake
+  static constexpr int32_t erpm_max = 100000;        // electrical rpm, velocity loop
+  static constexpr float position_max = 36000.0f;    // deg, position loop
+  static constexpr int16_t acceleration_max = 200;   // position-velocity loop
+  static constexpr float mit_position_max = 12.5f;   // rad
+  static constexpr float mit_velocity_max = 50.0f;   // rad/s
+  static constexpr float mit_torque_max = 18.0f;     // Nm
+  static constexpr float mit_kp_max = 500.0f;        // Nm/rad
+  static constexpr float mit_kd_max = 5.0f;          // Nm*s/rad
+};
+
+struct AK60_6 : AKGeneric {
+  static constexpr int pole_pairs = 14;
+  static constexpr float gear_ratio = 6.0f;
+  static constexpr float torque_constant = 0.47f;
+  static constexpr float current_max = 19.0f;
+  static constexpr float brake_current_max = 19.0f;
+  static constexpr float mit_velocity_max = 45.0f;
+  static constexpr float mit_torque_max = 15.0f;
+};
+
+struct AK70_10 : AKGeneric {
+  static constexpr int pole_pairs = 21;
+  static constexpr float gear_ratio = 10.0f;
+  static constexpr float torque_constant = 1.23f;
+  static constexpr float current_max = 20.0f;
+  static constexpr float brake_current_max = 20.0f;
+  static constexpr float mit_velocity_max = 50.0f;
+  static constexpr float mit_torque_max = 25.0f;
+};
+
+struct AK80_9 : AKGeneric {
+  static constexpr int pole_pairs = 21;
+  static constexpr float gear_ratio = 9.0f;
+  static constexpr float torque_constant = 0.82f;
+  static constexpr float current_max = 22.0f;
+  static constexpr float brake_current_max = 22.0f;
+  static constexpr float mit_velocity_max = 50.0f;
+  static constexpr float mit_torque_max = 18.0f;
+};
+
+struct AK80_64 : AKGeneric {
+  static constexpr int pole_pairs = 21;
+  static constexpr float gear_ratio = 64.0f;
+  static constexpr float torque_constant = 8.7f;
+  static constexpr float current_max = 14.0f;
+  static constexpr float brake_current_max = 14.0f;
+  static constexpr float mit_velocity_max = 8.0f;
+  static constexpr float mit_torque_max = 144.0f;
+};
+
+/**
+ * @brief Clamps and wire scaling of the servo mode commands of a model, all evaluated at compile time for
+ * constant arguments.
+ */
+template <typename Model> struct ModelCodec {
+  /**
+   * @brief The servo mode limits of the model, AKMotor registers them on its manager.
+   */
+  static constexpr ServoLimits servoLimits() {
+    ServoLimits limits;
+    limits.pole_pairs = Model::pole_pairs;
+    limits.current_max = Model::current_max;
+    limits.brake_current_max = Model::brake_current_max;
+    limits.erpm_max = Model::erpm_max;
+    limits.position_max = Model::position_max;
+    limits.acceleration_max = Model::acceleration_max;
+    return limits;
+  }
+
+  static constexpr int32_t current(float amps) {
+    return servoLimits().current(amps);
+  }
+
+  static constexpr int32_t brake(float amps) {
+    return servoLimits().brake(amps);
+  }
+
+  static constexpr int32_t erpm(float rpm) {
+    return servoLimits().erpm(rpm);
+  }
+
+  static constexpr int32_t position(float degrees) {
+    return servoLimits().position(degrees);
+  }
+
+  static constexpr int32_t profilePosition(float degrees) {
+    return servoLimits().profilePosition(degrees);
+  }
+
+  static constexpr int16_t acceleration(int16_t acc) {
+    return servoLimits().acceleration(acc);
+  }
+
+  /**
+   * @brief The MIT mode ranges of the model.
+   */
+  static MITLimits mitLimits() {
+    MITLimits limits;
+    limits.position_max = Model::mit_position_max;
+    limits.velocity_max = Model::mit_velocity_max;
+    limits.torque_max = Model::mit_torque_max;
+    limits.kp_max = Model::mit_kp_max;
+    limits.kd_max = Model::mit_kd_max;
+    limits.torque_constant = Model::torque_constant;
+    return limits;
+  }
+};
+
+/**
+ * @brief Manager of a motor of a known model
+ * The servo mode commands are clamped and scaled with the constants of the model, with no per-call branching on
+ * the model. The servo and MIT limits of the manager are set from the model, so commands sent through an
+ * AKManager reference apply them too, and connect() registers them on the bus for the controllers, pollers and
+ * identifiers driving the same motor. Motors of different models can share a bus.
+ */
+template <typename Model> class AKMotor : public AKManager {
+public:
+  typedef Model model_type;
+  typedef ModelCodec<Model> codec_type;
+
+  AKMotor() :
+    AKManager()
+  {
+    setMITLimits(codec_type::mitLimits());
+    setServoLimits(codec_type::servoLimits());
+  }
+
+  explicit AKMotor(uint8_t motor_id) :
+    AKManager(motor_id)
+  {
+    setMITLimits(codec_type::mitLimits());
+    setServoLimits(codec_type::servoLimits());
+  }
+
+  /**
+   * @param current The current, clamped to +-Model::current_max.
+   */
+  void sendCurrent(float current) {
+    __send_int32(MotorModeID::CURRENTLOOP, codec_type::current(current), false);
+  }
+
+  /**
+   * @param current The brake current, clamped to [0, Model::brake_current_max].
+   */
+  void sendCurrentBrake(float current) {
+    __send_int32(MotorModeID::CURRENTBREAK, codec_type::brake(current), false);
+  }
+
+  /**
+   * @param vel The rotor velocity in rpm, converted with Model::pole_pairs.
+   */
+  void sendVelocity(float vel) {
+    __send_int32(MotorModeID::VELOCITY, codec_type::erpm(vel), true);
+  }
+
+  /**
+   * @param pose The position in degrees, clamped to +-Model::position_max.
+   */
+  void sendPosition(float pose) {
+    __send_int32(MotorModeID::POSITION, codec_type::position(pose), true);
+  }
+
+  void sendPositionVelocityAcceleration(float pose, int16_t vel, int16_t acc) {
+    __send_profile(codec_type::profilePosition(pose), vel, codec_type::acceleration(acc));
+  }
+
+  /**
+   * @brief Convert a torque at the output to the motor current, 0 if the torque constant is unknown.
+   */
+  static constexpr float torqueToCurrent(float torque) {
+    return Model::torque_constant > 0.0f ? torque / Model::torque_constant : 0.0f;
+  }
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_MODELS_HPP
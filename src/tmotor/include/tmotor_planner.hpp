@@ -0,0 +1,151 @@
+#ifndef H_TMOTOR_PLANNER_HPP
+#define H_TMOTOR_PLANNER_HPP
+
+/**
+ * @file tmotor_planner.hpp
+ * @brief Bus bandwidth planning and admission control of periodic motor commands.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief The command a motor is sent periodically, selects the CAN ID and the DLC the manager emits.
+ */
+enum class CommandType {
+  DUTY,                      // servo mode, 4 bytes
+  CURRENT,                   // servo mode, 4 bytes
+  BRAKE,                     // servo mode, 4 bytes
+  VELOCITY,                  // servo mode, 4 bytes
+  POSITION,                  // servo mode, 4 bytes
+  PVA,                       // servo mode position-velocity-acceleration, 8 bytes
+  MIT                        // MIT mode, 8 byte standard frame answered by an 8 byte reply
+};
+
+/**
+ * @brief Get the data length of the frames AKManager sends for a command.
+ */
+uint8_t commandDLC(CommandType command);
+
+/**
+ * @brief The periodic traffic of one motor.
+ */
+struct MotorLoad {
+  uint8_t motor_id;
+  CommandType command;
+  float rate;                // Hz, commands sent per second
+  float feedback_rate;       // Hz, servo mode feedback broadcast rate, ignored in MIT mode which replies per command
+
+  MotorLoad() :
+    motor_id(0),
+    command(CommandType::CURRENT),
+    rate(0.0f),
+    feedback_rate(0.0f)
+  {}
+
+  MotorLoad(uint8_t motor_id, CommandType command, float rate, float feedback_rate = 0.0f) :
+    motor_id(motor_id),
+    command(command),
+    rate(rate),
+    feedback_rate(feedback_rate)
+  {}
+};
+
+/**
+ * @brief Worst-case figures of a set of motor loads.
+ */
+struct BusPlan {
+  float utilization;         // fraction of the bitrate used by the worst-case (fully stuffed) frames
+  float max_latency_us;      // largest worst-case queuing plus transmission time of any frame, infinite if overloaded
+  std::vector<float> latency_us; // worst-case latency of the command of each load, in the order of the loads
+  bool schedulable;          // utilization within the headroom and every frame delivered within its period
+};
+
+/**
+ * @brief What BusPlanner::admit() does with a load that does not fit.
+ */
+enum class AdmissionPolicy {
+  REJECT,                    // leave the plan unchanged and refuse the load
+  DOWN_RATE                  // lower the command rate of the load to the largest that fits, MIT replies follow
+};
+
+/**
+ * @brief Bus planner
+ * Computes the worst-case utilization and latency of periodic motor traffic before it is put on the bus. Frames
+ * are sized with frameBits() at the DLC the manager actually emits, the servo feedback and MIT replies of each
+ * load are included, and latencies follow the classic CAN response time analysis: a frame waits for the longest
+ * lower priority frame already on the bus plus every higher priority frame released meanwhile.
+ */
+class BusPlanner {
+protected:
+  uint32_t _bitrate;
+  float _headroom;
+  int _mit_reply_id;
+  std::vector<MotorLoad> _loads;
+
+  struct Flow {
+    uint64_t priority;       // arbitration order, lower wins
+    float bits;
+    float period_us;
+    int load;                // index of the load whose command this is, -1 for feedback
+  };
+
+  std::vector<Flow> __flows(const std::vector<MotorLoad> &loads) const;
+  BusPlan __plan(const std::vector<MotorLoad> &loads) const;
+
+public:
+
+  /**
+   * @brief Constructor for the BusPlanner class.
+   *
+   * @param bitrate The CAN bitrate in bits per second.
+   *
+   * @param headroom The largest utilization admitted, 0.7 by default.
+   *
+   * @param mit_reply_id The standard CAN ID MIT mode replies are sent to, they win arbitration against commands.
+   */
+  BusPlanner(uint32_t bitrate, float headroom = 0.7f, int mit_reply_id = 0);
+
+  /**
+   * @brief Get the plan of an arbitrary set of loads against this bus, without admitting them.
+   */
+  BusPlan evaluate(const std::vector<MotorLoad> &loads) const;
+
+  /**
+   * @brief Get the plan of the admitted loads.
+   */
+  BusPlan plan() const;
+
+  /**
+   * @brief Add a load if the bus can carry it with the admitted ones.
+   *
+   * @param load The load, its command rate is lowered in place when down-rated.
+   *
+   * @param policy Whether to refuse a load that does not fit or to lower its command rate until it fits. The servo
+   * feedback rate is configured in the motor and never lowered, a load whose feedback alone does not fit is refused.
+   *
+   * @return Whether the load was admitted.
+   */
+  bool admit(MotorLoad &load, AdmissionPolicy policy = AdmissionPolicy::REJECT);
+
+  /**
+   * @brief Remove the admitted loads of a motor.
+   */
+  void release(uint8_t motor_id);
+
+  /**
+   * @brief Get the admitted loads.
+   */
+  const std::vector<MotorLoad> &loads() const;
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_PLANNER_HPP
@@ -0,0 +1,159 @@
+#ifndef H_TMOTOR_POLLER_HPP
+#define H_TMOTOR_POLLER_HPP
+
+/**
+ * @file tmotor_poller.hpp
+ * @brief Pipelined round-robin request/response polling of many AK motors on one bus.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+#include <tmotor_metrics.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief Polling statistics of one motor since the poller was started.
+ */
+struct PollStatistics {
+  uint8_t motor_id;
+  uint64_t requests;
+  uint64_t replies;
+  uint64_t timeouts;         // requests given up on after the reply timeout
+  double rate_hz;            // replies per second
+  double rtt_mean_us;        // mean time from the request written to the reply decoded
+  double rtt_max_us;
+};
+
+/**
+ * @brief Polling statistics of the whole fleet since the poller was started.
+ */
+struct PollerStatistics {
+  uint64_t cycles;           // rounds in which every motor was sent a request
+  double cycles_per_second;
+  size_t window;             // requests currently allowed in flight
+  std::vector<PollStatistics> motors;
+};
+
+/**
+ * @brief Round-robin poller
+ * Sends the request of each registered motor in turn without waiting for the previous motor to reply, so the
+ * turnaround time of one motor overlaps with the requests of the others. At most window requests are in flight,
+ * a motor has at most one, and replies are matched by the motor ID of the feedback decoded by the bus. The window
+ * grows by one after every timeout-free cycle and is halved on a timeout, converging on the largest number of
+ * outstanding requests the motors and the bus keep up with. No request is sent while the bus is emergency stopped
+ * or to a motor stopped by a reflex.
+ *
+ * @note Any feedback of a motor completes its request, motors broadcasting their feedback periodically should be
+ * switched to reply only.
+ */
+class RoundRobinPoller {
+protected:
+  struct Channel {
+    AKManager manager;
+    std::function<void(AKManager&)> request;
+    bool in_flight;
+    uint32_t sent_sequence;  // motor sequence when the request was written
+    Clock::time_point sent;
+
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> replies;
+    std::atomic<uint64_t> timeouts;
+    std::atomic<double> rtt_sum;
+    std::atomic<double> rtt_max;
+    std::shared_ptr<LatencyHistogram> rtt;
+
+    Channel(uint8_t motor_id, std::function<void(AKManager&)> request) :
+      manager(motor_id),
+      request(request),
+      in_flight(false),
+      sent_sequence(0),
+      sent(),
+      requests(0),
+      replies(0),
+      timeouts(0),
+      rtt_sum(0.0),
+      rtt_max(0.0),
+      rtt(std::make_shared<LatencyHistogram>())
+    {}
+  };
+
+  std::shared_ptr<AKBus> _bus;
+  std::shared_ptr<Clock> _clock;
+  size_t _max_in_flight;
+  std::chrono::nanoseconds _reply_timeout;
+  std::vector<std::unique_ptr<Channel>> _channels;
+  std::atomic<bool> _shutdown;
+  std::thread _loop;
+  Clock::time_point _started;
+
+  /* only written by the loop thread */
+  std::atomic<size_t> _window;
+  std::atomic<uint64_t> _cycles;
+
+  bool __collect(Clock::time_point now);
+  void __run();
+
+public:
+
+  /**
+   * @brief Constructor for the RoundRobinPoller class.
+   *
+   * @param bus The connected bus the motors are on, times are taken from the clock of the bus.
+   *
+   * @param max_in_flight The upper bound of the requests in flight, 4 by default.
+   *
+   * @param reply_timeout How long to wait for a reply before the request is given up on, 10 ms by default.
+   */
+  RoundRobinPoller(std::shared_ptr<AKBus> bus, size_t max_in_flight = 4,
+                   std::chrono::nanoseconds reply_timeout = std::chrono::milliseconds(10));
+
+  RoundRobinPoller(const RoundRobinPoller&) = delete;
+  RoundRobinPoller& operator=(const RoundRobinPoller&) = delete;
+
+  /**
+   * @brief Destructor for the RoundRobinPoller class, stops the loop.
+   */
+  ~RoundRobinPoller();
+
+  /**
+   * @brief Register a motor, must be called before start().
+   *
+   * @param motor_id The motor ID.
+   *
+   * @param request Sends the request of the motor through the given manager, e.g. a sendMIT() or sendCurrent()
+   * call. It is called from the poller thread.
+   */
+  void addMotor(uint8_t motor_id, std::function<void(AKManager&)> request);
+
+  /**
+   * @brief Start the polling thread.
+   */
+  void start();
+
+  /**
+   * @brief Stop the polling thread, outstanding requests are abandoned.
+   */
+  void stop();
+
+  /**
+   * @brief Get the achieved cycle rate and the per-motor reply rates since start().
+   */
+  PollerStatistics getStatistics();
+
+  /**
+   * @brief Get the histogram of the round-trip times of a motor since start().
+   *
+   * @return The histogram, nullptr if the motor was not added.
+   */
+  std::shared_ptr<const LatencyHistogram> getLatencyHistogram(uint8_t motor_id);
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_POLLER_HPP
@@ -0,0 +1,149 @@
+#ifndef H_TMOTOR_SIM_HPP
+#define H_TMOTOR_SIM_HPP
+
+/**
+ * @file tmotor_sim.hpp
+ * @brief Simulated AK motors on a virtual-time bus, for deterministic faster-than-real-time tests.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+#include <tmotor_clock.hpp>
+
+namespace TMotor
+{
+
+/**
+ * @brief Physical parameters of a simulated motor, seen from the rotor.
+ */
+struct MotorModel {
+  float inertia;             // kg*m^2
+  float damping;             // Nm*s/rad, viscous friction
+  float friction;            // Nm, Coulomb friction
+  float torque_constant;     // Nm/A
+  float current_limit;       // A
+  float velocity_kp;         // A per rpm, the velocity loop of the servo mode
+  float position_kp;         // rpm per degree, the position loop of the servo mode
+  float resistance;          // Ohm, winding resistance heating the motor
+  float thermal_resistance;  // K/W, winding to ambient
+  float thermal_capacity;    // J/K
+  float ambient;             // C
+  int pole_pairs;            // converts the electrical rpm of the velocity commands
+
+  MotorModel() :
+    inertia(1e-4f),
+    damping(1e-4f),
+    friction(0.0f),
+    torque_constant(0.1f),
+    current_limit(60.0f),
+    velocity_kp(0.02f),
+    position_kp(5.0f),
+    resistance(0.2f),
+    thermal_resistance(2.0f),
+    thermal_capacity(50.0f),
+    ambient(25.0f),
+    pole_pairs(TMOTOR_AK_POLE_PAIRS)
+  {}
+};
+
+/**
+ * @brief A motor answering servo mode commands
+ * Decodes the frames AKManager sends, integrates its rigid body and thermal model and encodes the 0x2900 feedback
+ * frame, with the same fixed-point scaling as a real motor.
+ */
+class SimulatedMotor {
+protected:
+  uint8_t _motor_id;
+  MotorModel _model;
+  MotorModeID _mode;
+  float _setpoint;           // A, rpm or degrees depending on the mode
+  float _position;           // rad
+  float _velocity;           // rad/s
+  float _current;            // A
+  float _temperature;        // C
+
+public:
+  SimulatedMotor(uint8_t motor_id, const MotorModel &model = MotorModel());
+
+  uint8_t getMotorID() const;
+
+  /**
+   * @brief Apply a command frame, frames of other motors are ignored.
+   *
+   * @return Whether the frame was addressed to this motor.
+   */
+  bool receive(const struct can_frame &frame);
+
+  /**
+   * @brief Integrate the motor over a time step.
+   */
+  void step(std::chrono::nanoseconds dt);
+
+  /**
+   * @brief Encode the current state as a servo mode feedback frame.
+   */
+  void feedback(struct can_frame &frame) const;
+
+  float getPosition() const;     // degrees
+  float getVelocity() const;     // rpm
+  float getCurrent() const;      // A
+  float getTemperature() const;  // C
+};
+
+/**
+ * @brief Lockstep simulation of motors behind a bus
+ * Opens the bus on one end of a socket pair with a virtual clock, and serves the other end with simulated motors.
+ * Every step delivers the commands written since the previous step, integrates the motors, waits until the bus
+ * decoded their feedback and then advances the clock, waking controllers sleeping on it.
+ */
+class Simulation {
+protected:
+  std::shared_ptr<AKBus> _bus;
+  std::shared_ptr<VirtualClock> _clock;
+  std::vector<std::unique_ptr<SimulatedMotor>> _motors;
+  int _fd;
+  uint64_t _steps;
+
+public:
+
+  /**
+   * @brief Constructor for the Simulation class, opens the bus and gives it a virtual clock.
+   *
+   * @param bus The bus to simulate, it must not be connected to anything else.
+   */
+  explicit Simulation(std::shared_ptr<AKBus> bus);
+
+  Simulation(const Simulation&) = delete;
+  Simulation& operator=(const Simulation&) = delete;
+
+  ~Simulation();
+
+  /**
+   * @brief Add a simulated motor.
+   */
+  SimulatedMotor &addMotor(uint8_t motor_id, const MotorModel &model = MotorModel());
+
+  std::shared_ptr<VirtualClock> getClock();
+
+  /**
+   * @brief Run one step, see the class description.
+   *
+   * @note Throws CANSocketException if the bus does not decode the feedback within a second of real time.
+   */
+  void step(std::chrono::nanoseconds dt);
+
+  /**
+   * @brief Run steps until the given amount of virtual time has passed.
+   */
+  void run(std::chrono::nanoseconds duration, std::chrono::nanoseconds dt);
+
+  uint64_t getSteps() const;
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_SIM_HPP
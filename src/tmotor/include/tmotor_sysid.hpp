@@ -0,0 +1,203 @@
+#ifndef H_TMOTOR_SYSID_HPP
+#define H_TMOTOR_SYSID_HPP
+
+/**
+ * @file tmotor_sysid.hpp
+ * @brief Chirp and PRBS excitation of AK motors and least squares fitting of their rigid body model.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <tmotor.hpp>
+
+namespace TMotor
+{
+
+enum class ExcitationType {
+  CHIRP,                     // sine sweeping exponentially from the start to the end frequency
+  PRBS                       // maximum length pseudo-random binary sequence of +-amplitude
+};
+
+/**
+ * @brief The signal played to one motor.
+ */
+struct ExcitationConfig {
+  ExcitationType type;
+  MotorModeID mode;          // CURRENTLOOP (A) or VELOCITY (rpm)
+  float amplitude;
+  float offset;
+  float start_frequency;     // Hz, chirp
+  float end_frequency;       // Hz, chirp
+  float bit_time;            // s, PRBS
+  uint16_t seed;             // PRBS, any non-zero value
+  std::chrono::nanoseconds duration;
+
+  ExcitationConfig() :
+    type(ExcitationType::CHIRP),
+    mode(MotorModeID::CURRENTLOOP),
+    amplitude(1.0f),
+    offset(0.0f),
+    start_frequency(0.5f),
+    end_frequency(20.0f),
+    bit_time(0.01f),
+    seed(0xACE1),
+    duration(std::chrono::seconds(5))
+  {}
+};
+
+/**
+ * @brief Samples of an excitation signal.
+ */
+class ExcitationSignal {
+protected:
+  ExcitationConfig _config;
+  std::vector<int8_t> _bits; // the PRBS, one entry per bit time
+
+public:
+  explicit ExcitationSignal(const ExcitationConfig &config);
+
+  /**
+   * @brief Get the command at a time since the start, the offset alone past the duration.
+   */
+  float at(double seconds) const;
+};
+
+/**
+ * @brief Rigid body model fitted to the feedback of a motor
+ * The model is current = a*acceleration + b*velocity + c*sign(velocity) with the velocity of the rotor in rad/s.
+ * Scaled by the torque constant a, b and c are the inertia, the viscous damping and the Coulomb friction.
+ */
+struct IdentifiedModel {
+  uint8_t motor_id;
+  size_t samples;            // feedback frames used
+  double current_per_acceleration; // a, A*s^2/rad
+  double current_per_velocity;     // b, A*s/rad
+  double friction_current;         // c, A
+  double inertia;            // kg*m^2, 0 without a torque constant
+  double damping;            // Nm*s/rad, 0 without a torque constant
+  double friction;           // Nm, 0 without a torque constant
+  double bandwidth_hz;       // corner frequency b/(2*pi*a) of the velocity response to current
+  double r_squared;          // share of the current variance the model explains
+};
+
+/**
+ * @brief Fit the model to recorded feedback.
+ *
+ * The model is integrated over sliding windows so the velocity is never differentiated, each window is one row of
+ * the least squares problem. The rows are split between threads which accumulate their normal equations, summed
+ * and solved once.
+ *
+ * @param samples The feedback in the order it was received.
+ *
+ * @param window Feedback frames per window.
+ *
+ * @param threads Threads accumulating the rows, 0 for one per hardware thread.
+ *
+ * @param torque_constant Nm/A, 0 if unknown.
+ *
+ * @return The fit, throws std::runtime_error if the samples do not excite the model enough to be fitted.
+ */
+IdentifiedModel fitModel(const std::vector<MotorState> &samples, size_t window = 10, unsigned threads = 0,
+                         float torque_constant = 0.0f);
+
+/**
+ * @brief Identification of a fleet of motors
+ * A loop on the clock of the bus plays the excitation of every motor at a fixed rate through AKManager, and
+ * records every feedback frame the bus decodes. Once the longest excitation is over the motors are commanded
+ * zero and the loop stops, fit() then fits every motor concurrently.
+ */
+class SystemIdentifier {
+protected:
+  struct Channel {
+    AKManager manager;
+    ExcitationSignal signal;
+    ExcitationConfig config;
+    float torque_constant;
+    std::shared_ptr<SampleBuffer> buffer;
+    uint64_t cursor;
+    std::vector<MotorState> samples;
+
+    Channel(uint8_t motor_id, const ExcitationConfig &config, float torque_constant) :
+      manager(motor_id),
+      signal(config),
+      config(config),
+      torque_constant(torque_constant),
+      buffer(),
+      cursor(0)
+    {}
+  };
+
+  std::shared_ptr<AKBus> _bus;
+  std::shared_ptr<Clock> _clock;
+  std::chrono::nanoseconds _period;
+  std::vector<std::unique_ptr<Channel>> _channels;
+  StopToken _stop;
+  std::atomic<bool> _done;
+  std::thread _loop;
+
+  void __record(Channel &channel);
+  void __command(Channel &channel, float value);
+  void __run();
+
+public:
+
+  /**
+   * @brief Constructor for the SystemIdentifier class.
+   *
+   * @param bus The connected bus the motors are on, the loop runs on the clock of the bus.
+   *
+   * @param period The command period, 1 ms by default.
+   */
+  SystemIdentifier(std::shared_ptr<AKBus> bus, std::chrono::nanoseconds period = std::chrono::milliseconds(1));
+
+  SystemIdentifier(const SystemIdentifier&) = delete;
+  SystemIdentifier& operator=(const SystemIdentifier&) = delete;
+
+  /**
+   * @brief Destructor for the SystemIdentifier class, stops the loop and the recording.
+   */
+  ~SystemIdentifier();
+
+  /**
+   * @brief Register a motor, must be called before start().
+   *
+   * @param torque_constant Nm/A scaling the fit to physical units, 0 if unknown.
+   */
+  void addMotor(uint8_t motor_id, const ExcitationConfig &config, float torque_constant = 0.0f);
+
+  /**
+   * @brief Start the excitation, the previous recordings are discarded.
+   */
+  void start();
+
+  /**
+   * @brief Check whether every excitation has been played.
+   */
+  bool isDone();
+
+  /**
+   * @brief Stop the loop, the motors are commanded zero if it was still running.
+   */
+  void stop();
+
+  /**
+   * @brief Get the feedback recorded for a motor, call once stopped.
+   */
+  const std::vector<MotorState> &getSamples(uint8_t motor_id);
+
+  /**
+   * @brief Fit every motor concurrently, call once stopped.
+   *
+   * @param window Feedback frames per integration window.
+   *
+   * @return The fits in the order the motors were added, throws std::runtime_error if a motor cannot be fitted.
+   */
+  std::vector<IdentifiedModel> fit(size_t window = 10);
+};
+
+} // namespace TMotor
+
+#endif // H_TMOTOR_SYSID_HPP
@@ -0,0 +1,147 @@
+#ifndef H_TMOTOR_TRACE_HPP
+#define H_TMOTOR_TRACE_HPP
+
+/**
+ * @file tmotor_trace.hpp
+ * @brief Compile-time optional trace points written to per-thread buffers and saved as a Chrome trace.
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace TMotor
+{
+
+/**
+ * @brief A traced span, or an instant if its duration is zero.
+ */
+struct TraceEvent {
+  const char *name;          // a string literal, only the pointer is stored
+  uint64_t start_ns;         // steady clock
+  uint64_t duration_ns;
+};
+
+/**
+ * @brief Ring of the events of one thread, written only by that thread.
+ */
+class TraceBuffer {
+protected:
+  std::unique_ptr<TraceEvent[]> _events;
+  size_t _mask;
+  std::atomic<uint64_t> _head; // number of events recorded so far
+  std::atomic<uint64_t> _tail; // events before it were discarded
+
+public:
+  const int tid;
+  std::string name;
+  std::atomic<bool> exited;
+
+  TraceBuffer(size_t capacity, int tid);
+
+  void push(const char *name, uint64_t start_ns, uint64_t duration_ns);
+
+  /**
+   * @brief Copy the newest events, oldest first, returns their number.
+   */
+  size_t copy(TraceEvent *out, size_t max) const;
+
+  /**
+   * @brief Make copy() skip the events recorded so far, safe while the owner keeps recording.
+   */
+  void discard();
+
+  size_t capacity() const;
+};
+
+/**
+ * @brief Process-wide trace recorder
+ * Each thread records into its own ring buffer, allocated on its first event, so recording never takes a lock
+ * or a system call. When a ring is full the oldest events are overwritten. write() saves every buffer in the
+ * Chrome trace event format, which chrome://tracing and ui.perfetto.dev open.
+ *
+ * The library only records when compiled with TMOTOR_TRACING defined (cmake -DTMOTOR_TRACING=on), otherwise
+ * the trace macros expand to nothing.
+ */
+class Tracer {
+public:
+  /**
+   * @brief Set the number of events kept per thread, used by the buffers of threads that have not traced yet.
+   *
+   * @param events The capacity, rounded up to a power of two, 65536 by default.
+   */
+  static void setCapacity(size_t events);
+
+  /**
+   * @brief Name the calling thread in the trace.
+   */
+  static void nameThread(const char *name);
+
+  /**
+   * @brief Get the steady clock in nanoseconds.
+   */
+  static uint64_t now();
+
+  /**
+   * @brief Record an event of the calling thread.
+   *
+   * @param name A string literal naming the event.
+   */
+  static void record(const char *name, uint64_t start_ns, uint64_t duration_ns);
+
+  /**
+   * @brief Save the events of every thread as a Chrome trace JSON file.
+   *
+   * @note Events recorded while writing may be missing, or torn at the oldest end of a full buffer, stop the
+   * traced threads first for an exact trace.
+   *
+   * @return The number of events written, throws std::runtime_error if the file cannot be written.
+   */
+  static size_t write(const char *path);
+
+  /**
+   * @brief Drop the recorded events and the buffers of the threads that have exited.
+   */
+  static void clear();
+};
+
+/**
+ * @brief Records a span from its construction to its destruction.
+ */
+class TraceScope {
+protected:
+  const char *_name;
+  uint64_t _start;
+
+public:
+  explicit TraceScope(const char *name) :
+    _name(name),
+    _start(Tracer::now())
+  {}
+
+  ~TraceScope() {
+    Tracer::record(_name, _start, Tracer::now() - _start);
+  }
+};
+
+} // namespace TMotor
+
+#ifdef TMOTOR_TRACING
+#define TMOTOR_TRACE_CONCAT_(a, b) a##b
+#define TMOTOR_TRACE_CONCAT(a, b) TMOTOR_TRACE_CONCAT_(a, b)
+#define TMOTOR_TRACE_SCOPE(name) TMotor::TraceScope TMOTOR_TRACE_CONCAT(_trace_scope_, __LINE__)(name)
+#define TMOTOR_TRACE_INSTANT(name) TMotor::Tracer::record(name, TMotor::Tracer::now(), 0)
+#define TMOTOR_TRACE_THREAD(name) TMotor::Tracer::nameThread(name)
+#else
+#define TMOTOR_TRACE_SCOPE(name) ((void) 0)
+#define TMOTOR_TRACE_INSTANT(name) ((void) 0)
+#define TMOTOR_TRACE_THREAD(name) ((void) 0)
+#endif
+
+#endif // H_TMOTOR_TRACE_HPP
@@ -10,91 +10,1018 @@
  */
 
 #include "../include/tmotor.hpp"
+#include "../include/tmotor_trace.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <alloca.h>
+#include <sys/mman.h>
 
 using namespace TMotor;
 
-std::string fault_to_string(MotorFault &fault) {
-  switch (fault) {
-    case MotorFault::NONE:
-      return std::string("None");
-    case MotorFault::OVERTEMPERATURE:
-      return std::string("Overtemperature");
-    case MotorFault::OVERCURRENT:
-      return std::string("Overcurrent");
-    case MotorFault::OVERVOLTAGE:
-      return std::string("Overvoltage");
-    case MotorFault::UNDERVOLTAGE:
-      return std::string("Undervoltage");
-    case MotorFault::ENCODER:
-      return std::string("Encoder");
-    case MotorFault::HARDWARE:
-      return std::string("Hardware");
-    default:
-      return std::string("INVALID FAULT");
-  }
-}
-
-void AKManager::__read_motor_message() {
-  struct can_frame rframe;
-  int nbytes = read(_can_fd, &rframe, sizeof(struct can_frame));
-  if (nbytes < sizeof(struct can_frame)) {
+std::string TMotor::fault_to_string(MotorFault &fault) {
+  return std::string(fault_to_cstr(fault));
+}
+
+bool TMotor::lockMemory() {
+  return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+void TMotor::prefaultStack(size_t bytes) {
+  volatile char *stack = (volatile char *) alloca(bytes);
+  for (size_t i = 0; i < bytes; i += 4096) {
+    stack[i] = 0;
+  }
+}
+
+uint32_t TMotor::frameBits(bool extended, uint8_t dlc) {
+  uint32_t header = extended ? 54 : 34; // bits exposed to stuffing besides the data
+  uint32_t stuffed = header + 8*dlc;
+  return stuffed + 13 + (stuffed - 1) / 4;
+}
+
+static uint32_t clamp_uint(float x, float offset, float scale, uint32_t max) {
+  float scaled = (x - offset) * scale + 0.5f;
+  if (scaled <= 0.0f) return 0;
+  if (scaled >= (float) max) return max;
+  return (uint32_t) scaled;
+}
+
+MITCodec::MITCodec() :
+  MITCodec(MITLimits())
+{}
+
+MITCodec::MITCodec(const MITLimits &limits) :
+  _limits(limits),
+  _position_scale(65535.0f / (2.0f * limits.position_max)),
+  _velocity_scale(4095.0f / (2.0f * limits.velocity_max)),
+  _torque_scale(4095.0f / (2.0f * limits.torque_max)),
+  _kp_scale(4095.0f / limits.kp_max),
+  _kd_scale(4095.0f / limits.kd_max)
+{}
+
+const MITLimits &MITCodec::limits() const {
+  return _limits;
+}
+
+void MITCodec::pack(uint8_t motor_id, const MITCommand &command, struct can_frame &frame) const {
+  uint32_t p = clamp_uint(command.position, -_limits.position_max, _position_scale, 65535);
+  uint32_t v = clamp_uint(command.velocity, -_limits.velocity_max, _velocity_scale, 4095);
+  uint32_t kp = clamp_uint(command.kp, 0.0f, _kp_scale, 4095);
+  uint32_t kd = clamp_uint(command.kd, 0.0f, _kd_scale, 4095);
+  uint32_t t = clamp_uint(command.torque, -_limits.torque_max, _torque_scale, 4095);
+  frame.can_id = motor_id;
+  frame.can_dlc = 8;
+  frame.data[0] = p >> 8;
+  frame.data[1] = p & 0xFF;
+  frame.data[2] = v >> 4;
+  frame.data[3] = ((v & 0xF) << 4) | (kp >> 8);
+  frame.data[4] = kp & 0xFF;
+  frame.data[5] = kd >> 4;
+  frame.data[6] = ((kd & 0xF) << 4) | (t >> 8);
+  frame.data[7] = t & 0xFF;
+}
+
+bool MITCodec::unpack(const struct can_frame &frame, MITReply &reply) const {
+  if (frame.can_dlc < 6) {
+    return false;
+  }
+  uint32_t p = frame.data[1] << 8 | frame.data[2];
+  uint32_t v = frame.data[3] << 4 | frame.data[4] >> 4;
+  uint32_t t = (frame.data[4] & 0xF) << 8 | frame.data[5];
+  reply.motor_id = frame.data[0];
+  reply.position = p / _position_scale - _limits.position_max;
+  reply.velocity = v / _velocity_scale - _limits.velocity_max;
+  reply.torque = t / _torque_scale - _limits.torque_max;
+  reply.temperature = frame.can_dlc > 6 ? (int8_t) frame.data[6] : 0;
+  reply.error = frame.can_dlc > 7 ? frame.data[7] : 0;
+  return true;
+}
+
+float MITCodec::torqueToCurrent(float torque) const {
+  return _limits.torque_constant > 0.0f ? torque / _limits.torque_constant : torque;
+}
+
+void MITCodec::packSpecial(uint8_t motor_id, uint8_t last, struct can_frame &frame) {
+  frame.can_id = motor_id;
+  frame.can_dlc = 8;
+  memset(frame.data, 0xFF, 7);
+  frame.data[7] = last;
+}
+
+/* Time constant of a first order low-pass filter with the given cutoff, 0 passes every sample through. */
+static float time_constant(float cutoff) {
+  return cutoff > 0.0f ? 1.0f / (2.0f * (float) M_PI * cutoff) : 0.0f;
+}
+
+DerivedSignalFilter::DerivedSignalFilter() :
+  DerivedSignalFilter(DerivedConfig())
+{}
+
+DerivedSignalFilter::DerivedSignalFilter(const DerivedConfig &config) :
+  _config(config),
+  _velocity_tau(time_constant(config.velocity_cutoff)),
+  _acceleration_tau(time_constant(config.acceleration_cutoff)),
+  _temperature_tau(time_constant(config.temperature_cutoff)),
+  _primed(false),
+  _last(),
+  _temperature(0.0f),
+  _signals()
+{}
+
+const DerivedConfig &DerivedSignalFilter::config() const {
+  return _config;
+}
+
+void DerivedSignalFilter::reset() {
+  _primed = false;
+  _signals = DerivedSignals();
+}
+
+const DerivedSignals &DerivedSignalFilter::update(const MotorState &state) {
+  if (!_primed) {
+    _primed = true;
+    _last = state.timestamp;
+    _temperature = state.temperature;
+    _signals.velocity = state.velocity;
+    _signals.acceleration = 0.0f;
+    _signals.temperature_rate = 0.0f;
+  } else {
+    float dt = std::chrono::duration<float>(state.timestamp - _last).count();
+    if (dt > 0.0f) {
+      _last = state.timestamp;
+      float velocity = _signals.velocity + (state.velocity - _signals.velocity) * dt / (dt + _velocity_tau);
+      float acceleration = (velocity - _signals.velocity) / dt;
+      _signals.acceleration += (acceleration - _signals.acceleration) * dt / (dt + _acceleration_tau);
+      _signals.velocity = velocity;
+      float temperature = _temperature + (state.temperature - _temperature) * dt / (dt + _temperature_tau);
+      float temperature_rate = (temperature - _temperature) / dt;
+      _signals.temperature_rate += (temperature_rate - _signals.temperature_rate) * dt / (dt + _temperature_tau);
+      _temperature = temperature;
+    }
+  }
+  float shaft_speed = _signals.velocity / _config.pole_pairs / TMOTOR_RADS_TO_RPM; // rad/s
+  _signals.power = _config.torque_constant * state.current * shaft_speed +
+                   _config.resistance * state.current * state.current;
+  return _signals;
+}
+
+float BusStatistics::utilization(const BusStatistics &previous) const {
+  double elapsed = std::chrono::duration<double>(timestamp - previous.timestamp).count();
+  if (elapsed <= 0.0 || bitrate == 0) {
+    return 0.0f;
+  }
+  return (float) (100.0 * (bits - previous.bits) / (elapsed * bitrate));
+}
+
+SampleBuffer::SampleBuffer(size_t capacity) :
+  _mask(0),
+  _head(0)
+{
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  _slots.reset(new Slot[size]());
+  _mask = size - 1;
+}
+
+size_t SampleBuffer::capacity() {
+  return _mask + 1;
+}
+
+uint64_t SampleBuffer::head() {
+  return _head.load(std::memory_order_acquire);
+}
+
+void SampleBuffer::push(const MotorState &state) {
+  uint64_t index = _head.load(std::memory_order_relaxed);
+  Slot &slot = _slots[index & _mask];
+  slot.sequence.store(2*index + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.state = state;
+  slot.sequence.store(2*index + 2, std::memory_order_release);
+  _head.store(index + 1, std::memory_order_release);
+}
+
+size_t SampleBuffer::pull(uint64_t &cursor, MotorState *out, size_t max) {
+  uint64_t head = _head.load(std::memory_order_acquire);
+  if (head - cursor > capacity()) {
+    cursor = head - capacity();
+  }
+  size_t count = 0;
+  while (cursor < head && count < max) {
+    Slot &slot = _slots[cursor & _mask];
+    uint64_t before = slot.sequence.load(std::memory_order_acquire);
+    out[count] = slot.state;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+    if (before == 2*cursor + 2 && after == before) {
+      count++;
+    }
+    cursor++;
+  }
+  return count;
+}
+
+/* Packs the zero gain and torque command of a motor, emergencyStop() sends it without touching the codec. */
+static uint64_t mit_stop_data(const MITCodec &codec, uint8_t motor_id) {
+  struct can_frame frame;
+  codec.pack(motor_id, MITCommand{0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, frame);
+  uint64_t data = 0;
+  for (int i = 0; i < 8; i++) {
+    data |= (uint64_t) frame.data[i] << (8*i);
+  }
+  return data;
+}
+
+void AKBus::__read_motor_messages() {
+  struct pollfd pfd;
+  pfd.fd = _can_fd;
+  pfd.events = POLLIN;
+  int ready;
+  {
+    TMOTOR_TRACE_SCOPE("rx.poll");
+    ready = poll(&pfd, 1, 100);
+  }
+  if (ready <= 0) {
     return;
   }
+  __drain();
+}
+
+/* Drains every pending frame before notifying the waiters. */
+size_t AKBus::__drain() {
+  struct can_frame rframe;
+  char control[CMSG_SPACE(sizeof(uint32_t))];
+  struct iovec iov;
+  iov.iov_base = &rframe;
+  iov.iov_len = sizeof(struct can_frame);
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  bool updated = false;
+  size_t frames = 0;
+  while (true) {
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t received;
+    {
+      TMOTOR_TRACE_SCOPE("rx.recv");
+      received = recvmsg(_can_fd, &msg, MSG_DONTWAIT);
+    }
+    if (received != sizeof(struct can_frame)) {
+      break;
+    }
+    frames++;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+        uint32_t kernel_dropped;
+        memcpy(&kernel_dropped, CMSG_DATA(cmsg), sizeof(kernel_dropped));
+        __count_dropped(kernel_dropped);
+      }
+    }
+    if (rframe.can_id & CAN_ERR_FLAG) {
+      _error_frames.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+    uint8_t dlc = rframe.can_dlc > 8 ? 8 : rframe.can_dlc;
+    AtomicCounters &traffic = _traffic[rframe.can_id & 0xFF];
+    traffic.rx_frames.fetch_add(1, std::memory_order_relaxed);
+    traffic.rx_bytes.fetch_add(dlc, std::memory_order_relaxed);
+    _rx_frames.fetch_add(1, std::memory_order_relaxed);
+    _rx_bytes.fetch_add(dlc, std::memory_order_relaxed);
+    _bits.fetch_add(frameBits(rframe.can_id & CAN_EFF_FLAG, dlc), std::memory_order_relaxed);
+    TMOTOR_TRACE_SCOPE("rx.decode");
+    if (rframe.can_id & CAN_EFF_FLAG) {
+      updated |= __decode_servo(rframe);
+    } else if (_mit_reply_id >= 0 && (int) (rframe.can_id & CAN_SFF_MASK) == _mit_reply_id) {
+      updated |= __decode_mit(rframe);
+    }
+  }
+  if (updated) {
+    __report_reflexes();
+    {
+      TMOTOR_TRACE_SCOPE("rx.notify");
+      _update_cv.notify_all();
+    }
+    for (int i = 0; i < 8; i++) {
+      while (_updated[i] != 0) {
+        int bit = __builtin_ctz(_updated[i]);
+        _updated[i] &= _updated[i] - 1;
+        if (_update_callback) {
+          _update_callback(32*i + bit);
+        }
+      }
+    }
+  }
+  return frames;
+}
+
+bool AKBus::__decode_servo(const struct can_frame &rframe) {
   if (rframe.can_dlc != 8) {
+    return false;
+  }
+  if (((rframe.can_id & CAN_EFF_MASK) & ~0xFFu) != TMOTOR_AK_FEEDBACK_ID) {
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+  {
+    TMOTOR_TRACE_SCOPE("rx.lock");
+    lock.lock();
+  }
+  uint8_t motor_id = rframe.can_id & 0xFF;
+  MotorState &state = _states[motor_id];
+  state.position = ((int16_t) (rframe.data[0] << 8 | rframe.data[1])) * 0.1f;
+  state.velocity = ((int16_t) (rframe.data[2] << 8 | rframe.data[3]));
+  state.current = ((int16_t) (rframe.data[4] << 8 | rframe.data[5])) * 0.01f;
+  state.temperature = rframe.data[6];
+  state.motor_fault = (MotorFault) rframe.data[7];
+  __publish(motor_id);
+  return true;
+}
+
+bool AKBus::__decode_mit(const struct can_frame &rframe) {
+  if (rframe.can_dlc < 6) {
+    return false;
+  }
+  std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+  {
+    TMOTOR_TRACE_SCOPE("rx.lock");
+    lock.lock();
+  }
+  uint8_t motor_id = rframe.data[0];
+  MITReply reply;
+  if (!_mit_codecs[motor_id].unpack(rframe, reply)) {
+    return false;
+  }
+  MotorState &state = _states[motor_id];
+  state.position = reply.position * TMOTOR_RAD_TO_DEG;
+  state.velocity = reply.velocity * TMOTOR_RADS_TO_RPM;
+  state.current = _mit_codecs[motor_id].torqueToCurrent(reply.torque);
+  if (rframe.can_dlc == 8) {
+    state.temperature = reply.temperature;
+    state.motor_fault = (MotorFault) reply.error;
+  }
+  __publish(motor_id);
+  return true;
+}
+
+void AKBus::__publish(uint8_t motor_id) {
+  MotorState &state = _states[motor_id];
+  state.sequence++;
+  state.timestamp = _clock->now();
+  state.derived = _derived[motor_id].update(state);
+  _snapshots[motor_id].store(state);
+  if (_samples[motor_id]) {
+    _samples[motor_id]->push(state);
+  }
+  _sequence++;
+  _updated[motor_id >> 5] |= 1u << (motor_id & 31);
+  __check_reflexes(motor_id);
+}
+
+void AKBus::__check_reflexes(uint8_t motor_id) {
+  const ReflexConfig &config = _reflexes[motor_id];
+  const MotorState &state = _states[motor_id];
+  uint32_t bit = 1u << (motor_id & 31);
+  if (_tripped[motor_id >> 5].load(std::memory_order_relaxed) & bit) {
     return;
   }
+  bool tripped = false;
+  ReflexTrigger trigger = ReflexTrigger::FAULT;
+  if (config.current_limit > 0.0f) {
+    _reflex_counts[motor_id] = std::fabs(state.current) > config.current_limit ? _reflex_counts[motor_id] + 1 : 0;
+    if (_reflex_counts[motor_id] >= std::max<uint32_t>(config.current_samples, 1)) {
+      tripped = true;
+      trigger = ReflexTrigger::CURRENT;
+    }
+  }
+  if (!tripped && config.temperature_limit > 0 && state.temperature >= config.temperature_limit) {
+    tripped = true;
+    trigger = ReflexTrigger::TEMPERATURE;
+  }
+  if (!tripped && config.on_fault && state.motor_fault != MotorFault::NONE) {
+    tripped = true;
+  }
+  if (!tripped) {
+    return;
+  }
+  TMOTOR_TRACE_INSTANT("rx.reflex");
+  _tripped[motor_id >> 5].fetch_or(bit, std::memory_order_release);
+  _reflex_triggers[motor_id] = trigger;
+  _reflex_pending[motor_id >> 5] |= bit;
+  if (config.stop_bus) {
+    emergencyStop();
+    return;
+  }
+  struct can_frame frame;
+  __stop_frame(motor_id, config.action, _servo_limits[motor_id].brake(config.brake_current), frame);
+  __transmit(frame);
+}
 
-  std::lock_guard<std::mutex> lock(_mutex);
-  _position = ((int16_t) (rframe.data[0] << 8 | rframe.data[1])) * 0.1f;
-  _velocity = ((int16_t) (rframe.data[2] << 8 | rframe.data[3]));
-  _current = ((int16_t) (rframe.data[4] << 8 | rframe.data[5])) * 0.01f;
-  _temperature = rframe.data[6];
-  _motor_fault = (MotorFault) rframe.data[7];
+void AKBus::__report_reflexes() {
+  for (int i = 0; i < 8; i++) {
+    while (_reflex_pending[i] != 0) {
+      int bit = __builtin_ctz(_reflex_pending[i]);
+      _reflex_pending[i] &= _reflex_pending[i] - 1;
+      if (_reflex_callback) {
+        _reflex_callback(32*i + bit, _reflex_triggers[32*i + bit]);
+      }
+    }
+  }
 }
 
-AKManager::AKManager() :
+void AKBus::__count_dropped(uint32_t kernel_dropped) {
+  uint32_t dropped = kernel_dropped - _kernel_dropped;
+  _kernel_dropped = kernel_dropped;
+  if (dropped == 0) {
+    return;
+  }
+  _rx_dropped.fetch_add(dropped, std::memory_order_relaxed);
+  if (_drop_callback) {
+    _drop_callback(dropped);
+  }
+}
+
+void AKBus::__disconnect() {
+  _shutdown = true;
+  if (_can_reader.joinable()) {
+    _can_reader.join();
+  }
+  if (_can_fd > -1) {
+    close(_can_fd);
+  }
+  _can_fd = -1;
+  _kernel_dropped = 0;
+}
+
+void AKBus::__start_reader() {
+  _shutdown = false;
+  _can_reader = std::thread([this] {
+    TMOTOR_TRACE_THREAD("tmotor reader");
+    if (_prefault_stack > 0) {
+      prefaultStack(_prefault_stack);
+    }
+    while (!_shutdown) {
+      __read_motor_messages();
+    }
+  });
+}
+
+AKBus::AKBus() :
   _can_fd(-1),
   _shutdown(true),
+  _states(),
+  _sequence(0),
+  _traffic(),
+  _rx_frames(0),
+  _rx_bytes(0),
+  _tx_frames(0),
+  _tx_bytes(0),
+  _bits(0),
+  _error_frames(0),
+  _tx_failures(0),
+  _rx_dropped(0),
+  _bitrate(1000000),
+  _kernel_dropped(0),
+  _mit_reply_id(-1),
+  _stop_action((int) StopAction::ZERO_CURRENT),
+  _stop_brake(0),
+  _stopped(false),
+  _prefault_stack(0),
+  _clock(Clock::system())
+{
+  for (int i = 0; i < 8; i++) {
+    _stop_motors[i].store(0, std::memory_order_relaxed);
+    _stop_mit[i].store(0, std::memory_order_relaxed);
+    _tripped[i].store(0, std::memory_order_relaxed);
+    _reflex_pending[i] = 0;
+    _updated[i] = 0;
+  }
+  for (int i = 0; i < 256; i++) {
+    _reflex_counts[i] = 0;
+    _reflex_triggers[i] = ReflexTrigger::FAULT;
+    _brake_limits[i].store((int32_t) (ServoLimits().brake_current_max * 1000.0f), std::memory_order_relaxed);
+    _mit_stop[i].store(mit_stop_data(_mit_codecs[i], i), std::memory_order_relaxed);
+  }
+}
+
+AKBus::~AKBus() {
+  __disconnect();
+}
+
+void AKBus::connect(const char *can_interface) {
+  connect(can_interface, std::vector<uint8_t>());
+}
+
+/* Runs a socket call until it succeeds, sleeping with an exponential backoff between the attempts. */
+static int retry_with_backoff(Clock &clock, const BusOptions &options, std::function<int()> call) {
+  std::chrono::milliseconds backoff = options.initial_backoff;
+  int result = call();
+  for (int attempt = 1; result < 0 && attempt < options.attempts; attempt++) {
+    clock.sleepFor(backoff);
+    backoff *= 2;
+    result = call();
+  }
+  return result;
+}
+
+void AKBus::__fail_connect(const char *msg) {
+  if (_can_fd > -1) {
+    close(_can_fd);
+  }
+  _can_fd = -1;
+  throw CANSocketException(msg);
+}
+
+void AKBus::connect(const char *can_interface, const std::vector<uint8_t> &motor_ids, const BusOptions &options) {
+  __disconnect();
+
+  /* input the correct network interface name */
+  struct ifreq ifr;
+  if (strlen(can_interface) >= IFNAMSIZ) {
+    throw CANSocketException("The CAN interface name is too long.");
+  }
+  strncpy(ifr.ifr_name, can_interface, IFNAMSIZ);
+  
+  /* create socket file descriptor */
+  _can_fd = retry_with_backoff(*_clock, options, [] { return socket(PF_CAN, SOCK_RAW, CAN_RAW); });
+  if (_can_fd < 0) {
+    __fail_connect("Unable to create the CAN socket.");
+  }
+
+  /* resolve the interface index, a missing interface is not worth retrying */
+  if (ioctl(_can_fd, SIOCGIFINDEX, &ifr) < 0) {
+    __fail_connect("Unable to find the CAN interface.");
+  }
+
+  /* create the socket address and bind the interface to it */
+  struct sockaddr_can addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (retry_with_backoff(*_clock, options, [this, &addr] { return ::bind(_can_fd, (struct sockaddr *)&addr, sizeof(addr)); }) < 0) {
+    __fail_connect("Unable to bind to the CAN socket.");
+  }
+
+  /* Filter for the CAN messages, either every feedback ID or only the requested ones. */
+  std::vector<struct can_filter> rfilters;
+  if (motor_ids.empty()) {
+    struct can_filter rfilter;
+    rfilter.can_id = CAN_EFF_FLAG | TMOTOR_AK_FEEDBACK_ID;
+    rfilter.can_mask = CAN_EFF_FLAG | (CAN_EFF_MASK & ~0xFFu);
+    rfilters.push_back(rfilter);
+  }
+  for (uint8_t motor_id : motor_ids) {
+    struct can_filter rfilter;
+    rfilter.can_id = CAN_EFF_FLAG | TMOTOR_AK_FEEDBACK_ID | motor_id;
+    rfilter.can_mask = CAN_EFF_FLAG | CAN_EFF_MASK;
+    rfilters.push_back(rfilter);
+  }
+  if (options.mit_reply_id >= 0) {
+    struct can_filter rfilter;
+    rfilter.can_id = options.mit_reply_id & CAN_SFF_MASK;
+    rfilter.can_mask = CAN_EFF_FLAG | CAN_SFF_MASK;
+    rfilters.push_back(rfilter);
+  }
+  _mit_reply_id = options.mit_reply_id;
+  if (retry_with_backoff(*_clock, options, [this, &rfilters] {
+        return setsockopt(_can_fd, SOL_CAN_RAW, CAN_RAW_FILTER, rfilters.data(), rfilters.size() * sizeof(struct can_filter));
+      }) < 0) {
+    __fail_connect("Unable to set the CAN filter.");
+  }
+
+  /* Error frames are only counted, failing to receive them is not fatal. */
+  can_err_mask_t err_mask = CAN_ERR_MASK;
+  setsockopt(_can_fd, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &err_mask, sizeof(err_mask));
+
+  /* Have the kernel report the frames it drops when the receive queue overflows. */
+  int enable = 1;
+  if (setsockopt(_can_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) < 0) {
+    __fail_connect("Unable to enable receive queue overflow reporting.");
+  }
+
+  /* Buffer sizes, the FORCE variants exceed the rmem_max/wmem_max limits when privileged. */
+  if (options.receive_buffer > 0 &&
+      setsockopt(_can_fd, SOL_SOCKET, SO_RCVBUFFORCE, &options.receive_buffer, sizeof(int)) < 0 &&
+      setsockopt(_can_fd, SOL_SOCKET, SO_RCVBUF, &options.receive_buffer, sizeof(int)) < 0) {
+    __fail_connect("Unable to set the receive buffer size.");
+  }
+  if (options.send_buffer > 0 &&
+      setsockopt(_can_fd, SOL_SOCKET, SO_SNDBUFFORCE, &options.send_buffer, sizeof(int)) < 0 &&
+      setsockopt(_can_fd, SOL_SOCKET, SO_SNDBUF, &options.send_buffer, sizeof(int)) < 0) {
+    __fail_connect("Unable to set the send buffer size.");
+  }
+
+  /* Real-time mode, everything the reader touches is allocated by now */
+  if (options.lock_memory && !lockMemory()) {
+    __fail_connect("Unable to lock the process memory.");
+  }
+  _prefault_stack = options.prefault_stack;
+
+  if (options.reader_thread) {
+    __start_reader();
+  }
+}
+
+std::future<void> AKBus::connectAsync(const char *can_interface, const std::vector<uint8_t> &motor_ids, const BusOptions &options) {
+  std::string interface_name(can_interface);
+  return std::async(std::launch::async, [this, interface_name, motor_ids, options] {
+    connect(interface_name.c_str(), motor_ids, options);
+  });
+}
+
+void AKBus::open(int fd, const BusOptions &options) {
+  __disconnect();
+  _can_fd = fd;
+  _mit_reply_id = options.mit_reply_id;
+  if (options.lock_memory && !lockMemory()) {
+    __fail_connect("Unable to lock the process memory.");
+  }
+  _prefault_stack = options.prefault_stack;
+  if (options.reader_thread) {
+    __start_reader();
+  }
+}
+
+bool AKBus::isConnected() {
+  return _can_fd > -1;
+}
+
+int AKBus::getFd() {
+  return _can_fd;
+}
+
+size_t AKBus::processIncoming() {
+  if (_can_reader.joinable()) {
+    throw std::runtime_error("The bus is decoded by its reader thread.");
+  }
+  if (_can_fd < 0) {
+    return 0;
+  }
+  return __drain();
+}
+
+MotorState AKBus::getState(uint8_t motor_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _states[motor_id];
+}
+
+MotorState AKBus::peekState(uint8_t motor_id) {
+  return _snapshots[motor_id].load();
+}
+
+uint32_t AKBus::getSequence() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _sequence;
+}
+
+uint32_t AKBus::waitForUpdate(uint32_t sequence, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _update_cv.wait_for(lock, timeout, [this, sequence] { return _sequence != sequence; });
+  return _sequence;
+}
+
+uint32_t AKBus::waitForUpdate(uint8_t motor_id, uint32_t sequence, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  MotorState &state = _states[motor_id];
+  _update_cv.wait_for(lock, timeout, [&state, sequence] { return state.sequence != sequence; });
+  return state.sequence;
+}
+
+std::vector<DiscoveredMotor> AKBus::discover(std::chrono::milliseconds window) {
+  Clock::time_point deadline = _clock->now() + window;
+  std::vector<DiscoveredMotor> discovered;
+  std::unique_lock<std::mutex> lock(_mutex);
+  uint32_t start[256];
+  bool found[256];
+  for (int id = 0; id < 256; id++) {
+    start[id] = _states[id].sequence;
+    found[id] = false;
+  }
+  while (true) {
+    for (int id = 0; id < 256; id++) {
+      if (!found[id] && _states[id].sequence != start[id]) {
+        found[id] = true;
+        discovered.push_back(DiscoveredMotor{(uint8_t) id, _states[id]});
+      }
+    }
+    Clock::time_point now = _clock->now();
+    if (now >= deadline) {
+      break;
+    }
+    // woken by every decoded frame, the wait is capped so a virtual clock advanced meanwhile is noticed
+    _update_cv.wait_for(lock, std::min<Clock::duration>(deadline - now, std::chrono::milliseconds(10)));
+  }
+  std::sort(discovered.begin(), discovered.end(), [](const DiscoveredMotor &a, const DiscoveredMotor &b) {
+    return a.motor_id < b.motor_id;
+  });
+  return discovered;
+}
+
+void AKBus::setMITLimits(uint8_t motor_id, const MITLimits &limits) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _mit_codecs[motor_id] = MITCodec(limits);
+  _mit_stop[motor_id].store(mit_stop_data(_mit_codecs[motor_id], motor_id), std::memory_order_release);
+}
+
+MITLimits AKBus::getMITLimits(uint8_t motor_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _mit_codecs[motor_id].limits();
+}
+
+void AKBus::setServoLimits(uint8_t motor_id, const ServoLimits &limits) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _servo_limits[motor_id] = limits;
+  _brake_limits[motor_id].store(limits.brake(limits.brake_current_max), std::memory_order_release);
+}
+
+ServoLimits AKBus::getServoLimits(uint8_t motor_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _servo_limits[motor_id];
+}
+
+void AKBus::setDerivedConfig(uint8_t motor_id, const DerivedConfig &config) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _derived[motor_id] = DerivedSignalFilter(config);
+}
+
+void AKBus::setSampleBuffer(uint8_t motor_id, std::shared_ptr<SampleBuffer> buffer) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _samples[motor_id] = buffer;
+}
+
+void AKBus::setBitrate(uint32_t bitrate) {
+  _bitrate = bitrate;
+}
+
+void AKBus::setClock(std::shared_ptr<Clock> clock) {
+  _clock = clock ? clock : Clock::system();
+}
+
+std::shared_ptr<Clock> AKBus::getClock() {
+  return _clock;
+}
+
+void AKBus::setDropCallback(std::function<void(uint32_t)> callback) {
+  _drop_callback = callback;
+}
+
+BusStatistics AKBus::getStatistics() {
+  BusStatistics stats;
+  stats.timestamp = _clock->now();
+  stats.bitrate = _bitrate;
+  stats.rx_frames = _rx_frames.load(std::memory_order_relaxed);
+  stats.rx_bytes = _rx_bytes.load(std::memory_order_relaxed);
+  stats.tx_frames = _tx_frames.load(std::memory_order_relaxed);
+  stats.tx_bytes = _tx_bytes.load(std::memory_order_relaxed);
+  stats.bits = _bits.load(std::memory_order_relaxed);
+  stats.error_frames = _error_frames.load(std::memory_order_relaxed);
+  stats.tx_failures = _tx_failures.load(std::memory_order_relaxed);
+  stats.rx_dropped = _rx_dropped.load(std::memory_order_relaxed);
+  for (int i = 0; i < 256; i++) {
+    stats.motors[i].rx_frames = _traffic[i].rx_frames.load(std::memory_order_relaxed);
+    stats.motors[i].rx_bytes = _traffic[i].rx_bytes.load(std::memory_order_relaxed);
+    stats.motors[i].tx_frames = _traffic[i].tx_frames.load(std::memory_order_relaxed);
+    stats.motors[i].tx_bytes = _traffic[i].tx_bytes.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+void AKBus::__check_refused(uint8_t motor_id) {
+  if (_stopped.load(std::memory_order_acquire)) {
+    throw CANSocketException("The bus is emergency stopped.");
+  }
+  if (_tripped[motor_id >> 5].load(std::memory_order_acquire) & (1u << (motor_id & 31))) {
+    throw CANSocketException("A reflex stopped the motor.");
+  }
+}
+
+void AKBus::send(const struct can_frame &frame) {
+  uint8_t motor_id = frame.can_id & 0xFF;
+  __check_refused(motor_id);
+  if (!__transmit(frame)) {
+    throw CANSocketException("Error while writing to the socket");
+  }
+  // a stop latched between the check and the write may have been written before this command, the motor is then
+  // sent its stop frame again behind it
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  struct can_frame stop;
+  if (_stopped.load(std::memory_order_relaxed)) {
+    __stop_frame(motor_id, (StopAction) _stop_action.load(std::memory_order_acquire),
+                 _stop_brake.load(std::memory_order_relaxed), stop);
+    __transmit(stop);
+  } else if (_tripped[motor_id >> 5].load(std::memory_order_relaxed) & (1u << (motor_id & 31))) {
+    // the reader writes the stop frame of a reflex under the lock, so this one follows it
+    std::lock_guard<std::mutex> lock(_mutex);
+    const ReflexConfig &config = _reflexes[motor_id];
+    __stop_frame(motor_id, config.action, _servo_limits[motor_id].brake(config.brake_current), stop);
+    __transmit(stop);
+  }
+  __check_refused(motor_id);
+}
+
+bool AKBus::__transmit(const struct can_frame &frame) {
+  int nbytes;
+  {
+    TMOTOR_TRACE_SCOPE("tx.write");
+    nbytes = write(_can_fd, &frame, sizeof(struct can_frame));
+  }
+  if (nbytes < 0) {
+    _tx_failures.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  AtomicCounters &traffic = _traffic[frame.can_id & 0xFF];
+  traffic.tx_frames.fetch_add(1, std::memory_order_relaxed);
+  traffic.tx_bytes.fetch_add(frame.can_dlc, std::memory_order_relaxed);
+  _tx_frames.fetch_add(1, std::memory_order_relaxed);
+  _tx_bytes.fetch_add(frame.can_dlc, std::memory_order_relaxed);
+  _bits.fetch_add(frameBits(frame.can_id & CAN_EFF_FLAG, frame.can_dlc), std::memory_order_relaxed);
+  return true;
+}
+
+void AKBus::registerMotor(uint8_t motor_id, bool mit_mode) {
+  uint32_t bit = 1u << (motor_id & 31);
+  if (mit_mode) {
+    _stop_mit[motor_id >> 5].fetch_or(bit, std::memory_order_relaxed);
+  } else {
+    _stop_mit[motor_id >> 5].fetch_and(~bit, std::memory_order_relaxed);
+  }
+  _stop_motors[motor_id >> 5].fetch_or(bit, std::memory_order_release);
+}
+
+void AKBus::setStopAction(StopAction action, float brake_current) {
+  // clamped again to the brake limit of each motor when the frames are built
+  brake_current = std::max(0.0f, std::min(brake_current, (float) (INT32_MAX / 1000)));
+  _stop_brake.store((int32_t) (brake_current * 1000.0f), std::memory_order_relaxed);
+  _stop_action.store((int) action, std::memory_order_release);
+}
+
+void AKBus::__stop_frame(uint8_t motor_id, StopAction action, int32_t brake, struct can_frame &frame) {
+  memset(&frame, 0, sizeof(frame));
+  if (_stop_mit[motor_id >> 5].load(std::memory_order_relaxed) & (1u << (motor_id & 31))) {
+    // zero gains and torque, the motor goes limp whatever it was tracking
+    uint64_t data = _mit_stop[motor_id].load(std::memory_order_acquire);
+    frame.can_id = motor_id;
+    frame.can_dlc = 8;
+    for (int i = 0; i < 8; i++) {
+      frame.data[i] = (uint8_t) (data >> (8*i));
+    }
+    return;
+  }
+  int32_t value = 0;
+  uint32_t mode = (uint32_t) MotorModeID::CURRENTLOOP;
+  if (action == StopAction::BRAKE) {
+    value = std::min(brake, _brake_limits[motor_id].load(std::memory_order_acquire));
+    mode = (uint32_t) MotorModeID::CURRENTBREAK;
+  }
+  frame.can_id = motor_id | mode | CAN_EFF_FLAG;
+  frame.can_dlc = 4;
+  for (int i = 0; i < 4; i++) {
+    frame.data[i] = (uint8_t) (((uint32_t) value) >> (8*i));
+  }
+}
+
+/* Writes frames with one sendmmsg() per chunk, waiting briefly for the socket buffer when it is full. */
+static int send_batch(int fd, struct can_frame *frames, int count) {
+  struct iovec iov[64];
+  struct mmsghdr msgs[64];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < count; i++) {
+    iov[i].iov_base = &frames[i];
+    iov[i].iov_len = sizeof(struct can_frame);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int sent = 0;
+  for (int attempt = 0; sent < count && attempt < 10; ) {
+    int n = sendmmsg(fd, msgs + sent, count - sent, MSG_DONTWAIT);
+    if (n > 0) {
+      sent += n;
+      continue;
+    }
+    if (n < 0 && errno != EAGAIN && errno != ENOBUFS && errno != EINTR) {
+      break;
+    }
+    struct pollfd pfd = {fd, POLLOUT, 0};
+    poll(&pfd, 1, 1);
+    attempt++;
+  }
+  return sent;
+}
+
+int AKBus::emergencyStop() {
+  int saved_errno = errno;
+  // ordered before the stop frames, a send() not seeing it after its write is written before them
+  _stopped.store(true, std::memory_order_seq_cst);
+  int fd = _can_fd;
+  if (fd < 0) {
+    errno = saved_errno;
+    return -1;
+  }
+  // not traced, recording takes the tracer locks and may allocate, which a signal handler must not do
+  StopAction action = (StopAction) _stop_action.load(std::memory_order_acquire);
+  int32_t brake = _stop_brake.load(std::memory_order_relaxed);
+  struct can_frame frames[64];
+  int count = 0;
+  int sent = 0;
+  int failed = 0;
+  auto flush = [&]() {
+    int n = send_batch(fd, frames, count);
+    for (int i = 0; i < n; i++) {
+      AtomicCounters &traffic = _traffic[frames[i].can_id & 0xFF];
+      traffic.tx_frames.fetch_add(1, std::memory_order_relaxed);
+      traffic.tx_bytes.fetch_add(frames[i].can_dlc, std::memory_order_relaxed);
+      _tx_bytes.fetch_add(frames[i].can_dlc, std::memory_order_relaxed);
+      _bits.fetch_add(frameBits(frames[i].can_id & CAN_EFF_FLAG, frames[i].can_dlc), std::memory_order_relaxed);
+    }
+    _tx_frames.fetch_add(n, std::memory_order_relaxed);
+    failed += count - n;
+    sent += n;
+    count = 0;
+  };
+  for (int id = 0; id < 256; id++) {
+    uint32_t bit = 1u << (id & 31);
+    if (!(_stop_motors[id >> 5].load(std::memory_order_acquire) & bit)) continue;
+    __stop_frame(id, action, brake, frames[count++]);
+    if (count == 64) flush();
+  }
+  if (count > 0) flush();
+  _tx_failures.fetch_add(failed, std::memory_order_relaxed);
+  errno = saved_errno;
+  return sent;
+}
+
+bool AKBus::isStopped() {
+  return _stopped.load(std::memory_order_acquire);
+}
+
+void AKBus::clearStop() {
+  _stopped.store(false, std::memory_order_release);
+}
+
+void AKBus::setReflex(uint8_t motor_id, const ReflexConfig &config) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _reflexes[motor_id] = config;
+  _reflex_counts[motor_id] = 0;
+}
+
+bool AKBus::isTripped(uint8_t motor_id) {
+  return _tripped[motor_id >> 5].load(std::memory_order_acquire) & (1u << (motor_id & 31));
+}
+
+void AKBus::clearReflex(uint8_t motor_id) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _reflex_counts[motor_id] = 0;
+  _tripped[motor_id >> 5].fetch_and(~(1u << (motor_id & 31)), std::memory_order_release);
+}
+
+void AKBus::setReflexCallback(std::function<void(uint8_t, ReflexTrigger)> callback) {
+  _reflex_callback = callback;
+}
+
+void AKBus::setUpdateCallback(std::function<void(uint8_t)> callback) {
+  _update_callback = callback;
+}
+
+AKManager::AKManager() :
+  _bus(nullptr),
   _motor_id(-1),
-  _current(0.0f),
-  _velocity(0.0f),
-  _position(0.0f),
-  _temperature(0),
-  _motor_fault(MotorFault::NONE)
+  _mit_codec(),
+  _servo_limits(),
+  _mit_limits_set(false),
+  _servo_limits_set(false),
+  _clock(Clock::system())
 {
   return;
 }
 
 AKManager::AKManager(const uint8_t motor_id) :
-  _can_fd(-1),
-  _shutdown(true),
+  _bus(nullptr),
   _motor_id(motor_id),
-  _current(0.0f),
-  _velocity(0.0f),
-  _position(0.0f),
-  _temperature(0),
-  _motor_fault(MotorFault::NONE)
+  _mit_codec(),
+  _servo_limits(),
+  _mit_limits_set(false),
+  _servo_limits_set(false),
+  _clock(Clock::system())
 {
   return;
 }
 
 AKManager::AKManager(const AKManager& other) :
-  _can_fd(-1),
-  _shutdown(true),
+  _bus(nullptr),
   _motor_id(other._motor_id),
-  _current(0.0f),
-  _velocity(0.0f),
-  _position(0.0f),
-  _temperature(0),
-  _motor_fault(MotorFault::NONE)
+  _mit_codec(other._mit_codec),
+  _servo_limits(other._servo_limits),
+  _mit_limits_set(other._mit_limits_set),
+  _servo_limits_set(other._servo_limits_set),
+  _clock(other._clock)
 {}
 
 AKManager::~AKManager() {
-  _shutdown = true;
-  if (_can_reader.joinable()) {
-    _can_reader.join();
-  }  
-  close(_can_fd);
+  _bus.reset();
 }
 
 void AKManager::setMotorID(const uint8_t motor_id) {
@@ -106,109 +1033,163 @@ uint8_t AKManager::getMotorID() {
 }
 
 float AKManager::getCurrent() {
-  std::lock_guard<std::mutex> lock(_mutex);
-  return _current;
+  return getState().current;
 }
 
 float AKManager::getVelocity() {
-  std::lock_guard<std::mutex> lock(_mutex);
-  return _velocity;
+  return getState().velocity;
 }
 
 float AKManager::getPosition() {
-  std::lock_guard<std::mutex> lock(_mutex);
-  return _position;
+  return getState().position;
 }
 
 int8_t AKManager::getTemperature() {
-  std::lock_guard<std::mutex> lock(_mutex);
-  return _temperature;
+  return getState().temperature;
 }
 
 MotorFault AKManager::getFault() {
-  std::lock_guard<std::mutex> lock(_mutex);
-  return _motor_fault;
+  return getState().motor_fault;
 }
 
-void AKManager::connect(const char *can_interface) {
-  _shutdown = true;
-  if (_can_reader.joinable()) {
-    _can_reader.join();
+MotorState AKManager::getState() {
+  if (!_bus) {
+    return MotorState();
   }
-  if (_can_fd > -1) {
-    close(_can_fd);
+  return _bus->getState(_motor_id);
+}
+
+uint32_t AKManager::waitForUpdate(uint32_t sequence, std::chrono::milliseconds timeout) {
+  std::shared_ptr<AKBus> bus = _bus;
+  if (!bus) {
+    std::shared_ptr<Clock> clock = _clock;
+    clock->sleepFor(timeout, &_connected);
+    clock->leave();
+    return sequence;
   }
-  _can_fd = -1;
-  
-  /* create socket file descriptor */
-  int f_tries(0);
-  while (_can_fd < 0 && f_tries++ < 5) {
-    if ((_can_fd = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
+  return bus->waitForUpdate(_motor_id, sequence, timeout);
+}
+
+void AKManager::setClock(std::shared_ptr<Clock> clock) {
+  _clock = clock ? clock : Clock::system();
+}
+
+void AKManager::connect(const char *can_interface, const BusOptions &options) {
+  _bus.reset();
+  _connected.reset();
+  std::shared_ptr<AKBus> bus = std::make_shared<AKBus>();
+  bus->setClock(_clock);
+  bus->connect(can_interface, std::vector<uint8_t>{_motor_id}, options);
+  bus->setMITLimits(_motor_id, _mit_codec.limits());
+  bus->setServoLimits(_motor_id, _servo_limits);
+  bus->registerMotor(_motor_id);
+  _bus = bus;
+  _clock->requestStop(_connected);
+}
+
+std::future<void> AKManager::connectAsync(const char *can_interface, const BusOptions &options) {
+  std::string interface_name(can_interface);
+  return std::async(std::launch::async, [this, interface_name, options] {
+    connect(interface_name.c_str(), options);
+  });
+}
+
+void AKManager::connect(std::shared_ptr<AKBus> bus) {
+  _bus = bus;
+  if (!_bus) {
+    _connected.reset();
+    return;
   }
-  if (_can_fd < 0) {
-    throw CANSocketException("Unable to create the CAN socket.");
+  _clock->requestStop(_connected);
+  // limits set on the manager win, the others follow whoever registered the motor first
+  if (_mit_limits_set) {
+    _bus->setMITLimits(_motor_id, _mit_codec.limits());
+  } else {
+    _mit_codec = MITCodec(_bus->getMITLimits(_motor_id));
+  }
+  if (_servo_limits_set) {
+    _bus->setServoLimits(_motor_id, _servo_limits);
+  } else {
+    _servo_limits = _bus->getServoLimits(_motor_id);
   }
+  _bus->registerMotor(_motor_id);
+}
 
-  /* input the correct network interface name */
-  struct ifreq ifr;
-  strcpy(ifr.ifr_name, can_interface);
-  ioctl(_can_fd, SIOCGIFINDEX, &ifr);
+void AKManager::setMITLimits(const MITLimits &limits) {
+  _mit_codec = MITCodec(limits);
+  _mit_limits_set = true;
+  if (_bus) {
+    _bus->setMITLimits(_motor_id, limits);
+  }
+}
 
-  /* create the socket address and bind the interface to it */
-  struct sockaddr_can addr;
-  addr.can_family = AF_CAN;
-  addr.can_ifindex = ifr.ifr_ifindex;
-  int b_tries(0);
-  int bind = -1;
-  while (bind < 0 && b_tries++ < 5) {
-    if ((bind = ::bind(_can_fd, (struct sockaddr *)&addr, sizeof(addr))) < 0) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-    }
+void AKManager::setServoLimits(const ServoLimits &limits) {
+  _servo_limits = limits;
+  _servo_limits_set = true;
+  if (_bus) {
+    _bus->setServoLimits(_motor_id, limits);
   }
-  if (bind < 0) {
-    throw CANSocketException("Unable to bind to the CAN socket.");
+}
+
+ServoLimits AKManager::getServoLimits() {
+  return _servo_limits;
+}
+
+void AKManager::enterMITMode() {
+  if (!_bus) {
+    return;
   }
+  struct can_frame wframe;
+  MITCodec::packSpecial(_motor_id, 0xFC, wframe);
+  _bus->send(wframe);
+  _bus->registerMotor(_motor_id, true);
+}
+
+void AKManager::exitMITMode() {
+  if (!_bus) {
+    return;
+  }
+  struct can_frame wframe;
+  MITCodec::packSpecial(_motor_id, 0xFD, wframe);
+  _bus->send(wframe);
+  _bus->registerMotor(_motor_id, false);
+}
 
-  /* Filter for the CAN messages. */
-  struct can_filter rfilter;
-  rfilter.can_id = 0x00002900 | _motor_id;
-  rfilter.can_mask = CAN_SFF_MASK;
-  int o_tries(0);
-  int opt = -1;
-  while ((opt = setsockopt(_can_fd, SOL_CAN_RAW, CAN_RAW_FILTER, &rfilter, sizeof(struct can_filter))) < 0 && o_tries++ < 5) {
-    std::this_thread::sleep_for(std::chrono::seconds(1));
+void AKManager::setMITOrigin() {
+  if (!_bus) {
+    return;
   }
-  if (opt < 0) {
-    throw CANSocketException("Unable to set the CAN filter.");
+  struct can_frame wframe;
+  MITCodec::packSpecial(_motor_id, 0xFE, wframe);
+  _bus->send(wframe);
+}
+
+void AKManager::sendMIT(const MITCommand &command) {
+  if (!_bus) {
+    return;
   }
+  struct can_frame wframe;
+  _mit_codec.pack(_motor_id, command, wframe);
+  _bus->send(wframe);
+}
 
-  _shutdown = false;
-  _can_reader = std::thread([this] {
-    while (!_shutdown) {
-      __read_motor_message();
-      std::this_thread::sleep_for(std::chrono::milliseconds(10));
-    }
-  });
+std::shared_ptr<AKBus> AKManager::getBus() {
+  return _bus;
 }
 
 void AKManager::setOrigin(MotorOriginMode mode) {
-  if (_can_fd < 0) {
+  if (!_bus) {
     return;
   }
   struct can_frame wframe;
   wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::SETORIGIN;
   wframe.data[0] = mode;
   wframe.can_dlc = 1;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
-  }
+  _bus->send(wframe);
 }
 
 void AKManager::sendDutyCycle(float duty) {
-  if (_can_fd < 0) {
+  if (!_bus) {
     return;
   }
   struct can_frame wframe;
@@ -219,119 +1200,56 @@ void AKManager::sendDutyCycle(float duty) {
   wframe.data[2] = (duty_cmd_int >> 16) & 0xFF;
   wframe.data[3] = (duty_cmd_int >> 24) & 0xFF;
   wframe.can_dlc = 4;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket.");
-  }
+  _bus->send(wframe);
 }
 
-void AKManager::sendCurrent(float current) {
-  if (_can_fd < 0) {
+void AKManager::__send_int32(MotorModeID mode, int32_t value, bool big_endian) {
+  if (!_bus) {
     return;
   }
-  float current_max = 60.0;
-  float current_min = -60.0;
-  if (current > current_max) current = current_max;
-  if (current < current_min) current = current_min;
   struct can_frame wframe;
-  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::CURRENTLOOP;
-  int32_t current_cmd_int = (int32_t) (current * 100.0f);
-  wframe.data[0] = current_cmd_int & 0xFF;
-  wframe.data[1] = (current_cmd_int >> 8) & 0xFF;
-  wframe.data[2] = (current_cmd_int >> 16) & 0xFF;
-  wframe.data[3] = (current_cmd_int >> 24) & 0xFF;
-  wframe.can_dlc = 4;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
+  wframe.can_id = CAN_EFF_FLAG | _motor_id | mode;
+  for (int i = 0; i < 4; i++) {
+    wframe.data[big_endian ? 3 - i : i] = (value >> (8*i)) & 0xFF;
   }
+  wframe.can_dlc = 4;
+  _bus->send(wframe);
 }
 
-void AKManager::sendCurrentBrake(float current) {
-  if (_can_fd < 0) {
+void AKManager::__send_profile(int32_t position, int16_t velocity, int16_t acceleration) {
+  if (!_bus) {
     return;
   }
-  float current_max = 60.0;
-  float current_min = 0.0;
-  if (current > current_max) current = current_max;
-  if (current < current_min) current = current_min;
   struct can_frame wframe;
-  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::CURRENTBREAK;
-  int32_t current_cmd_int = (int32_t) (current * 1000.0f);
-  wframe.data[0] = current_cmd_int & 0xFF;
-  wframe.data[1] = (current_cmd_int >> 8) & 0xFF;
-  wframe.data[2] = (current_cmd_int >> 16) & 0xFF;
-  wframe.data[3] = (current_cmd_int >> 24) & 0xFF;
-  wframe.can_dlc = 4;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
-  }
+  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::POSITIONVELOCITY;
+  wframe.data[0] = (position >> 24) & 0xFF;
+  wframe.data[1] = (position >> 16) & 0xFF;
+  wframe.data[2] = (position >> 8) & 0xFF;
+  wframe.data[3] = position & 0xFF;
+  wframe.data[4] = (velocity >> 8) & 0xFF;
+  wframe.data[5] = velocity & 0xFF;
+  wframe.data[6] = (acceleration >> 8) & 0xFF;
+  wframe.data[7] = acceleration & 0xFF;
+  wframe.can_dlc = 8;
+  _bus->send(wframe);
 }
 
-void AKManager::sendVelocity(float vel) {
-  if (_can_fd < 0) {
-    return;
-  }
-  int32_t vel_int = ((int32_t) vel)*TMOTOR_AK_POLE_PAIRS;
-  struct can_frame wframe;
-  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::VELOCITY;
-  wframe.data[3] = (vel_int & 0xFF);
-  wframe.data[2] = (vel_int >> 8) & 0xFF;
-  wframe.data[1] = (vel_int >> 16) & 0xFF;
-  wframe.data[0] = (vel_int >> 24) & 0xFF;
-  wframe.can_dlc = 4;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
-  }
+void AKManager::sendCurrent(float current) {
+  __send_int32(MotorModeID::CURRENTLOOP, _servo_limits.current(current), false);
+}
 
+void AKManager::sendCurrentBrake(float current) {
+  __send_int32(MotorModeID::CURRENTBREAK, _servo_limits.brake(current), false);
+}
+
+void AKManager::sendVelocity(float vel) {
+  __send_int32(MotorModeID::VELOCITY, _servo_limits.erpm(vel), true);
 }
 
 void AKManager::sendPosition(float pose) {
-  if (_can_fd < 0) {
-    return;
-  }
-  pose = pose > 36000.0f ? 36000.0f : pose;
-  pose = pose < -36000.0f ? -36000.0f : pose;
-  struct can_frame wframe;
-  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::POSITION;
-  int32_t pos_cmd_int = (int32_t) (pose);
-  wframe.data[0] = (pos_cmd_int >> 24) & 0xFF;
-  wframe.data[1] = (pos_cmd_int >> 16) & 0xFF;
-  wframe.data[2] = (pos_cmd_int >> 8) & 0xFF;
-  wframe.data[3] = pos_cmd_int & 0xFF;
-  wframe.can_dlc = 4;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
-  }
+  __send_int32(MotorModeID::POSITION, _servo_limits.position(pose), true);
 }
 
 void AKManager::sendPositionVelocityAcceleration(float pose, int16_t vel, int16_t acc) {
-  if (_can_fd < 0) {
-    return;
-  }
-  int16_t acc_max = 200;
-  int16_t acc_min = 0;
-  if (acc > acc_max) acc = acc_max;
-  if (acc < acc_min) acc = acc_min;
-  struct can_frame wframe;
-  wframe.can_id = CAN_EFF_FLAG | _motor_id | MotorModeID::POSITIONVELOCITY;
-  int32_t pos_cmd_int = (int32_t) (pose * 10000.0f);
-  int16_t vel_cmd_int = vel;
-  int16_t acc_cmd_int = acc;
-  wframe.data[0] = (pos_cmd_int >> 24) & 0xFF;
-  wframe.data[1] = (pos_cmd_int >> 16) & 0xFF;
-  wframe.data[2] = (pos_cmd_int >> 8) & 0xFF;
-  wframe.data[3] = pos_cmd_int & 0xFF;
-  wframe.data[4] = (vel_cmd_int >> 8) & 0xFF;
-  wframe.data[5] = vel_cmd_int & 0xFF;
-  wframe.data[6] = (acc_cmd_int >> 8) & 0xFF;
-  wframe.data[7] = acc_cmd_int & 0xFF;
-  wframe.can_dlc = 8;
-  int nbytes = write(_can_fd, &wframe, sizeof(struct can_frame));
-  if (nbytes < 0) {
-    throw CANSocketException("Error while writing to the socket");
-  }
+  __send_profile(_servo_limits.profilePosition(pose), vel, _servo_limits.acceleration(acc));
 }
\ No newline at end of file
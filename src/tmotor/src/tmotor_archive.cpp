@@ -0,0 +1,499 @@
+/**
+ * @file tmotor_archive.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_archive.hpp"
+
+#include <cmath>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <endian.h>
+
+using namespace TMotor;
+
+/*
+ * File layout, every integer little-endian whatever the host:
+ *   "TMTLM002"
+ *   column blocks
+ *   uint32 motor count, then per motor: uint8 ID, 3 zero bytes, uint32 block count, uint64 samples,
+ *   followed by its block index entries, each the fields of ArchiveBlock in declaration order without padding
+ *   uint64 offset of the motor count, "TMTLMEND"
+ */
+static const char archive_magic[8] = {'T', 'M', 'T', 'L', 'M', '0', '0', '2'};
+static const char archive_end[8] = {'T', 'M', 'T', 'L', 'M', 'E', 'N', 'D'};
+static const size_t block_entry_size = 8 + 4 + 4 * COLUMN_COUNT + 4 * 8 * COLUMN_COUNT;
+
+static inline uint64_t zigzag(int64_t value) {
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t value) {
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+static inline uint64_t load64(const uint8_t *in) {
+  uint64_t word;
+  memcpy(&word, in, sizeof(word));
+  return le64toh(word);
+}
+
+static inline uint32_t load32(const uint8_t *in) {
+  uint32_t word;
+  memcpy(&word, in, sizeof(word));
+  return le32toh(word);
+}
+
+static inline void store64(uint8_t *out, uint64_t value) {
+  value = htole64(value);
+  memcpy(out, &value, sizeof(value));
+}
+
+static inline void store32(uint8_t *out, uint32_t value) {
+  value = htole32(value);
+  memcpy(out, &value, sizeof(value));
+}
+
+static void store_block(uint8_t *out, const ArchiveBlock &block) {
+  store64(out, block.offset);
+  store32(out + 8, block.count);
+  out += 12;
+  for (int column = 0; column < COLUMN_COUNT; column++, out += 4) {
+    store32(out, block.column_offset[column]);
+  }
+  for (int column = 0; column < COLUMN_COUNT; column++, out += 32) {
+    store64(out, block.stats[column].min);
+    store64(out + 8, block.stats[column].max);
+    store64(out + 16, block.stats[column].sum);
+    store64(out + 24, block.stats[column].sum_sq);
+  }
+}
+
+static void load_block(const uint8_t *in, ArchiveBlock &block) {
+  block.offset = load64(in);
+  block.count = load32(in + 8);
+  in += 12;
+  for (int column = 0; column < COLUMN_COUNT; column++, in += 4) {
+    block.column_offset[column] = load32(in);
+  }
+  for (int column = 0; column < COLUMN_COUNT; column++, in += 32) {
+    block.stats[column].min = load64(in);
+    block.stats[column].max = load64(in + 8);
+    block.stats[column].sum = load64(in + 16);
+    block.stats[column].sum_sq = load64(in + 24);
+  }
+}
+
+size_t TMotor::maxEncodedSize(size_t count) {
+  return 10 + 1 + count * 8 + 8;
+}
+
+size_t TMotor::encodeColumn(const int64_t *values, size_t count, uint8_t *out) {
+  if (count == 0) {
+    return 0;
+  }
+  size_t size = 0;
+  uint64_t first = zigzag(values[0]);
+  do {
+    out[size++] = (first & 0x7F) | (first > 0x7F ? 0x80 : 0);
+    first >>= 7;
+  } while (first > 0);
+
+  uint64_t widest = 0;
+  for (size_t i = 1; i < count; i++) {
+    widest |= zigzag(values[i] - values[i-1]);
+  }
+  int width = 0;
+  while (width < 64 && (widest >> width) != 0) {
+    width++;
+  }
+  out[size++] = width;
+
+  uint64_t word = 0;
+  int bits = 0;
+  for (size_t i = 1; i < count && width > 0; i++) {
+    uint64_t delta = zigzag(values[i] - values[i-1]);
+    word |= delta << bits;
+    if (bits + width >= 64) {
+      store64(out + size, word);
+      size += sizeof(word);
+      word = bits > 0 ? delta >> (64 - bits) : 0;
+      bits = bits + width - 64;
+    } else {
+      bits += width;
+    }
+  }
+  store64(out + size, word);
+  size += (bits + 7) / 8;
+  memset(out + size, 0, 8); // readers load whole words past the last value
+  return size + 8;
+}
+
+size_t TMotor::decodeColumn(const uint8_t *in, size_t count, int64_t *out) {
+  if (count == 0) {
+    return 0;
+  }
+  size_t size = 0;
+  uint64_t first = 0;
+  for (int shift = 0; ; shift += 7) {
+    uint8_t byte = in[size++];
+    first |= (uint64_t) (byte & 0x7F) << shift;
+    if (!(byte & 0x80)) break;
+  }
+  int width = in[size++];
+  const uint8_t *packed = in + size;
+  uint64_t mask = width < 64 ? (((uint64_t) 1 << width) - 1) : ~(uint64_t) 0;
+
+  int64_t value = unzigzag(first);
+  out[0] = value;
+  for (size_t i = 1; i < count; i++) {
+    size_t bit = (i - 1) * width;
+    unsigned shift = bit & 7;
+    const uint8_t *word = packed + bit / 8;
+    uint64_t delta = load64(word) >> shift;
+    if (shift + width > 64) {
+      delta |= load64(word + 8) << (64 - shift);
+    }
+    value += unzigzag(delta & mask);
+    out[i] = value;
+  }
+  return size + ((count - 1) * width + 7) / 8 + 8;
+}
+
+ArchiveWriter::ArchiveWriter(const char *path, size_t block_size) :
+  _file(fopen(path, "wb")),
+  _block_size(block_size > 0 ? block_size : 1),
+  _offset(0)
+{
+  if (_file == nullptr) {
+    throw std::runtime_error("Unable to create the archive.");
+  }
+  __write(archive_magic, sizeof(archive_magic));
+}
+
+ArchiveWriter::~ArchiveWriter() {
+  if (_file != nullptr) {
+    try {
+      close();
+    } catch (std::runtime_error &e) {
+      // nothing to report the error to
+    }
+  }
+}
+
+void ArchiveWriter::__write(const void *data, size_t size) {
+  if (fwrite(data, 1, size, _file) != size) {
+    throw std::runtime_error("Unable to write the archive.");
+  }
+  _offset += size;
+}
+
+void ArchiveWriter::__flush(uint8_t motor_id) {
+  Stream &stream = *_streams[motor_id];
+  size_t count = stream.columns[COLUMN_TIME].size();
+  if (count == 0) {
+    return;
+  }
+  ArchiveBlock block;
+  block.offset = _offset;
+  block.count = count;
+  _buffer.resize(maxEncodedSize(count) * COLUMN_COUNT);
+  size_t size = 0;
+  for (int column = 0; column < COLUMN_COUNT; column++) {
+    const std::vector<int64_t> &values = stream.columns[column];
+    ColumnStats &stats = block.stats[column];
+    stats.min = INT64_MAX;
+    stats.max = INT64_MIN;
+    stats.sum = 0;
+    stats.sum_sq = 0;
+    for (int64_t value : values) {
+      if (value < stats.min) stats.min = value;
+      if (value > stats.max) stats.max = value;
+      if (column != COLUMN_TIME) {
+        stats.sum += value;
+        stats.sum_sq += value * value;
+      }
+    }
+    block.column_offset[column] = size;
+    size += encodeColumn(values.data(), count, _buffer.data() + size);
+    stream.columns[column].clear();
+  }
+  __write(_buffer.data(), size);
+  stream.blocks.push_back(block);
+}
+
+bool ArchiveWriter::append(int64_t time_us, const struct can_frame &frame) {
+  if (!(frame.can_id & CAN_EFF_FLAG) || frame.can_dlc != 8 ||
+      ((frame.can_id & CAN_EFF_MASK) & ~0xFFu) != TMOTOR_AK_FEEDBACK_ID) {
+    return false;
+  }
+  uint8_t motor_id = frame.can_id & 0xFF;
+  if (!_streams[motor_id]) {
+    _streams[motor_id].reset(new Stream());
+    _streams[motor_id]->samples = 0;
+    for (int column = 0; column < COLUMN_COUNT; column++) {
+      _streams[motor_id]->columns[column].reserve(_block_size);
+    }
+  }
+  Stream &stream = *_streams[motor_id];
+  stream.columns[COLUMN_TIME].push_back(time_us);
+  stream.columns[COLUMN_POSITION].push_back((int16_t) (frame.data[0] << 8 | frame.data[1]));
+  stream.columns[COLUMN_VELOCITY].push_back((int16_t) (frame.data[2] << 8 | frame.data[3]));
+  stream.columns[COLUMN_CURRENT].push_back((int16_t) (frame.data[4] << 8 | frame.data[5]));
+  stream.columns[COLUMN_TEMPERATURE].push_back((int8_t) frame.data[6]);
+  stream.columns[COLUMN_FAULT].push_back(frame.data[7]);
+  stream.samples++;
+  if (stream.columns[COLUMN_TIME].size() >= _block_size) {
+    __flush(motor_id);
+  }
+  return true;
+}
+
+void ArchiveWriter::close() {
+  if (_file == nullptr) {
+    return;
+  }
+  uint64_t index_offset = _offset;
+  uint32_t motor_count = 0;
+  for (int motor_id = 0; motor_id < 256; motor_id++) {
+    if (_streams[motor_id]) {
+      __flush(motor_id);
+      motor_count++;
+    }
+  }
+  index_offset = _offset;
+  uint8_t field[8];
+  store32(field, motor_count);
+  __write(field, 4);
+  for (int motor_id = 0; motor_id < 256; motor_id++) {
+    if (!_streams[motor_id]) {
+      continue;
+    }
+    Stream &stream = *_streams[motor_id];
+    uint8_t header[16] = {(uint8_t) motor_id, 0, 0, 0};
+    store32(header + 4, stream.blocks.size());
+    store64(header + 8, stream.samples);
+    __write(header, sizeof(header));
+    _buffer.resize(stream.blocks.size() * block_entry_size);
+    for (size_t b = 0; b < stream.blocks.size(); b++) {
+      store_block(_buffer.data() + b * block_entry_size, stream.blocks[b]);
+    }
+    __write(_buffer.data(), _buffer.size());
+  }
+  store64(field, index_offset);
+  __write(field, 8);
+  __write(archive_end, sizeof(archive_end));
+  int result = fclose(_file);
+  _file = nullptr;
+  if (result != 0) {
+    throw std::runtime_error("Unable to write the archive.");
+  }
+}
+
+ArchiveReader::ArchiveReader(const char *path) :
+  _data(nullptr),
+  _size(0)
+{
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open the archive.");
+  }
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t) (sizeof(archive_magic) + 4 + 16)) {
+    ::close(fd);
+    throw std::runtime_error("Not a telemetry archive.");
+  }
+  _size = st.st_size;
+  void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    throw std::runtime_error("Unable to map the archive.");
+  }
+  _data = (const uint8_t *) data;
+  madvise(data, _size, MADV_SEQUENTIAL);
+
+  uint64_t index_offset = load64(_data + _size - 16);
+  if (memcmp(_data, archive_magic, 8) != 0 || memcmp(_data + _size - 8, archive_end, 8) != 0 ||
+      index_offset + 4 > _size - 16) {
+    munmap(data, _size);
+    throw std::runtime_error("Not a telemetry archive.");
+  }
+  const uint8_t *cursor = _data + index_offset;
+  uint32_t motor_count = load32(cursor);
+  cursor += 4;
+  for (uint32_t i = 0; i < motor_count; i++) {
+    if (cursor + 16 > _data + _size - 16) {
+      munmap(data, _size);
+      throw std::runtime_error("Truncated archive index.");
+    }
+    Motor motor;
+    motor.motor_id = cursor[0];
+    motor.block_count = load32(cursor + 4);
+    motor.samples = load64(cursor + 8);
+    motor.blocks = cursor + 16;
+    if ((size_t) (_data + _size - 16 - motor.blocks) / block_entry_size < motor.block_count) {
+      munmap(data, _size);
+      throw std::runtime_error("Truncated archive index.");
+    }
+    cursor = motor.blocks + (size_t) motor.block_count * block_entry_size;
+    _motors.push_back(motor);
+  }
+}
+
+ArchiveReader::~ArchiveReader() {
+  munmap((void *) _data, _size);
+}
+
+std::vector<uint8_t> ArchiveReader::motors() const {
+  std::vector<uint8_t> motor_ids;
+  for (const Motor &motor : _motors) {
+    motor_ids.push_back(motor.motor_id);
+  }
+  return motor_ids;
+}
+
+MotorSummary ArchiveReader::summarize(uint8_t motor_id, int64_t from_us, int64_t to_us, int hot_threshold) const {
+  const Motor *motor = nullptr;
+  for (const Motor &candidate : _motors) {
+    if (candidate.motor_id == motor_id) motor = &candidate;
+  }
+  if (motor == nullptr) {
+    throw std::runtime_error("The motor is not in the archive.");
+  }
+
+  MotorSummary summary = MotorSummary();
+  summary.motor_id = motor_id;
+  summary.temperature_max = INT_MIN;
+  ColumnStats totals[COLUMN_COUNT];
+  for (int column = 0; column < COLUMN_COUNT; column++) {
+    totals[column] = ColumnStats{INT64_MAX, INT64_MIN, 0, 0};
+  }
+  int64_t previous_us = 0;
+  bool previous_hot = false;
+  FaultInterval open_fault{0, 0, MotorFault::NONE};
+  ArchiveBlock peak_copy;
+  const ArchiveBlock *peak_block = nullptr; // scanned block holding the peak, its time is looked up at the end
+  std::vector<int64_t> columns[COLUMN_COUNT];
+
+  for (uint32_t b = 0; b < motor->block_count; b++) {
+    ArchiveBlock block;
+    load_block(motor->blocks + (size_t) b * block_entry_size, block);
+    if (block.stats[COLUMN_TIME].max < from_us || block.stats[COLUMN_TIME].min > to_us) {
+      continue;
+    }
+    if (block.offset + block.column_offset[COLUMN_COUNT-1] > _size) {
+      throw std::runtime_error("Truncated archive block.");
+    }
+    bool inside = block.stats[COLUMN_TIME].min >= from_us && block.stats[COLUMN_TIME].max <= to_us;
+    bool decode = !inside || block.stats[COLUMN_FAULT].max > 0 || open_fault.fault != MotorFault::NONE ||
+                  block.stats[COLUMN_TEMPERATURE].max >= hot_threshold;
+
+    if (!decode) {
+      summary.blocks_scanned++;
+      if (summary.samples == 0) summary.first_us = block.stats[COLUMN_TIME].min;
+      summary.last_us = block.stats[COLUMN_TIME].max;
+      summary.samples += block.count;
+      for (int column = COLUMN_POSITION; column < COLUMN_COUNT; column++) {
+        const ColumnStats &stats = block.stats[column];
+        if (stats.min < totals[column].min) totals[column].min = stats.min;
+        if (stats.max > totals[column].max) totals[column].max = stats.max;
+        totals[column].sum += stats.sum;
+        totals[column].sum_sq += stats.sum_sq;
+      }
+      if (block.stats[COLUMN_TEMPERATURE].max > summary.temperature_max) {
+        summary.temperature_max = block.stats[COLUMN_TEMPERATURE].max;
+        peak_copy = block;
+        peak_block = &peak_copy;
+      }
+      if (previous_hot) summary.hot_seconds += (block.stats[COLUMN_TIME].min - previous_us) * 1e-6;
+      previous_hot = false;
+      previous_us = block.stats[COLUMN_TIME].max;
+      continue;
+    }
+
+    summary.blocks_decoded++;
+    for (int column = 0; column < COLUMN_COUNT; column++) {
+      columns[column].resize(block.count);
+      decodeColumn(_data + block.offset + block.column_offset[column], block.count, columns[column].data());
+    }
+    for (uint32_t i = 0; i < block.count; i++) {
+      int64_t time_us = columns[COLUMN_TIME][i];
+      if (time_us < from_us || time_us > to_us) {
+        continue;
+      }
+      if (summary.samples == 0) summary.first_us = time_us;
+      summary.last_us = time_us;
+      summary.samples++;
+      for (int column = COLUMN_POSITION; column < COLUMN_COUNT; column++) {
+        int64_t value = columns[column][i];
+        if (value < totals[column].min) totals[column].min = value;
+        if (value > totals[column].max) totals[column].max = value;
+        totals[column].sum += value;
+        totals[column].sum_sq += value * value;
+      }
+      int temperature = columns[COLUMN_TEMPERATURE][i];
+      if (temperature > summary.temperature_max) {
+        summary.temperature_max = temperature;
+        summary.temperature_max_us = time_us;
+        peak_block = nullptr;
+      }
+      if (previous_hot) summary.hot_seconds += (time_us - previous_us) * 1e-6;
+      previous_hot = temperature >= hot_threshold;
+      previous_us = time_us;
+
+      MotorFault fault = (MotorFault) columns[COLUMN_FAULT][i];
+      if (fault != open_fault.fault) {
+        if (open_fault.fault != MotorFault::NONE) {
+          open_fault.end_us = time_us;
+          summary.faults.push_back(open_fault);
+        }
+        open_fault = FaultInterval{time_us, time_us, fault};
+      }
+    }
+  }
+  if (open_fault.fault != MotorFault::NONE) {
+    open_fault.end_us = summary.last_us;
+    summary.faults.push_back(open_fault);
+  }
+  if (peak_block != nullptr) {
+    columns[COLUMN_TIME].resize(peak_block->count);
+    columns[COLUMN_TEMPERATURE].resize(peak_block->count);
+    decodeColumn(_data + peak_block->offset + peak_block->column_offset[COLUMN_TIME], peak_block->count,
+                 columns[COLUMN_TIME].data());
+    decodeColumn(_data + peak_block->offset + peak_block->column_offset[COLUMN_TEMPERATURE], peak_block->count,
+                 columns[COLUMN_TEMPERATURE].data());
+    for (uint32_t i = 0; i < peak_block->count; i++) {
+      if (columns[COLUMN_TEMPERATURE][i] == summary.temperature_max) {
+        summary.temperature_max_us = columns[COLUMN_TIME][i];
+        break;
+      }
+    }
+  }
+
+  if (summary.samples > 0) {
+    double n = summary.samples;
+    summary.position_min = totals[COLUMN_POSITION].min * 0.1f;
+    summary.position_max = totals[COLUMN_POSITION].max * 0.1f;
+    summary.position_mean = totals[COLUMN_POSITION].sum / n * 0.1;
+    summary.velocity_min = totals[COLUMN_VELOCITY].min;
+    summary.velocity_max = totals[COLUMN_VELOCITY].max;
+    summary.velocity_mean = totals[COLUMN_VELOCITY].sum / n;
+    summary.current_min = totals[COLUMN_CURRENT].min * 0.01f;
+    summary.current_max = totals[COLUMN_CURRENT].max * 0.01f;
+    summary.current_mean = totals[COLUMN_CURRENT].sum / n * 0.01;
+    summary.current_rms = std::sqrt(totals[COLUMN_CURRENT].sum_sq / n) * 0.01;
+  } else {
+    summary.temperature_max = 0;
+  }
+  return summary;
+}
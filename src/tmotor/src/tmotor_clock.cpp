@@ -0,0 +1,140 @@
+/**
+ * @file tmotor_clock.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_clock.hpp"
+
+#include <algorithm>
+
+using namespace TMotor;
+
+/* the virtual clock that released the calling thread from its last sleep */
+static thread_local VirtualClock *awake_on = nullptr;
+
+std::shared_ptr<Clock> Clock::system() {
+  static std::shared_ptr<Clock> clock = std::make_shared<SystemClock>();
+  return clock;
+}
+
+Clock::time_point SystemClock::now() {
+  return std::chrono::steady_clock::now();
+}
+
+void SystemClock::sleepUntil(time_point deadline, const StopToken *token) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  _cv.wait_until(lock, deadline, [token] { return token != nullptr && token->stopRequested(); });
+}
+
+void SystemClock::requestStop(StopToken &token) {
+  {
+    // set under the mutex so a sleeper cannot miss it between its check and its wait
+    std::lock_guard<std::mutex> lock(_mutex);
+    __request(token);
+  }
+  _cv.notify_all();
+}
+
+VirtualClock::VirtualClock(time_point start) :
+  _now(start),
+  _running(0)
+{
+  return;
+}
+
+Clock::time_point VirtualClock::now() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  return _now;
+}
+
+void VirtualClock::sleepUntil(time_point deadline, const StopToken *token) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  if (awake_on == this) {
+    awake_on = nullptr;
+    _running--;
+    _cv.notify_all();
+  }
+  if (deadline <= _now || (token != nullptr && token->stopRequested())) {
+    return;
+  }
+  Sleeper sleeper{deadline, token, false, false};
+  _sleepers.push_back(&sleeper);
+  _cv.notify_all();
+  _cv.wait(lock, [&sleeper] { return sleeper.released; });
+  _sleepers.erase(std::find(_sleepers.begin(), _sleepers.end(), &sleeper));
+  if (sleeper.advanced) {
+    awake_on = this;
+  }
+}
+
+void VirtualClock::requestStop(StopToken &token) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  __request(token);
+  for (Sleeper *sleeper : _sleepers) {
+    if (sleeper->token == &token) {
+      sleeper->released = true;
+    }
+  }
+  _cv.notify_all();
+}
+
+void VirtualClock::leave() {
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (awake_on == this) {
+    awake_on = nullptr;
+    _running--;
+    _cv.notify_all();
+  }
+}
+
+void VirtualClock::__settle(std::unique_lock<std::mutex> &lock) {
+  _cv.wait(lock, [this] { return _running == 0; });
+}
+
+void VirtualClock::advance(duration step) {
+  advanceTo(now() + step);
+}
+
+void VirtualClock::advanceTo(time_point target) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (true) {
+    __settle(lock);
+    time_point next = target;
+    for (Sleeper *sleeper : _sleepers) {
+      if (!sleeper->released && sleeper->deadline < next) {
+        next = sleeper->deadline;
+      }
+    }
+    if (next > _now) {
+      _now = next;
+    }
+    for (Sleeper *sleeper : _sleepers) {
+      if (!sleeper->released && sleeper->deadline <= _now) {
+        sleeper->released = true;
+        sleeper->advanced = true;
+        _running++;
+      }
+    }
+    _cv.notify_all();
+    if (_now >= target) {
+      __settle(lock);
+      return;
+    }
+  }
+}
+
+bool VirtualClock::waitForSleepers(size_t count, std::chrono::milliseconds timeout) {
+  std::unique_lock<std::mutex> lock(_mutex);
+  return _cv.wait_for(lock, timeout, [this, count] {
+    size_t sleeping = 0;
+    for (Sleeper *sleeper : _sleepers) {
+      sleeping += sleeper->released ? 0 : 1;
+    }
+    return sleeping >= count;
+  });
+}
@@ -0,0 +1,201 @@
+/**
+ * @file tmotor_controller.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_controller.hpp"
+#include "../include/tmotor_trace.hpp"
+
+#include <cmath>
+#include <stdexcept>
+#include <pthread.h>
+
+using namespace TMotor;
+
+ImpedanceController::ImpedanceController(std::shared_ptr<AKBus> bus, std::chrono::nanoseconds period) :
+  _bus(bus),
+  _clock(bus->getClock()),
+  _period(period),
+  _feedback_timeout(std::chrono::milliseconds(50)),
+  _channels_by_id(),
+  _stop(),
+  _ticks(0),
+  _overruns(0),
+  _stale(0),
+  _wake_sum(0.0),
+  _wake_sq_sum(0.0),
+  _wake_max(0.0),
+  _latency_sum(0.0),
+  _latency_max(0.0),
+  _wake_histogram(std::make_shared<LatencyHistogram>()),
+  _latency_histogram(std::make_shared<LatencyHistogram>())
+{
+  return;
+}
+
+ImpedanceController::~ImpedanceController() {
+  stop();
+}
+
+void ImpedanceController::addMotor(uint8_t motor_id, const ImpedanceGains &gains) {
+  if (_channels_by_id[motor_id] != nullptr) {
+    _channels_by_id[motor_id]->gains.store(gains);
+    return;
+  }
+  _channels.emplace_back(new Channel(motor_id, gains));
+  _channels.back()->manager.connect(_bus);
+  _channels_by_id[motor_id] = _channels.back().get();
+}
+
+void ImpedanceController::setFeedbackTimeout(std::chrono::nanoseconds timeout) {
+  _feedback_timeout = timeout;
+}
+
+void ImpedanceController::setGains(uint8_t motor_id, const ImpedanceGains &gains) {
+  if (_channels_by_id[motor_id] != nullptr) {
+    _channels_by_id[motor_id]->gains.store(gains);
+  }
+}
+
+void ImpedanceController::setTarget(uint8_t motor_id, const ImpedanceTarget &target) {
+  if (_channels_by_id[motor_id] != nullptr) {
+    _channels_by_id[motor_id]->target.store(target);
+  }
+}
+
+void ImpedanceController::setEnabled(uint8_t motor_id, bool enabled) {
+  if (_channels_by_id[motor_id] != nullptr) {
+    _channels_by_id[motor_id]->enabled = enabled;
+  }
+}
+
+void ImpedanceController::__tick() {
+  // refused commands are skipped rather than thrown, which would allocate on every tick of a stopped bus
+  if (_bus->isStopped()) {
+    return;
+  }
+  Clock::time_point now = _clock->now();
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    uint8_t motor_id = channel->manager.getMotorID();
+    if (!channel->enabled.load(std::memory_order_relaxed) || _bus->isTripped(motor_id)) {
+      continue;
+    }
+    // without the lock of the reader, which every waiter of the bus contends for
+    MotorState state = _bus->peekState(motor_id);
+    float current = 0.0f;
+    if (state.sequence == 0 || now - state.timestamp > _feedback_timeout) {
+      _stale.store(_stale.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    } else {
+      ImpedanceGains gains = channel->gains.load();
+      ImpedanceTarget target = channel->target.load();
+      current = gains.kp * (target.position - state.position)
+              + gains.kd * (target.velocity - state.velocity)
+              + target.feedforward;
+      if (current > gains.current_limit) current = gains.current_limit;
+      if (current < -gains.current_limit) current = -gains.current_limit;
+    }
+    try {
+      channel->manager.sendCurrent(current);
+    } catch (CANSocketException &e) {
+      // a write error counted by the bus statistics, or a stop latched since the check, the next tick tries again
+    }
+  }
+}
+
+void ImpedanceController::__run() {
+  TMOTOR_TRACE_THREAD("tmotor controller");
+  prefaultStack(64 * 1024);
+  Clock::time_point deadline = _clock->now() + _period;
+  while (true) {
+    {
+      TMOTOR_TRACE_SCOPE("controller.sleep");
+      _clock->sleepUntil(deadline, &_stop);
+    }
+    if (_stop.stopRequested()) {
+      break;
+    }
+    Clock::time_point woke = _clock->now();
+    {
+      TMOTOR_TRACE_SCOPE("controller.tick");
+      __tick();
+    }
+    Clock::time_point done = _clock->now();
+
+    double wake = std::chrono::duration<double, std::micro>(woke - deadline).count();
+    double latency = std::chrono::duration<double, std::micro>(done - deadline).count();
+    _ticks.store(_ticks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    _wake_sum.store(_wake_sum.load(std::memory_order_relaxed) + wake, std::memory_order_relaxed);
+    _wake_sq_sum.store(_wake_sq_sum.load(std::memory_order_relaxed) + wake*wake, std::memory_order_relaxed);
+    if (wake > _wake_max.load(std::memory_order_relaxed)) _wake_max.store(wake, std::memory_order_relaxed);
+    _latency_sum.store(_latency_sum.load(std::memory_order_relaxed) + latency, std::memory_order_relaxed);
+    if (latency > _latency_max.load(std::memory_order_relaxed)) _latency_max.store(latency, std::memory_order_relaxed);
+    _wake_histogram->record(wake);
+    _latency_histogram->record(latency);
+
+    deadline += _period;
+    if (done > deadline) {
+      _overruns.store(_overruns.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      deadline = done + _period; // skip the missed ticks rather than bursting
+    }
+  }
+  _clock->leave();
+}
+
+void ImpedanceController::start(int priority) {
+  stop();
+  _ticks = 0;
+  _overruns = 0;
+  _stale = 0;
+  _wake_sum = 0.0;
+  _wake_sq_sum = 0.0;
+  _wake_max = 0.0;
+  _latency_sum = 0.0;
+  _latency_max = 0.0;
+  _wake_histogram->reset();
+  _latency_histogram->reset();
+  _stop.reset();
+  _loop = std::thread([this] { __run(); });
+  if (priority > 0) {
+    struct sched_param param;
+    param.sched_priority = priority;
+    if (pthread_setschedparam(_loop.native_handle(), SCHED_FIFO, &param) != 0) {
+      stop();
+      throw std::runtime_error("Unable to set the real-time priority of the control loop.");
+    }
+  }
+}
+
+void ImpedanceController::stop() {
+  if (_loop.joinable()) {
+    _clock->requestStop(_stop);
+    _loop.join();
+  }
+}
+
+LoopStatistics ImpedanceController::getStatistics() {
+  LoopStatistics stats;
+  stats.ticks = _ticks.load(std::memory_order_relaxed);
+  stats.overruns = _overruns.load(std::memory_order_relaxed);
+  stats.stale = _stale.load(std::memory_order_relaxed);
+  double ticks = stats.ticks > 0 ? stats.ticks : 1;
+  stats.wake_mean_us = _wake_sum.load(std::memory_order_relaxed) / ticks;
+  stats.wake_max_us = _wake_max.load(std::memory_order_relaxed);
+  double variance = _wake_sq_sum.load(std::memory_order_relaxed) / ticks - stats.wake_mean_us * stats.wake_mean_us;
+  stats.jitter_us = variance > 0.0 ? std::sqrt(variance) : 0.0;
+  stats.latency_mean_us = _latency_sum.load(std::memory_order_relaxed) / ticks;
+  stats.latency_max_us = _latency_max.load(std::memory_order_relaxed);
+  return stats;
+}
+
+std::shared_ptr<const LatencyHistogram> ImpedanceController::getWakeHistogram() {
+  return _wake_histogram;
+}
+
+std::shared_ptr<const LatencyHistogram> ImpedanceController::getLatencyHistogram() {
+  return _latency_histogram;
+}
@@ -0,0 +1,320 @@
+/**
+ * @file tmotor_metrics.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_metrics.hpp"
+
+#include <stdarg.h>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+
+using namespace TMotor;
+
+LatencyHistogram::LatencyHistogram() :
+  _sum_us(0.0)
+{
+  for (std::atomic<uint64_t> &bucket : _buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::record(double us) {
+  size_t bucket = 0;
+  while (bucket < histogram_buckets - 1 && us > histogram_bounds_us[bucket]) {
+    bucket++;
+  }
+  _buckets[bucket].store(_buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  _sum_us.store(_sum_us.load(std::memory_order_relaxed) + us, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::reset() {
+  for (std::atomic<uint64_t> &bucket : _buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+  _sum_us.store(0.0, std::memory_order_relaxed);
+}
+
+HistogramSnapshot LatencyHistogram::snapshot() const {
+  HistogramSnapshot snapshot;
+  snapshot.count = 0;
+  for (size_t i = 0; i < histogram_buckets; i++) {
+    snapshot.buckets[i] = _buckets[i].load(std::memory_order_relaxed);
+    snapshot.count += snapshot.buckets[i];
+  }
+  snapshot.sum_us = _sum_us.load(std::memory_order_relaxed);
+  return snapshot;
+}
+
+MetricsExporter::MetricsExporter(std::shared_ptr<AKBus> bus) :
+  _bus(bus),
+  _listen_fd(-1),
+  _shutdown(true)
+{
+  return;
+}
+
+MetricsExporter::~MetricsExporter() {
+  stop();
+}
+
+void MetricsExporter::addHistogram(const std::string &name, const std::string &help, const std::string &labels,
+                                   std::shared_ptr<const LatencyHistogram> histogram) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  _histograms.push_back(Histogram{name, help, labels, histogram});
+}
+
+void MetricsExporter::__listen(int fd, const struct sockaddr *addr, socklen_t addr_len) {
+  if (fd < 0) {
+    throw std::runtime_error("Unable to create the metrics socket.");
+  }
+  if (bind(fd, addr, addr_len) < 0 || listen(fd, 4) < 0) {
+    close(fd);
+    throw std::runtime_error("Unable to bind the metrics socket.");
+  }
+  _listen_fd = fd;
+  _shutdown = false;
+  _server = std::thread([this] { __serve(); });
+}
+
+void MetricsExporter::listenUnix(const char *path) {
+  stop();
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("The metrics socket path is too long.");
+  }
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  __listen(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0), (struct sockaddr *) &addr, sizeof(addr));
+  _unix_path = path;
+}
+
+uint16_t MetricsExporter::listenTCP(uint16_t port) {
+  stop();
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int reuse = 1;
+  if (fd >= 0) {
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  }
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  __listen(fd, (struct sockaddr *) &addr, sizeof(addr));
+  socklen_t addr_len = sizeof(addr);
+  getsockname(_listen_fd, (struct sockaddr *) &addr, &addr_len);
+  return ntohs(addr.sin_port);
+}
+
+void MetricsExporter::stop() {
+  _shutdown = true;
+  if (_server.joinable()) {
+    _server.join();
+  }
+  if (_listen_fd > -1) {
+    close(_listen_fd);
+    _listen_fd = -1;
+  }
+  if (!_unix_path.empty()) {
+    unlink(_unix_path.c_str());
+    _unix_path.clear();
+  }
+}
+
+void MetricsExporter::__serve() {
+  // scraping is never urgent, leave the CPU to everything else
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+  while (!_shutdown) {
+    struct pollfd pfd = {_listen_fd, POLLIN, 0};
+    if (poll(&pfd, 1, 100) <= 0) {
+      continue;
+    }
+    int fd = accept4(_listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) {
+      continue;
+    }
+    __answer(fd);
+    close(fd);
+  }
+}
+
+void MetricsExporter::__answer(int fd) {
+  struct timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  std::string request;
+  char buffer[1024];
+  while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+    ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+    if (received <= 0) {
+      break;
+    }
+    request.append(buffer, received);
+  }
+
+  std::string status("200 OK");
+  std::string body;
+  if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0) {
+    body = render();
+  } else {
+    status = "404 Not Found";
+    body = "Only GET /metrics is served.\n";
+  }
+  std::string response = "HTTP/1.0 " + status + "\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                         "Connection: close\r\n\r\n" + body;
+  size_t sent = 0;
+  while (sent < response.size()) {
+    ssize_t result = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (result <= 0) {
+      break;
+    }
+    sent += result;
+  }
+}
+
+/* Appends a formatted line to the output. */
+static void print(std::string &out, const char *format, ...) {
+  char line[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  if (length > 0) {
+    out.append(line, std::min((size_t) length, sizeof(line) - 1));
+  }
+}
+
+static void print_header(std::string &out, const char *name, const char *type, const char *help) {
+  print(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+std::string MetricsExporter::render() {
+  std::string out;
+  BusStatistics stats = _bus->getStatistics();
+
+  struct {
+    const char *name;
+    const char *help;
+    uint64_t value;
+  } counters[] = {
+    {"tmotor_bus_rx_frames_total", "Frames received through the bus socket.", stats.rx_frames},
+    {"tmotor_bus_rx_bytes_total", "Data bytes received through the bus socket.", stats.rx_bytes},
+    {"tmotor_bus_tx_frames_total", "Frames written through the bus.", stats.tx_frames},
+    {"tmotor_bus_tx_bytes_total", "Data bytes written through the bus.", stats.tx_bytes},
+    {"tmotor_bus_bits_total", "Worst-case bits the counted frames occupied on the wire.", stats.bits},
+    {"tmotor_bus_error_frames_total", "Error frames received.", stats.error_frames},
+    {"tmotor_bus_tx_failures_total", "Frames that could not be written.", stats.tx_failures},
+    {"tmotor_bus_rx_dropped_total", "Frames the kernel dropped because the receive queue was full.", stats.rx_dropped},
+  };
+  for (const auto &counter : counters) {
+    print_header(out, counter.name, "counter", counter.help);
+    print(out, "%s %llu\n", counter.name, (unsigned long long) counter.value);
+  }
+
+  struct {
+    const char *name;
+    const char *help;
+    uint64_t TrafficCounters::*field;
+  } traffic[] = {
+    {"tmotor_motor_rx_frames_total", "Frames received from a motor.", &TrafficCounters::rx_frames},
+    {"tmotor_motor_tx_frames_total", "Frames written to a motor.", &TrafficCounters::tx_frames},
+  };
+  for (const auto &counter : traffic) {
+    print_header(out, counter.name, "counter", counter.help);
+    for (int motor_id = 0; motor_id < 256; motor_id++) {
+      const TrafficCounters &motor = stats.motors[motor_id];
+      if (motor.rx_frames > 0 || motor.tx_frames > 0) {
+        print(out, "%s{motor=\"0x%02x\"} %llu\n", counter.name, motor_id, (unsigned long long) (motor.*counter.field));
+      }
+    }
+  }
+
+  std::vector<MotorState> states;
+  std::vector<int> motor_ids;
+  for (int motor_id = 0; motor_id < 256; motor_id++) {
+    MotorState state = _bus->peekState(motor_id);
+    if (state.sequence > 0) {
+      states.push_back(state);
+      motor_ids.push_back(motor_id);
+    }
+  }
+  Clock::time_point now = _bus->getClock()->now();
+  struct {
+    const char *name;
+    const char *type;
+    const char *help;
+    std::function<double(const MotorState&)> value;
+  } telemetry[] = {
+    {"tmotor_motor_feedback_total", "counter", "Feedback frames decoded.",
+     [](const MotorState &state) { return (double) state.sequence; }},
+    {"tmotor_motor_feedback_age_seconds", "gauge", "Time since the last feedback frame.",
+     [now](const MotorState &state) { return std::chrono::duration<double>(now - state.timestamp).count(); }},
+    {"tmotor_motor_position_degrees", "gauge", "Reported position.",
+     [](const MotorState &state) { return (double) state.position; }},
+    {"tmotor_motor_velocity_rpm", "gauge", "Low-pass filtered velocity.",
+     [](const MotorState &state) { return (double) state.derived.velocity; }},
+    {"tmotor_motor_acceleration_rpm_per_second", "gauge", "Low-pass filtered acceleration.",
+     [](const MotorState &state) { return (double) state.derived.acceleration; }},
+    {"tmotor_motor_current_amperes", "gauge", "Reported current.",
+     [](const MotorState &state) { return (double) state.current; }},
+    {"tmotor_motor_power_watts", "gauge", "Electrical power, zero unless the motor constants are configured.",
+     [](const MotorState &state) { return (double) state.derived.power; }},
+    {"tmotor_motor_temperature_celsius", "gauge", "Reported temperature.",
+     [](const MotorState &state) { return (double) state.temperature; }},
+    {"tmotor_motor_fault", "gauge", "Reported fault code, 0 when healthy.",
+     [](const MotorState &state) { return (double) state.motor_fault; }},
+  };
+  for (const auto &metric : telemetry) {
+    print_header(out, metric.name, metric.type, metric.help);
+    for (size_t i = 0; i < states.size(); i++) {
+      print(out, "%s{motor=\"0x%02x\"} %.9g\n", metric.name, motor_ids[i], metric.value(states[i]));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  std::vector<const Histogram *> sorted;
+  for (const Histogram &histogram : _histograms) {
+    sorted.push_back(&histogram);
+  }
+  // the series of a metric must be contiguous, keep the registration order otherwise
+  std::stable_sort(sorted.begin(), sorted.end(), [](const Histogram *a, const Histogram *b) {
+    return a->name < b->name;
+  });
+  for (size_t i = 0; i < sorted.size(); i++) {
+    const Histogram &histogram = *sorted[i];
+    if (i == 0 || sorted[i-1]->name != histogram.name) {
+      print_header(out, histogram.name.c_str(), "histogram", histogram.help.c_str());
+    }
+    std::string labels = histogram.labels.empty() ? "" : histogram.labels + ",";
+    HistogramSnapshot snapshot = histogram.histogram->snapshot();
+    uint64_t cumulative = 0;
+    for (size_t bucket = 0; bucket < histogram_buckets; bucket++) {
+      cumulative += snapshot.buckets[bucket];
+      if (bucket < histogram_buckets - 1) {
+        print(out, "%s_bucket{%sle=\"%g\"} %llu\n", histogram.name.c_str(), labels.c_str(),
+              histogram_bounds_us[bucket] * 1e-6, (unsigned long long) cumulative);
+      } else {
+        print(out, "%s_bucket{%sle=\"+Inf\"} %llu\n", histogram.name.c_str(), labels.c_str(),
+              (unsigned long long) cumulative);
+      }
+    }
+    std::string braces = histogram.labels.empty() ? "" : "{" + histogram.labels + "}";
+    print(out, "%s_sum%s %.9g\n", histogram.name.c_str(), braces.c_str(), snapshot.sum_us * 1e-6);
+    print(out, "%s_count%s %llu\n", histogram.name.c_str(), braces.c_str(), (unsigned long long) snapshot.count);
+  }
+  return out;
+}
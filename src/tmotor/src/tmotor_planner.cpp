@@ -0,0 +1,196 @@
+/**
+ * @file tmotor_planner.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_planner.hpp"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+using namespace TMotor;
+
+uint8_t TMotor::commandDLC(CommandType command) {
+  switch (command) {
+    case CommandType::PVA:
+    case CommandType::MIT:
+      return 8;
+    default:
+      return 4;
+  }
+}
+
+static uint32_t command_mode(CommandType command) {
+  switch (command) {
+    case CommandType::DUTY:     return MotorModeID::DUTY;
+    case CommandType::CURRENT:  return MotorModeID::CURRENTLOOP;
+    case CommandType::BRAKE:    return MotorModeID::CURRENTBREAK;
+    case CommandType::VELOCITY: return MotorModeID::VELOCITY;
+    case CommandType::POSITION: return MotorModeID::POSITION;
+    default:                    return MotorModeID::POSITIONVELOCITY;
+  }
+}
+
+/* Arbitration order of a CAN ID, a standard frame wins against an extended frame with the same 11 bit base. */
+static uint64_t arbitration_key(uint32_t can_id, bool extended) {
+  if (!extended) {
+    return (uint64_t) (can_id & CAN_SFF_MASK) << 19;
+  }
+  return (uint64_t) ((can_id >> 18) & CAN_SFF_MASK) << 19 | 1u << 18 | (can_id & 0x3FFFF);
+}
+
+BusPlanner::BusPlanner(uint32_t bitrate, float headroom, int mit_reply_id) :
+  _bitrate(bitrate > 0 ? bitrate : 1),
+  _headroom(headroom),
+  _mit_reply_id(mit_reply_id)
+{
+  return;
+}
+
+std::vector<BusPlanner::Flow> BusPlanner::__flows(const std::vector<MotorLoad> &loads) const {
+  std::vector<Flow> flows;
+  for (size_t i = 0; i < loads.size(); i++) {
+    const MotorLoad &load = loads[i];
+    if (load.rate > 0.0f) {
+      Flow flow;
+      if (load.command == CommandType::MIT) {
+        flow.priority = arbitration_key(load.motor_id, false);
+        flow.bits = frameBits(false, 8);
+      } else {
+        flow.priority = arbitration_key(command_mode(load.command) | load.motor_id, true);
+        flow.bits = frameBits(true, commandDLC(load.command));
+      }
+      flow.period_us = 1e6f / load.rate;
+      flow.load = i;
+      flows.push_back(flow);
+    }
+    float feedback_rate = load.command == CommandType::MIT ? load.rate : load.feedback_rate;
+    if (feedback_rate > 0.0f) {
+      Flow flow;
+      if (load.command == CommandType::MIT) {
+        flow.priority = arbitration_key(_mit_reply_id, false);
+        flow.bits = frameBits(false, 8);
+      } else {
+        flow.priority = arbitration_key(TMOTOR_AK_FEEDBACK_ID | load.motor_id, true);
+        flow.bits = frameBits(true, 8);
+      }
+      flow.period_us = 1e6f / feedback_rate;
+      flow.load = -1;
+      flows.push_back(flow);
+    }
+  }
+  return flows;
+}
+
+BusPlan BusPlanner::__plan(const std::vector<MotorLoad> &loads) const {
+  const float infinity = std::numeric_limits<float>::infinity();
+  float bit_us = 1e6f / _bitrate;
+  std::vector<Flow> flows = __flows(loads);
+
+  BusPlan plan;
+  plan.utilization = 0.0f;
+  for (const Flow &flow : flows) {
+    plan.utilization += flow.bits * bit_us / flow.period_us;
+  }
+  plan.max_latency_us = 0.0f;
+  plan.latency_us.assign(loads.size(), 0.0f);
+  plan.schedulable = plan.utilization <= _headroom;
+
+  for (const Flow &flow : flows) {
+    float cost = flow.bits * bit_us;
+    float latency = infinity;
+    if (plan.utilization < 1.0f) {
+      float blocking = 0.0f;
+      for (const Flow &other : flows) {
+        if (other.priority > flow.priority) {
+          blocking = std::max(blocking, other.bits * bit_us);
+        }
+      }
+      // queuing delay, frames of equal priority are counted as interference
+      float queuing = blocking;
+      while (true) {
+        float next = blocking;
+        for (const Flow &other : flows) {
+          if (&other != &flow && other.priority <= flow.priority) {
+            next += std::ceil((queuing + bit_us) / other.period_us) * other.bits * bit_us;
+          }
+        }
+        if (next <= queuing || next + cost > flow.period_us) {
+          queuing = next;
+          break;
+        }
+        queuing = next;
+      }
+      latency = queuing + cost;
+    }
+    if (latency > flow.period_us) {
+      plan.schedulable = false;
+    }
+    plan.max_latency_us = std::max(plan.max_latency_us, latency);
+    if (flow.load >= 0) {
+      plan.latency_us[flow.load] = latency;
+    }
+  }
+  return plan;
+}
+
+BusPlan BusPlanner::evaluate(const std::vector<MotorLoad> &loads) const {
+  return __plan(loads);
+}
+
+BusPlan BusPlanner::plan() const {
+  return __plan(_loads);
+}
+
+bool BusPlanner::admit(MotorLoad &load, AdmissionPolicy policy) {
+  std::vector<MotorLoad> loads(_loads);
+  loads.push_back(load);
+  if (__plan(loads).schedulable) {
+    _loads.push_back(load);
+    return true;
+  }
+  if (policy == AdmissionPolicy::REJECT) {
+    return false;
+  }
+
+  // only the command rate is ours to lower, the servo feedback rate is set in the motor firmware while MIT
+  // replies follow the commands, so a load whose feedback alone does not fit is refused
+  loads.back().rate = 0.0f;
+  if (!__plan(loads).schedulable) {
+    return false;
+  }
+
+  // the plan only gets worse with the rate of the load, bisect the largest scale that still fits
+  float lo = 0.0f, hi = 1.0f;
+  for (int i = 0; i < 24; i++) {
+    float scale = (lo + hi) / 2;
+    loads.back().rate = load.rate * scale;
+    if (__plan(loads).schedulable) {
+      lo = scale;
+    } else {
+      hi = scale;
+    }
+  }
+  if (lo <= 0.0f || (load.rate > 0.0f && load.rate * lo < 1.0f)) {
+    return false;
+  }
+  load.rate *= lo;
+  _loads.push_back(load);
+  return true;
+}
+
+void BusPlanner::release(uint8_t motor_id) {
+  _loads.erase(std::remove_if(_loads.begin(), _loads.end(),
+                              [motor_id](const MotorLoad &load) { return load.motor_id == motor_id; }),
+               _loads.end());
+}
+
+const std::vector<MotorLoad> &BusPlanner::loads() const {
+  return _loads;
+}
@@ -0,0 +1,173 @@
+/**
+ * @file tmotor_poller.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_poller.hpp"
+#include "../include/tmotor_trace.hpp"
+
+using namespace TMotor;
+
+RoundRobinPoller::RoundRobinPoller(std::shared_ptr<AKBus> bus, size_t max_in_flight,
+                                   std::chrono::nanoseconds reply_timeout) :
+  _bus(bus),
+  _clock(bus->getClock()),
+  _max_in_flight(max_in_flight > 0 ? max_in_flight : 1),
+  _reply_timeout(reply_timeout),
+  _shutdown(true),
+  _started(),
+  _window(1),
+  _cycles(0)
+{
+  return;
+}
+
+RoundRobinPoller::~RoundRobinPoller() {
+  stop();
+}
+
+void RoundRobinPoller::addMotor(uint8_t motor_id, std::function<void(AKManager&)> request) {
+  _channels.emplace_back(new Channel(motor_id, request));
+  _channels.back()->manager.connect(_bus);
+}
+
+bool RoundRobinPoller::__collect(Clock::time_point now) {
+  bool timed_out = false;
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    if (!channel->in_flight) {
+      continue;
+    }
+    if (_bus->peekState(channel->manager.getMotorID()).sequence != channel->sent_sequence) {
+      double rtt = std::chrono::duration<double, std::micro>(now - channel->sent).count();
+      channel->replies.store(channel->replies.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      channel->rtt_sum.store(channel->rtt_sum.load(std::memory_order_relaxed) + rtt, std::memory_order_relaxed);
+      if (rtt > channel->rtt_max.load(std::memory_order_relaxed)) channel->rtt_max.store(rtt, std::memory_order_relaxed);
+      channel->rtt->record(rtt);
+      channel->in_flight = false;
+    } else if (now - channel->sent > _reply_timeout) {
+      channel->timeouts.store(channel->timeouts.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      channel->in_flight = false;
+      timed_out = true;
+    }
+  }
+  return timed_out;
+}
+
+void RoundRobinPoller::__run() {
+  size_t next = 0;
+  size_t in_flight = 0;
+  bool cycle_timed_out = false;
+  uint32_t bus_sequence = _bus->getSequence();
+  TMOTOR_TRACE_THREAD("tmotor poller");
+  while (!_shutdown) {
+    // fill the window, a motor waiting for its reply holds the round-robin until it completes or times out
+    size_t window = _window.load(std::memory_order_relaxed);
+    size_t visited = 0;
+    // refused requests are skipped rather than thrown, a stopped bus only waits for feedback
+    while (!_bus->isStopped() && in_flight < window && !_channels[next]->in_flight && visited < _channels.size()) {
+      Channel &channel = *_channels[next];
+      uint8_t motor_id = channel.manager.getMotorID();
+      visited++;
+      if (!_bus->isTripped(motor_id)) {
+        channel.sent_sequence = _bus->peekState(motor_id).sequence;
+        channel.sent = _clock->now();
+        channel.in_flight = true;
+        in_flight++;
+        channel.requests.store(channel.requests.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        try {
+          TMOTOR_TRACE_SCOPE("poller.request");
+          channel.request(channel.manager);
+        } catch (CANSocketException &e) {
+          // a write error counted by the bus statistics, or a stop latched since the check, the request times
+          // out like a lost reply
+        }
+      }
+      next = (next + 1) % _channels.size();
+      if (next == 0) {
+        _cycles.store(_cycles.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (cycle_timed_out) {
+          window = window > 1 ? window / 2 : 1;
+        } else if (window < _max_in_flight && window < _channels.size()) {
+          window++;
+        }
+        _window.store(window, std::memory_order_relaxed);
+        cycle_timed_out = false;
+      }
+    }
+
+    {
+      TMOTOR_TRACE_SCOPE("poller.wait");
+      bus_sequence = _bus->waitForUpdate(bus_sequence, std::chrono::milliseconds(1));
+    }
+    cycle_timed_out |= __collect(_clock->now());
+    in_flight = 0;
+    for (std::unique_ptr<Channel> &channel : _channels) {
+      in_flight += channel->in_flight ? 1 : 0;
+    }
+  }
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    channel->in_flight = false;
+  }
+}
+
+void RoundRobinPoller::start() {
+  stop();
+  if (_channels.empty()) {
+    return;
+  }
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    channel->requests = 0;
+    channel->replies = 0;
+    channel->timeouts = 0;
+    channel->rtt_sum = 0.0;
+    channel->rtt_max = 0.0;
+    channel->rtt->reset();
+  }
+  _window = 1;
+  _cycles = 0;
+  _started = _clock->now();
+  _shutdown = false;
+  _loop = std::thread([this] { __run(); });
+}
+
+void RoundRobinPoller::stop() {
+  _shutdown = true;
+  if (_loop.joinable()) {
+    _loop.join();
+  }
+}
+
+PollerStatistics RoundRobinPoller::getStatistics() {
+  PollerStatistics stats;
+  double elapsed = std::chrono::duration<double>(_clock->now() - _started).count();
+  if (elapsed <= 0.0) elapsed = 1.0;
+  stats.cycles = _cycles.load(std::memory_order_relaxed);
+  stats.cycles_per_second = stats.cycles / elapsed;
+  stats.window = _window.load(std::memory_order_relaxed);
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    PollStatistics motor;
+    motor.motor_id = channel->manager.getMotorID();
+    motor.requests = channel->requests.load(std::memory_order_relaxed);
+    motor.replies = channel->replies.load(std::memory_order_relaxed);
+    motor.timeouts = channel->timeouts.load(std::memory_order_relaxed);
+    motor.rate_hz = motor.replies / elapsed;
+    motor.rtt_mean_us = motor.replies > 0 ? channel->rtt_sum.load(std::memory_order_relaxed) / motor.replies : 0.0;
+    motor.rtt_max_us = channel->rtt_max.load(std::memory_order_relaxed);
+    stats.motors.push_back(motor);
+  }
+  return stats;
+}
+
+std::shared_ptr<const LatencyHistogram> RoundRobinPoller::getLatencyHistogram(uint8_t motor_id) {
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    if (channel->manager.getMotorID() == motor_id) {
+      return channel->rtt;
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,219 @@
+/**
+ * @file tmotor_sim.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_sim.hpp"
+
+#include <cmath>
+
+using namespace TMotor;
+
+#define TMOTOR_DEG_TO_RAD 0.017453293f
+
+static int32_t le_int32(const uint8_t *data) {
+  return (int32_t) ((uint32_t) data[0] | (uint32_t) data[1] << 8 | (uint32_t) data[2] << 16 | (uint32_t) data[3] << 24);
+}
+
+static int32_t be_int32(const uint8_t *data) {
+  return (int32_t) ((uint32_t) data[0] << 24 | (uint32_t) data[1] << 16 | (uint32_t) data[2] << 8 | (uint32_t) data[3]);
+}
+
+static int16_t saturate_int16(float value) {
+  if (value > 32767.0f) return 32767;
+  if (value < -32768.0f) return -32768;
+  return (int16_t) std::lround(value);
+}
+
+SimulatedMotor::SimulatedMotor(uint8_t motor_id, const MotorModel &model) :
+  _motor_id(motor_id),
+  _model(model),
+  _mode(MotorModeID::CURRENTLOOP),
+  _setpoint(0.0f),
+  _position(0.0f),
+  _velocity(0.0f),
+  _current(0.0f),
+  _temperature(model.ambient)
+{
+  return;
+}
+
+uint8_t SimulatedMotor::getMotorID() const {
+  return _motor_id;
+}
+
+bool SimulatedMotor::receive(const struct can_frame &frame) {
+  if (!(frame.can_id & CAN_EFF_FLAG) || (frame.can_id & 0xFF) != _motor_id) {
+    return false;
+  }
+  MotorModeID mode = (MotorModeID) (frame.can_id & CAN_EFF_MASK & ~0xFFu);
+  switch (mode) {
+    case MotorModeID::DUTY:
+      _mode = MotorModeID::CURRENTLOOP;
+      _setpoint = le_int32(frame.data) / 100000.0f * _model.current_limit;
+      break;
+    case MotorModeID::CURRENTLOOP:
+      _mode = mode;
+      _setpoint = le_int32(frame.data) / 100.0f;
+      break;
+    case MotorModeID::CURRENTBREAK:
+      _mode = mode;
+      _setpoint = le_int32(frame.data) / 1000.0f;
+      break;
+    case MotorModeID::VELOCITY:
+      _mode = mode;
+      _setpoint = (float) be_int32(frame.data) / _model.pole_pairs;
+      break;
+    case MotorModeID::POSITION:
+      _mode = mode;
+      _setpoint = (float) be_int32(frame.data);
+      break;
+    case MotorModeID::POSITIONVELOCITY:
+      _mode = MotorModeID::POSITION;
+      _setpoint = be_int32(frame.data) / 10000.0f;
+      break;
+    case MotorModeID::SETORIGIN:
+      _position = 0.0f;
+      break;
+    default:
+      return false;
+  }
+  return true;
+}
+
+void SimulatedMotor::step(std::chrono::nanoseconds dt) {
+  float seconds = std::chrono::duration<float>(dt).count();
+  float rpm = _velocity / TMOTOR_RPM_TO_RADS;
+  float current;
+  switch (_mode) {
+    case MotorModeID::CURRENTBREAK:
+      current = -_model.velocity_kp * rpm;
+      if (current > _setpoint) current = _setpoint;
+      if (current < -_setpoint) current = -_setpoint;
+      break;
+    case MotorModeID::VELOCITY:
+      current = _model.velocity_kp * (_setpoint - rpm);
+      break;
+    case MotorModeID::POSITION:
+      current = _model.velocity_kp * (_model.position_kp * (_setpoint - _position * TMOTOR_RAD_TO_DEG) - rpm);
+      break;
+    default:
+      current = _setpoint;
+      break;
+  }
+  if (current > _model.current_limit) current = _model.current_limit;
+  if (current < -_model.current_limit) current = -_model.current_limit;
+  _current = current;
+
+  float torque = _model.torque_constant * current - _model.damping * _velocity;
+  if (_velocity > 0.0f) torque -= _model.friction;
+  if (_velocity < 0.0f) torque += _model.friction;
+  _velocity += torque / _model.inertia * seconds;
+  _position += _velocity * seconds;
+
+  float heating = current * current * _model.resistance;
+  float cooling = (_temperature - _model.ambient) / _model.thermal_resistance;
+  _temperature += (heating - cooling) / _model.thermal_capacity * seconds;
+}
+
+void SimulatedMotor::feedback(struct can_frame &frame) const {
+  int16_t position = saturate_int16(getPosition() * 10.0f);
+  int16_t velocity = saturate_int16(getVelocity());
+  int16_t current = saturate_int16(_current * 100.0f);
+  float temperature = _temperature > 127.0f ? 127.0f : _temperature;
+  frame.can_id = CAN_EFF_FLAG | TMOTOR_AK_FEEDBACK_ID | _motor_id;
+  frame.can_dlc = 8;
+  frame.data[0] = position >> 8;
+  frame.data[1] = position & 0xFF;
+  frame.data[2] = velocity >> 8;
+  frame.data[3] = velocity & 0xFF;
+  frame.data[4] = current >> 8;
+  frame.data[5] = current & 0xFF;
+  frame.data[6] = (int8_t) temperature;
+  frame.data[7] = MotorFault::NONE;
+}
+
+float SimulatedMotor::getPosition() const {
+  return _position * TMOTOR_RAD_TO_DEG;
+}
+
+float SimulatedMotor::getVelocity() const {
+  return _velocity / TMOTOR_RPM_TO_RADS;
+}
+
+float SimulatedMotor::getCurrent() const {
+  return _current;
+}
+
+float SimulatedMotor::getTemperature() const {
+  return _temperature;
+}
+
+Simulation::Simulation(std::shared_ptr<AKBus> bus) :
+  _bus(bus),
+  _clock(std::make_shared<VirtualClock>()),
+  _fd(-1),
+  _steps(0)
+{
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) < 0) {
+    throw CANSocketException("Unable to create the simulated bus.");
+  }
+  _fd = fds[1];
+  _bus->setClock(_clock);
+  _bus->open(fds[0]);
+}
+
+Simulation::~Simulation() {
+  if (_fd > -1) {
+    close(_fd);
+  }
+}
+
+SimulatedMotor &Simulation::addMotor(uint8_t motor_id, const MotorModel &model) {
+  _motors.emplace_back(new SimulatedMotor(motor_id, model));
+  return *_motors.back();
+}
+
+std::shared_ptr<VirtualClock> Simulation::getClock() {
+  return _clock;
+}
+
+void Simulation::step(std::chrono::nanoseconds dt) {
+  /* deliver the commands written since the last step */
+  struct can_frame frame;
+  while (recv(_fd, &frame, sizeof(frame), MSG_DONTWAIT) == (ssize_t) sizeof(frame)) {
+    for (std::unique_ptr<SimulatedMotor> &motor : _motors) {
+      motor->receive(frame);
+    }
+  }
+
+  for (std::unique_ptr<SimulatedMotor> &motor : _motors) {
+    motor->step(dt);
+    uint32_t sequence = _bus->getState(motor->getMotorID()).sequence;
+    motor->feedback(frame);
+    if (write(_fd, &frame, sizeof(frame)) != (ssize_t) sizeof(frame) ||
+        _bus->waitForUpdate(motor->getMotorID(), sequence, std::chrono::milliseconds(1000)) == sequence) {
+      throw CANSocketException("The simulated feedback was not decoded by the bus.");
+    }
+  }
+
+  _clock->advance(dt);
+  _steps++;
+}
+
+void Simulation::run(std::chrono::nanoseconds duration, std::chrono::nanoseconds dt) {
+  Clock::time_point end = _clock->now() + duration;
+  while (_clock->now() < end) {
+    step(dt);
+  }
+}
+
+uint64_t Simulation::getSteps() const {
+  return _steps;
+}
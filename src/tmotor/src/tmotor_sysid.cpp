@@ -0,0 +1,358 @@
+/**
+ * @file tmotor_sysid.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_sysid.hpp"
+#include "../include/tmotor_trace.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+using namespace TMotor;
+
+ExcitationSignal::ExcitationSignal(const ExcitationConfig &config) :
+  _config(config)
+{
+  if (config.type != ExcitationType::PRBS) {
+    return;
+  }
+  double seconds = std::chrono::duration<double>(config.duration).count();
+  size_t bits = config.bit_time > 0.0f ? (size_t) std::ceil(seconds / config.bit_time) + 1 : 1;
+  _bits.reserve(bits);
+  uint16_t lfsr = config.seed != 0 ? config.seed : 1;
+  for (size_t i = 0; i < bits; i++) {
+    // x^16 + x^14 + x^13 + x^11 + 1, a period of 65535 bits
+    uint16_t bit = ((lfsr >> 0) ^ (lfsr >> 2) ^ (lfsr >> 3) ^ (lfsr >> 5)) & 1u;
+    lfsr = (lfsr >> 1) | (bit << 15);
+    _bits.push_back((lfsr & 1u) ? 1 : -1);
+  }
+}
+
+float ExcitationSignal::at(double seconds) const {
+  double duration = std::chrono::duration<double>(_config.duration).count();
+  if (seconds < 0.0 || seconds >= duration) {
+    return _config.offset;
+  }
+  if (_config.type == ExcitationType::PRBS) {
+    size_t bit = _config.bit_time > 0.0f ? (size_t) (seconds / _config.bit_time) : 0;
+    return _config.offset + _config.amplitude * _bits[bit < _bits.size() ? bit : _bits.size() - 1];
+  }
+  double f0 = _config.start_frequency;
+  double f1 = _config.end_frequency;
+  double phase;
+  if (f0 > 0.0 && f1 > 0.0 && f0 != f1) {
+    double rate = std::log(f1 / f0);
+    phase = 2.0 * M_PI * f0 * duration / rate * (std::exp(rate * seconds / duration) - 1.0);
+  } else {
+    phase = 2.0 * M_PI * f0 * seconds;
+  }
+  return _config.offset + _config.amplitude * (float) std::sin(phase);
+}
+
+namespace {
+
+/* Normal equations of a slice of the rows, the unknowns are a, b and c. */
+struct NormalEquations {
+  double xtx[3][3] = {};
+  double xty[3] = {};
+  double yty = 0.0;
+  double y_sum = 0.0;
+  size_t rows = 0;
+
+  void add(const double x[3], double y) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        xtx[i][j] += x[i] * x[j];
+      }
+      xty[i] += x[i] * y;
+    }
+    yty += y * y;
+    y_sum += y;
+    rows++;
+  }
+
+  void add(const NormalEquations &other) {
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        xtx[i][j] += other.xtx[i][j];
+      }
+      xty[i] += other.xty[i];
+    }
+    yty += other.yty;
+    y_sum += other.y_sum;
+    rows += other.rows;
+  }
+};
+
+double sign(double value) {
+  return value > 0.0 ? 1.0 : (value < 0.0 ? -1.0 : 0.0);
+}
+
+/* Accumulates the windows starting in [first, last), the current of a frame is the one held since the previous. */
+void accumulate(const std::vector<MotorState> &samples, size_t window, size_t first, size_t last,
+                NormalEquations &equations) {
+  for (size_t start = first; start < last; start++) {
+    double x[3] = {0.0, 0.0, 0.0};
+    double y = 0.0;
+    for (size_t k = start; k < start + window; k++) {
+      const MotorState &previous = samples[k];
+      const MotorState &next = samples[k + 1];
+      double dt = std::chrono::duration<double>(next.timestamp - previous.timestamp).count();
+      double w0 = previous.velocity * TMOTOR_RPM_TO_RADS;
+      double w1 = next.velocity * TMOTOR_RPM_TO_RADS;
+      x[1] += 0.5 * (w0 + w1) * dt;
+      x[2] += 0.5 * (sign(w0) + sign(w1)) * dt;
+      y += next.current * dt;
+    }
+    x[0] = (samples[start + window].velocity - samples[start].velocity) * TMOTOR_RPM_TO_RADS;
+    equations.add(x, y);
+  }
+}
+
+/* Solves the 3x3 system with partial pivoting, returns false if it is singular. */
+bool solve(double a[3][3], double b[3], double x[3]) {
+  double scale = 0.0;
+  for (int i = 0; i < 3; i++) {
+    scale = std::max(scale, std::fabs(a[i][i]));
+  }
+  for (int col = 0; col < 3; col++) {
+    int pivot = col;
+    for (int row = col + 1; row < 3; row++) {
+      if (std::fabs(a[row][col]) > std::fabs(a[pivot][col])) pivot = row;
+    }
+    if (std::fabs(a[pivot][col]) <= 1e-12 * scale) {
+      return false;
+    }
+    std::swap(a[col], a[pivot]);
+    std::swap(b[col], b[pivot]);
+    for (int row = col + 1; row < 3; row++) {
+      double factor = a[row][col] / a[col][col];
+      for (int k = col; k < 3; k++) {
+        a[row][k] -= factor * a[col][k];
+      }
+      b[row] -= factor * b[col];
+    }
+  }
+  for (int row = 2; row >= 0; row--) {
+    double sum = b[row];
+    for (int k = row + 1; k < 3; k++) {
+      sum -= a[row][k] * x[k];
+    }
+    x[row] = sum / a[row][row];
+  }
+  return true;
+}
+
+} // namespace
+
+IdentifiedModel TMotor::fitModel(const std::vector<MotorState> &samples, size_t window, unsigned threads,
+                                 float torque_constant) {
+  if (window == 0 || samples.size() < window + 4) {
+    throw std::runtime_error("Not enough samples to fit the model.");
+  }
+  size_t rows = samples.size() - window;
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = (unsigned) std::min<size_t>(threads, (rows + 1023) / 1024); // a thread per thousand rows at least
+  threads = std::max(1u, threads);
+
+  std::vector<NormalEquations> partial(threads);
+  std::vector<std::thread> workers;
+  for (unsigned i = 1; i < threads; i++) {
+    workers.emplace_back(accumulate, std::cref(samples), window, rows * i / threads, rows * (i + 1) / threads,
+                         std::ref(partial[i]));
+  }
+  accumulate(samples, window, 0, rows / threads, partial[0]);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  NormalEquations total;
+  for (const NormalEquations &equations : partial) {
+    total.add(equations);
+  }
+
+  double xtx[3][3];
+  double xty[3];
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 3; j++) {
+      xtx[i][j] = total.xtx[i][j];
+    }
+    xty[i] = total.xty[i];
+  }
+  double theta[3];
+  if (!solve(xtx, xty, theta)) {
+    throw std::runtime_error("The excitation does not excite the model enough to fit it.");
+  }
+
+  // residual sum of squares from the normal equations, y'y - 2*theta'X'y + theta'X'X*theta
+  double sse = total.yty;
+  for (int i = 0; i < 3; i++) {
+    sse -= 2.0 * theta[i] * total.xty[i];
+    for (int j = 0; j < 3; j++) {
+      sse += theta[i] * total.xtx[i][j] * theta[j];
+    }
+  }
+  double sst = total.yty - total.y_sum * total.y_sum / total.rows;
+
+  IdentifiedModel model;
+  model.motor_id = 0;
+  model.samples = samples.size();
+  model.current_per_acceleration = theta[0];
+  model.current_per_velocity = theta[1];
+  model.friction_current = theta[2];
+  model.inertia = theta[0] * torque_constant;
+  model.damping = theta[1] * torque_constant;
+  model.friction = theta[2] * torque_constant;
+  model.bandwidth_hz = theta[0] > 0.0 && theta[1] > 0.0 ? theta[1] / (2.0 * M_PI * theta[0]) : 0.0;
+  model.r_squared = sst > 0.0 ? 1.0 - std::max(sse, 0.0) / sst : 0.0;
+  return model;
+}
+
+SystemIdentifier::SystemIdentifier(std::shared_ptr<AKBus> bus, std::chrono::nanoseconds period) :
+  _bus(bus),
+  _clock(bus->getClock()),
+  _period(period),
+  _stop(),
+  _done(false)
+{
+  return;
+}
+
+SystemIdentifier::~SystemIdentifier() {
+  stop();
+}
+
+void SystemIdentifier::addMotor(uint8_t motor_id, const ExcitationConfig &config, float torque_constant) {
+  if (config.mode != MotorModeID::CURRENTLOOP && config.mode != MotorModeID::VELOCITY) {
+    throw std::runtime_error("Only current and velocity excitations are supported.");
+  }
+  _channels.emplace_back(new Channel(motor_id, config, torque_constant));
+}
+
+void SystemIdentifier::__record(Channel &channel) {
+  MotorState batch[64];
+  size_t count;
+  while ((count = channel.buffer->pull(channel.cursor, batch, 64)) > 0) {
+    channel.samples.insert(channel.samples.end(), batch, batch + count);
+  }
+}
+
+void SystemIdentifier::__command(Channel &channel, float value) {
+  if (channel.config.mode == MotorModeID::VELOCITY) {
+    channel.manager.sendVelocity(value);
+  } else {
+    channel.manager.sendCurrent(value);
+  }
+}
+
+void SystemIdentifier::__run() {
+  TMOTOR_TRACE_THREAD("tmotor identifier");
+  std::chrono::nanoseconds longest(0);
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    longest = std::max(longest, channel->config.duration);
+  }
+  Clock::time_point start = _clock->now();
+  Clock::time_point deadline = start;
+  bool refused = false;
+  while (!_stop.stopRequested()) {
+    double t = std::chrono::duration<double>(deadline - start).count();
+    for (std::unique_ptr<Channel> &channel : _channels) {
+      __record(*channel);
+      try {
+        __command(*channel, channel->signal.at(t));
+      } catch (CANSocketException &e) {
+        // a refused command, e.g. a tripped reflex, ends the excitation of every motor
+        refused = true;
+      }
+    }
+    if (refused || deadline - start >= longest) {
+      break;
+    }
+    deadline += _period;
+    _clock->sleepUntil(deadline, &_stop);
+  }
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    try {
+      __command(*channel, 0.0f);
+    } catch (CANSocketException &e) {
+    }
+  }
+  _done = true;
+  _clock->leave();
+}
+
+void SystemIdentifier::start() {
+  stop();
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    channel->manager.connect(_bus);
+    channel->buffer = std::make_shared<SampleBuffer>(4096);
+    channel->cursor = channel->buffer->head();
+    channel->samples.clear();
+    double seconds = std::chrono::duration<double>(channel->config.duration).count();
+    double period = std::chrono::duration<double>(_period).count();
+    channel->samples.reserve((size_t) (seconds / period) + 1024);
+    _bus->setSampleBuffer(channel->manager.getMotorID(), channel->buffer);
+  }
+  _done = false;
+  _stop.reset();
+  _loop = std::thread([this] { __run(); });
+}
+
+bool SystemIdentifier::isDone() {
+  return _done;
+}
+
+void SystemIdentifier::stop() {
+  if (_loop.joinable()) {
+    _clock->requestStop(_stop);
+    _loop.join();
+  }
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    if (channel->buffer) {
+      _bus->setSampleBuffer(channel->manager.getMotorID(), nullptr);
+      __record(*channel);
+      channel->buffer = nullptr;
+    }
+  }
+}
+
+const std::vector<MotorState> &SystemIdentifier::getSamples(uint8_t motor_id) {
+  for (std::unique_ptr<Channel> &channel : _channels) {
+    if (channel->manager.getMotorID() == motor_id) {
+      return channel->samples;
+    }
+  }
+  throw std::runtime_error("The motor is not identified.");
+}
+
+std::vector<IdentifiedModel> SystemIdentifier::fit(size_t window) {
+  size_t count = _channels.size();
+  std::vector<IdentifiedModel> models(count);
+  std::vector<std::exception_ptr> errors(count);
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency() / (unsigned) std::max<size_t>(count, 1));
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < count; i++) {
+    workers.emplace_back([&, i] {
+      try {
+        models[i] = fitModel(_channels[i]->samples, window, threads, _channels[i]->torque_constant);
+        models[i].motor_id = _channels[i]->manager.getMotorID();
+      } catch (...) {
+        errors[i] = std::current_exception();
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  for (std::exception_ptr &error : errors) {
+    if (error) std::rethrow_exception(error);
+  }
+  return models;
+}
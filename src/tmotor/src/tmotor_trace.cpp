@@ -0,0 +1,195 @@
+/**
+ * @file tmotor_trace.cpp
+ * @brief
+ * @version 0.1
+ * @date 2026-10-18
+ *
+ * @copyright Copyright (c) 2024
+ *
+ */
+
+#include "../include/tmotor_trace.hpp"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <stdexcept>
+
+using namespace TMotor;
+
+TraceBuffer::TraceBuffer(size_t capacity, int tid) :
+  _head(0),
+  _tail(0),
+  tid(tid),
+  exited(false)
+{
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  _events.reset(new TraceEvent[size]);
+  _mask = size - 1;
+}
+
+void TraceBuffer::push(const char *name, uint64_t start_ns, uint64_t duration_ns) {
+  uint64_t head = _head.load(std::memory_order_relaxed);
+  TraceEvent &event = _events[head & _mask];
+  event.name = name;
+  event.start_ns = start_ns;
+  event.duration_ns = duration_ns;
+  _head.store(head + 1, std::memory_order_release);
+}
+
+size_t TraceBuffer::copy(TraceEvent *out, size_t max) const {
+  uint64_t head = _head.load(std::memory_order_acquire);
+  uint64_t count = head - _tail.load(std::memory_order_relaxed);
+  if (count > capacity()) count = capacity();
+  if (count > max) count = max;
+  for (uint64_t i = head - count; i < head; i++) {
+    *out++ = _events[i & _mask];
+  }
+  return count;
+}
+
+void TraceBuffer::discard() {
+  _tail.store(_head.load(std::memory_order_acquire), std::memory_order_relaxed);
+}
+
+size_t TraceBuffer::capacity() const {
+  return _mask + 1;
+}
+
+namespace {
+
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  size_t capacity = 65536;
+};
+
+Registry &registry() {
+  static Registry instance;
+  return instance;
+}
+
+/* The buffer of the calling thread, flagged when the thread exits so clear() can drop it. */
+struct ThreadTrace {
+  std::shared_ptr<TraceBuffer> buffer;
+
+  ~ThreadTrace() {
+    if (buffer) buffer->exited = true;
+  }
+};
+
+thread_local ThreadTrace thread_trace;
+
+TraceBuffer &thread_buffer() {
+  if (!thread_trace.buffer) {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    thread_trace.buffer = std::make_shared<TraceBuffer>(r.capacity, (int) syscall(SYS_gettid));
+    r.buffers.push_back(thread_trace.buffer);
+  }
+  return *thread_trace.buffer;
+}
+
+/* Writes a string literal as a JSON string, the trace names never need more than quote escaping. */
+void write_string(FILE *file, const char *text) {
+  fputc('"', file);
+  for (; *text != '\0'; text++) {
+    if (*text == '"' || *text == '\\') fputc('\\', file);
+    if ((unsigned char) *text >= 0x20) fputc(*text, file);
+  }
+  fputc('"', file);
+}
+
+} // namespace
+
+void Tracer::setCapacity(size_t events) {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  r.capacity = events > 0 ? events : 1;
+}
+
+void Tracer::nameThread(const char *name) {
+  TraceBuffer &buffer = thread_buffer();
+  std::lock_guard<std::mutex> lock(registry().mutex);
+  buffer.name = name;
+}
+
+uint64_t Tracer::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::record(const char *name, uint64_t start_ns, uint64_t duration_ns) {
+  thread_buffer().push(name, start_ns, duration_ns);
+}
+
+size_t Tracer::write(const char *path) {
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    buffers = r.buffers;
+  }
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    throw std::runtime_error("Unable to create the trace file.");
+  }
+  int pid = getpid();
+  size_t written = 0;
+  std::vector<TraceEvent> events;
+  fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  for (std::shared_ptr<TraceBuffer> &buffer : buffers) {
+    {
+      std::lock_guard<std::mutex> lock(registry().mutex);
+      if (!buffer->name.empty()) {
+        fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":",
+                first ? "" : ",\n", pid, buffer->tid);
+        write_string(file, buffer->name.c_str());
+        fprintf(file, "}}");
+        first = false;
+      }
+    }
+    events.resize(buffer->capacity());
+    size_t count = buffer->copy(events.data(), events.size());
+    for (size_t i = 0; i < count; i++) {
+      const TraceEvent &event = events[i];
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      write_string(file, event.name);
+      if (event.duration_ns > 0) {
+        fprintf(file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", pid, buffer->tid,
+                event.start_ns * 1e-3, event.duration_ns * 1e-3);
+      } else {
+        fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f}", pid, buffer->tid,
+                event.start_ns * 1e-3);
+      }
+      first = false;
+    }
+    written += count;
+  }
+  fprintf(file, "\n]}\n");
+  if (fclose(file) != 0) {
+    throw std::runtime_error("Unable to write the trace file.");
+  }
+  return written;
+}
+
+void Tracer::clear() {
+  Registry &r = registry();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::vector<std::shared_ptr<TraceBuffer>> live;
+  for (std::shared_ptr<TraceBuffer> &buffer : r.buffers) {
+    if (!buffer->exited) {
+      // replacing the buffer would race with its thread, so live buffers are only emptied logically
+      buffer->discard();
+      live.push_back(buffer);
+    }
+  }
+  r.buffers.swap(live);
+}
@@ -0,0 +1,129 @@
+#ifndef STREAM_HPP
+#define STREAM_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include <tmotor.hpp>
+#include <tmotor_planner.hpp>
+
+// Command a setpoint stream drives every motor with.
+enum class StreamMode {
+  DUTY,
+  CURRENT,
+  BRAKE,
+  VELOCITY,
+  POSITION,
+  PVA
+};
+
+bool parse_stream_mode(const std::string &name, StreamMode &mode) {
+  if (name == "duty")     { mode = StreamMode::DUTY;     return true; }
+  if (name == "current")  { mode = StreamMode::CURRENT;  return true; }
+  if (name == "brake")    { mode = StreamMode::BRAKE;    return true; }
+  if (name == "velocity") { mode = StreamMode::VELOCITY; return true; }
+  if (name == "position") { mode = StreamMode::POSITION; return true; }
+  if (name == "pva")      { mode = StreamMode::PVA;      return true; }
+  return false;
+}
+
+// Number of values a single motor takes per tick.
+size_t stream_mode_fields(StreamMode mode) {
+  return mode == StreamMode::PVA ? 3 : 1;
+}
+
+TMotor::CommandType stream_mode_command(StreamMode mode) {
+  switch (mode) {
+    case StreamMode::DUTY:     return TMotor::CommandType::DUTY;
+    case StreamMode::CURRENT:  return TMotor::CommandType::CURRENT;
+    case StreamMode::BRAKE:    return TMotor::CommandType::BRAKE;
+    case StreamMode::VELOCITY: return TMotor::CommandType::VELOCITY;
+    case StreamMode::POSITION: return TMotor::CommandType::POSITION;
+    default:                   return TMotor::CommandType::PVA;
+  }
+}
+
+void send_setpoint(TMotor::AKManager &motor, StreamMode mode, const float *values) {
+  switch (mode) {
+    case StreamMode::DUTY:
+      motor.sendDutyCycle(values[0]);
+      break;
+    case StreamMode::CURRENT:
+      motor.sendCurrent(values[0]);
+      break;
+    case StreamMode::BRAKE:
+      motor.sendCurrentBrake(values[0]);
+      break;
+    case StreamMode::VELOCITY:
+      motor.sendVelocity(values[0]);
+      break;
+    case StreamMode::POSITION:
+      motor.sendPosition(values[0]);
+      break;
+    case StreamMode::PVA:
+      motor.sendPositionVelocityAcceleration(values[0], (int16_t) values[1], (int16_t) values[2]);
+      break;
+  }
+}
+
+/**
+ * Reads one tick worth of setpoints at a time, i.e. the values of every motor in order.
+ * CSV records are a line of comma or whitespace separated numbers, empty lines and lines
+ * starting with '#' are skipped. Binary records are packed native endian 32-bit floats.
+ */
+class SetpointStream {
+  FILE *m_file;
+  bool m_binary;
+  size_t m_width;
+  char *m_line;
+  size_t m_line_size;
+
+public:
+  SetpointStream(FILE *file, bool binary, size_t width) :
+    m_file(file),
+    m_binary(binary),
+    m_width(width),
+    m_line(nullptr),
+    m_line_size(0)
+  {}
+
+  ~SetpointStream() {
+    free(m_line);
+  }
+
+  size_t width() {
+    return m_width;
+  }
+
+  // Returns false at the end of the stream, throws std::runtime_error on a malformed record.
+  bool next(float *values) {
+    if (m_binary) {
+      size_t count = fread(values, sizeof(float), m_width, m_file);
+      if (count == 0) return false;
+      if (count != m_width) throw std::runtime_error("Truncated binary setpoint record.");
+      return true;
+    }
+    ssize_t len;
+    while ((len = getline(&m_line, &m_line_size, m_file)) >= 0) {
+      char *cursor = m_line;
+      while (*cursor == ' ' || *cursor == '\t') cursor++;
+      if (*cursor == '\n' || *cursor == '\0' || *cursor == '#') continue;
+      for (size_t i = 0; i < m_width; i++) {
+        char *end;
+        values[i] = strtof(cursor, &end);
+        if (end == cursor) throw std::runtime_error("Malformed CSV setpoint record.");
+        cursor = end;
+        while (*cursor == ',' || *cursor == ' ' || *cursor == '\t') cursor++;
+      }
+      return true;
+    }
+    return false;
+  }
+};
+
+#endif // STREAM_HPP
@@ -0,0 +1,336 @@
+#include <getopt.h>
+#include <signal.h>
+#include <net/if.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include <Stream.hpp>
+#include <tmotor.hpp>
+#include <tmotor_cli.hpp>
+#include <tmotor_metrics.hpp>
+#include <tmotor_trace.hpp>
+
+static std::atomic<bool> interrupted(false);
+static std::atomic<TMotor::AKBus*> signal_bus(nullptr);
+
+// Stops every motor from the handler itself, the playback loop may be blocked in a write or a sleep.
+void on_signal(int) {
+  interrupted = true;
+  TMotor::AKBus *bus = signal_bus.load();
+  if (bus != nullptr) bus->emergencyStop();
+}
+
+void usage() {
+  std::cerr << "Usage: tmotorctl [options] <can_interface> <motor_ids>\n"
+               "Plays a setpoint stream to the listed motors and echoes their feedback.\n\n"
+               "  <motor_ids>          comma separated hexadecimal IDs or ranges, e.g. 1,2,a-f\n"
+               "  -m, --mode <mode>    duty, current, brake, velocity, position or pva (default current)\n"
+               "  -i, --input <file>   setpoint stream, '-' for stdin (default)\n"
+               "  -b, --binary         read packed 32-bit floats instead of CSV\n"
+               "  -r, --rate <hz>      records played per second (default 100)\n"
+               "  -e, --echo           print every feedback frame to stdout as CSV\n"
+               "  -z, --zero           send zero current to every motor once the stream ends\n"
+               "  -k, --keep           keep echoing feedback after the stream ends until interrupted\n"
+               "  -B, --bitrate <bps>  CAN bitrate the load is planned against (default 1000000)\n"
+               "  -f, --feedback <hz>  feedback rate the motors are configured to broadcast (default 0)\n"
+               "  -H, --headroom <x>   largest bus utilization allowed, 0-1 (default 0.7)\n"
+               "  -M, --metrics <addr> serve Prometheus metrics on a localhost TCP port or a Unix socket path\n"
+               "  -T, --trace <file>   save a Chrome trace of the run, needs a library built with TMOTOR_TRACING\n"
+               "  -x, --reflex <A>     stop every motor from the reader once a motor reports a fault or its\n"
+               "                       current stays above A for 3 frames\n\n"
+               "Each record holds the setpoints of every motor in order, pva takes 3 values per motor.\n"
+               "Streams whose worst-case bus load exceeds the headroom are refused before anything is sent.\n"
+               "SIGINT and SIGTERM emergency stop every motor with zero current from the signal handler.\n";
+}
+
+int main(int argc, char **argv) {
+  StreamMode mode = StreamMode::CURRENT;
+  std::string input("-");
+  bool binary = false;
+  double rate = 100.0;
+  bool echo = false;
+  bool zero = false;
+  bool keep = false;
+  uint32_t bitrate = 1000000;
+  double feedback = 0.0;
+  double headroom = 0.7;
+  std::string metrics;
+  std::string trace;
+  float reflex = 0.0f;
+
+  static struct option options[] = {
+    {"mode",   required_argument, nullptr, 'm'},
+    {"input",  required_argument, nullptr, 'i'},
+    {"binary", no_argument,       nullptr, 'b'},
+    {"rate",   required_argument, nullptr, 'r'},
+    {"echo",   no_argument,       nullptr, 'e'},
+    {"zero",   no_argument,       nullptr, 'z'},
+    {"keep",   no_argument,       nullptr, 'k'},
+    {"bitrate",  required_argument, nullptr, 'B'},
+    {"feedback", required_argument, nullptr, 'f'},
+    {"headroom", required_argument, nullptr, 'H'},
+    {"metrics",  required_argument, nullptr, 'M'},
+    {"trace",    required_argument, nullptr, 'T'},
+    {"reflex",   required_argument, nullptr, 'x'},
+    {"help",   no_argument,       nullptr, 'h'},
+    {nullptr,  0,                 nullptr, 0  }
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "m:i:br:ezkB:f:H:M:T:x:h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 'm':
+        if (!parse_stream_mode(optarg, mode)) {
+          std::cerr << "Invalid mode: " << optarg << "\n";
+          return 1;
+        }
+        break;
+      case 'i':
+        input = optarg;
+        break;
+      case 'b':
+        binary = true;
+        break;
+      case 'r':
+        rate = atof(optarg);
+        if (rate <= 0.0) {
+          std::cerr << "Invalid rate, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'e':
+        echo = true;
+        break;
+      case 'z':
+        zero = true;
+        break;
+      case 'k':
+        keep = true;
+        break;
+      case 'B':
+        bitrate = strtoul(optarg, nullptr, 10);
+        if (bitrate == 0) {
+          std::cerr << "Invalid bitrate, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'f':
+        feedback = atof(optarg);
+        if (feedback < 0.0) {
+          std::cerr << "Invalid feedback rate, must not be negative.\n";
+          return 1;
+        }
+        break;
+      case 'H':
+        headroom = atof(optarg);
+        if (headroom <= 0.0 || headroom > 1.0) {
+          std::cerr << "Invalid headroom, must be in (0, 1].\n";
+          return 1;
+        }
+        break;
+      case 'M':
+        metrics = optarg;
+        break;
+      case 'T':
+        trace = optarg;
+        break;
+      case 'x':
+        reflex = atof(optarg);
+        if (reflex <= 0.0f) {
+          std::cerr << "Invalid reflex current, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'h':
+        usage();
+        return 0;
+      default:
+        usage();
+        return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    return 1;
+  }
+
+  std::string can_interface(argv[optind]);
+  if (if_nametoindex(can_interface.c_str()) == 0) {
+    std::cerr << "Invalid can interface value, must be a valid can interface.\n";
+    return 1;
+  }
+  std::vector<uint8_t> motor_ids;
+  if (!TMotor::parse_motor_ids(argv[optind+1], motor_ids)) {
+    std::cerr << "Invalid motor IDs, must be a list of hexadecimal IDs or ranges such as 1,2,a-f.\n";
+    return 1;
+  }
+
+  TMotor::BusPlanner planner(bitrate, headroom);
+  for (uint8_t motor_id : motor_ids) {
+    TMotor::MotorLoad load(motor_id, stream_mode_command(mode), rate, feedback);
+    if (!planner.admit(load)) {
+      TMotor::BusPlan plan = planner.evaluate(std::vector<TMotor::MotorLoad>(motor_ids.size(), load));
+      std::cerr << "The bus cannot carry " << motor_ids.size() << " motors at " << rate << " Hz, worst-case load "
+                << plan.utilization * 100.0f << "% exceeds the " << headroom * 100.0 << "% headroom.\n";
+      return 1;
+    }
+  }
+  TMotor::BusPlan plan = planner.plan();
+  std::cerr << "Worst-case bus load " << plan.utilization * 100.0f << "%, command latency up to "
+            << plan.max_latency_us << " us.\n";
+
+  FILE *file = input == "-" ? stdin : fopen(input.c_str(), binary ? "rb" : "r");
+  if (file == nullptr) {
+    std::cerr << "Unable to open " << input << "\n";
+    return 1;
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  std::shared_ptr<TMotor::AKBus> bus = std::make_shared<TMotor::AKBus>();
+  std::vector<TMotor::AKManager> motors;
+  std::vector<std::shared_ptr<TMotor::SampleBuffer>> samples;
+  motors.reserve(motor_ids.size());
+  for (uint8_t motor_id : motor_ids) {
+    motors.emplace_back(motor_id);
+    samples.push_back(std::make_shared<TMotor::SampleBuffer>(1024));
+    if (echo) bus->setSampleBuffer(motor_id, samples.back());
+  }
+  try {
+    bus->connect(can_interface.c_str(), motor_ids);
+  } catch (TMotor::CANSocketException &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  for (TMotor::AKManager &motor : motors) {
+    motor.connect(bus);
+  }
+  signal_bus = bus.get();
+  if (reflex > 0.0f) {
+    TMotor::ReflexConfig config;
+    config.current_limit = reflex;
+    config.current_samples = 3;
+    config.on_fault = true;
+    config.stop_bus = true;
+    for (uint8_t motor_id : motor_ids) {
+      bus->setReflex(motor_id, config);
+    }
+  }
+
+  TMotor::MetricsExporter exporter(bus);
+  if (!metrics.empty()) {
+    try {
+      if (metrics.find_first_not_of("0123456789") == std::string::npos) {
+        int port = std::stoi(metrics);
+        if (port > 0xFFFF) throw std::out_of_range("Invalid metrics port.");
+        exporter.listenTCP(port);
+      } else {
+        exporter.listenUnix(metrics.c_str());
+      }
+    } catch (std::exception &e) {
+      std::cerr << e.what() << "\n";
+      return 1;
+    }
+  }
+
+  // Feedback echo, every decoded frame is printed once in arrival order per motor.
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::atomic<bool> shutdown(false);
+  std::thread printer;
+  if (echo) {
+    printer = std::thread([&] {
+      std::vector<uint64_t> cursors(samples.size(), 0);
+      TMotor::MotorState batch[64];
+      uint32_t sequence = 0;
+      printf("time,id,position,velocity,current,temperature,fault\n");
+      while (!shutdown) {
+        sequence = bus->waitForUpdate(sequence, std::chrono::milliseconds(100));
+        for (size_t i = 0; i < samples.size(); i++) {
+          size_t count;
+          while ((count = samples[i]->pull(cursors[i], batch, 64)) > 0) {
+            for (size_t j = 0; j < count; j++) {
+              double t = std::chrono::duration<double>(batch[j].timestamp - start).count();
+              printf("%.6f,0x%02X,%.1f,%.0f,%.2f,%d,%d\n", t, motor_ids[i], batch[j].position, batch[j].velocity,
+                     batch[j].current, batch[j].temperature, batch[j].motor_fault);
+            }
+          }
+        }
+        fflush(stdout);
+      }
+    });
+  }
+
+  // Playback, every record is due at an absolute deadline so jitter does not accumulate.
+  SetpointStream stream(file, binary, motor_ids.size() * stream_mode_fields(mode));
+  std::vector<float> values(stream.width());
+  std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<double>(1.0 / rate));
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + period;
+  size_t records = 0;
+  size_t overruns = 0;
+  int status = 0;
+  try {
+    while (!interrupted && stream.next(values.data())) {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (now > deadline) {
+        overruns++;
+        if (now > deadline + period) deadline = now; // do not burst to catch up with a slow input
+      } else {
+        std::this_thread::sleep_until(deadline);
+      }
+      TMOTOR_TRACE_SCOPE("tmotorctl.record");
+      for (size_t i = 0; i < motors.size(); i++) {
+        send_setpoint(motors[i], mode, &values[i * stream_mode_fields(mode)]);
+      }
+      records++;
+      deadline += period;
+    }
+  } catch (std::exception &e) {
+    if (!bus->isStopped()) {
+      std::cerr << e.what() << "\n";
+      status = 1;
+    }
+  }
+
+  for (uint8_t motor_id : motor_ids) {
+    if (bus->isTripped(motor_id)) {
+      fprintf(stderr, "A reflex stopped every motor after the feedback of motor 0x%02X.\n", motor_id);
+      status = 1;
+    }
+  }
+
+  if (zero && !bus->isStopped()) {
+    for (TMotor::AKManager &motor : motors) {
+      try {
+        motor.sendCurrent(0.0f);
+      } catch (TMotor::CANSocketException &e) {
+        std::cerr << e.what() << "\n";
+        status = 1;
+      }
+    }
+  }
+
+  while (keep && echo && !interrupted) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+
+  shutdown = true;
+  if (printer.joinable()) printer.join();
+  signal_bus = nullptr;
+  if (file != stdin) fclose(file);
+  std::cerr << "Played " << records << " records, " << overruns << " missed deadlines.\n";
+  if (!trace.empty()) {
+    try {
+      size_t events = TMotor::Tracer::write(trace.c_str());
+      std::cerr << "Saved " << events << " trace events to " << trace << "\n";
+    } catch (std::runtime_error &e) {
+      std::cerr << e.what() << "\n";
+      status = 1;
+    }
+  }
+  return status;
+}
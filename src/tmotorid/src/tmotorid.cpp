@@ -0,0 +1,228 @@
+#include <getopt.h>
+#include <signal.h>
+#include <net/if.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include <tmotor.hpp>
+#include <tmotor_cli.hpp>
+#include <tmotor_sim.hpp>
+#include <tmotor_sysid.hpp>
+
+static std::atomic<TMotor::AKBus*> signal_bus(nullptr);
+
+// Stops every motor from the handler itself, the excitation loop keeps running until its end.
+void on_signal(int) {
+  TMotor::AKBus *bus = signal_bus.load();
+  if (bus != nullptr) bus->emergencyStop();
+}
+
+void usage() {
+  std::cerr << "Usage: tmotorid [options] <can_interface|sim> <motor_ids>\n"
+               "Excites the listed motors, records their feedback and fits their rigid body model.\n\n"
+               "  <motor_ids>          comma separated hexadecimal IDs or ranges, e.g. 1,2,a-f\n"
+               "  sim                  identify simulated motors with the default model instead\n"
+               "  -s, --signal <type>  chirp or prbs (default chirp)\n"
+               "  -m, --mode <mode>    current or velocity (default current)\n"
+               "  -a, --amplitude <x>  A or rpm (default 1)\n"
+               "  -o, --offset <x>     A or rpm added to the signal (default 0)\n"
+               "  -d, --duration <s>   length of the excitation (default 5)\n"
+               "  -r, --rate <hz>      commands sent per second to each motor (default 1000)\n"
+               "  -F, --from <hz>      chirp start frequency (default 0.5)\n"
+               "  -E, --to <hz>        chirp end frequency (default 20)\n"
+               "  -b, --bit <s>        PRBS bit time (default 0.01)\n"
+               "  -k, --kt <Nm/A>      torque constant the fit is scaled with (default 0, current units)\n"
+               "  -w, --window <n>     feedback frames per integration window (default 10)\n\n"
+               "The motors must broadcast their feedback at the command rate or faster, every motor is\n"
+               "excited at once and fitted in parallel. The fit uses the measured current, so the velocity\n"
+               "mode identifies the same model while the motor's own loop keeps it in range.\n"
+               "SIGINT and SIGTERM emergency stop every motor with zero current from the signal handler.\n";
+}
+
+void print_model(const TMotor::IdentifiedModel &model, bool physical) {
+  printf("motor %02x: %zu samples, r2 %.5f, bandwidth %.3f Hz\n", model.motor_id, model.samples,
+         model.r_squared, model.bandwidth_hz);
+  printf("  current      %.6g A*s^2/rad * acc + %.6g A*s/rad * vel + %.6g A * sign(vel)\n",
+         model.current_per_acceleration, model.current_per_velocity, model.friction_current);
+  if (physical) {
+    printf("  inertia      %.6g kg*m^2\n", model.inertia);
+    printf("  damping      %.6g Nm*s/rad\n", model.damping);
+    printf("  friction     %.6g Nm\n", model.friction);
+  }
+}
+
+int main(int argc, char **argv) {
+  TMotor::ExcitationConfig config;
+  config.mode = TMotor::MotorModeID::CURRENTLOOP;
+  double rate = 1000.0;
+  float torque_constant = 0.0f;
+  size_t window = 10;
+
+  static struct option options[] = {
+    {"signal",    required_argument, nullptr, 's'},
+    {"mode",      required_argument, nullptr, 'm'},
+    {"amplitude", required_argument, nullptr, 'a'},
+    {"offset",    required_argument, nullptr, 'o'},
+    {"duration",  required_argument, nullptr, 'd'},
+    {"rate",      required_argument, nullptr, 'r'},
+    {"from",      required_argument, nullptr, 'F'},
+    {"to",        required_argument, nullptr, 'E'},
+    {"bit",       required_argument, nullptr, 'b'},
+    {"kt",        required_argument, nullptr, 'k'},
+    {"window",    required_argument, nullptr, 'w'},
+    {"help",      no_argument,       nullptr, 'h'},
+    {nullptr,     0,                 nullptr, 0  }
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "s:m:a:o:d:r:F:E:b:k:w:h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 's':
+        if (std::string(optarg) == "chirp") {
+          config.type = TMotor::ExcitationType::CHIRP;
+        } else if (std::string(optarg) == "prbs") {
+          config.type = TMotor::ExcitationType::PRBS;
+        } else {
+          std::cerr << "Invalid signal, must be chirp or prbs.\n";
+          return 1;
+        }
+        break;
+      case 'm':
+        if (std::string(optarg) == "current") {
+          config.mode = TMotor::MotorModeID::CURRENTLOOP;
+        } else if (std::string(optarg) == "velocity") {
+          config.mode = TMotor::MotorModeID::VELOCITY;
+        } else {
+          std::cerr << "Invalid mode, must be current or velocity.\n";
+          return 1;
+        }
+        break;
+      case 'a':
+        config.amplitude = atof(optarg);
+        break;
+      case 'o':
+        config.offset = atof(optarg);
+        break;
+      case 'd':
+        if (atof(optarg) <= 0.0) {
+          std::cerr << "Invalid duration, must be a positive number of seconds.\n";
+          return 1;
+        }
+        config.duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::duration<double>(atof(optarg)));
+        break;
+      case 'r':
+        rate = atof(optarg);
+        if (rate <= 0.0) {
+          std::cerr << "Invalid rate, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'F':
+        config.start_frequency = atof(optarg);
+        break;
+      case 'E':
+        config.end_frequency = atof(optarg);
+        break;
+      case 'b':
+        config.bit_time = atof(optarg);
+        break;
+      case 'k':
+        torque_constant = atof(optarg);
+        break;
+      case 'w':
+        window = strtoul(optarg, nullptr, 10);
+        if (window == 0) {
+          std::cerr << "Invalid window, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'h':
+        usage();
+        return 0;
+      default:
+        usage();
+        return 1;
+    }
+  }
+  if (argc - optind != 2) {
+    usage();
+    return 1;
+  }
+
+  std::string can_interface(argv[optind]);
+  bool simulate = can_interface == "sim";
+  if (!simulate && if_nametoindex(can_interface.c_str()) == 0) {
+    std::cerr << "Invalid can interface value, must be a valid can interface or sim.\n";
+    return 1;
+  }
+  std::vector<uint8_t> motor_ids;
+  if (!TMotor::parse_motor_ids(argv[optind+1], motor_ids)) {
+    std::cerr << "Invalid motor IDs, must be a list of hexadecimal IDs or ranges such as 1,2,a-f.\n";
+    return 1;
+  }
+
+  std::chrono::nanoseconds period = std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::duration<double>(1.0 / rate));
+  std::shared_ptr<TMotor::AKBus> bus = std::make_shared<TMotor::AKBus>();
+  std::unique_ptr<TMotor::Simulation> simulation;
+  try {
+    if (simulate) {
+      simulation.reset(new TMotor::Simulation(bus));
+      for (uint8_t motor_id : motor_ids) {
+        simulation->addMotor(motor_id);
+      }
+    } else {
+      bus->connect(can_interface.c_str(), motor_ids);
+    }
+  } catch (TMotor::CANSocketException &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  TMotor::SystemIdentifier identifier(bus, period);
+  for (uint8_t motor_id : motor_ids) {
+    identifier.addMotor(motor_id, config, torque_constant);
+  }
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+  signal_bus = bus.get();
+
+  if (simulate) {
+    // the loop sleeps on the virtual clock, the simulation advances it as fast as the motors are stepped
+    simulation->step(period);
+    identifier.start();
+    simulation->getClock()->waitForSleepers(1, std::chrono::seconds(1));
+    while (!identifier.isDone()) {
+      simulation->step(period);
+    }
+  } else {
+    identifier.start();
+    while (!identifier.isDone()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  identifier.stop();
+  signal_bus = nullptr;
+  if (bus->isStopped()) {
+    std::cerr << "Interrupted, nothing was fitted.\n";
+    return 1;
+  }
+
+  try {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<TMotor::IdentifiedModel> models = identifier.fit(window);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (const TMotor::IdentifiedModel &model : models) {
+      print_model(model, torque_constant > 0.0f);
+    }
+    std::cerr << "Fitted " << models.size() << " motors in " << elapsed * 1e3 << " ms.\n";
+  } catch (std::runtime_error &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,46 @@
+#ifndef CANDUMP_HPP
+#define CANDUMP_HPP
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include <linux/can.h>
+
+// Parses a line of a candump log, as written by candump -l:
+//   (1700000000.123456) can0 00002901#0102030405060708
+// Extended IDs are written with 8 hexadecimal digits, standard IDs with 3. Remote
+// and CAN FD frames are skipped.
+bool parse_candump_line(const char *line, int64_t &time_us, struct can_frame &frame) {
+  const char *cursor = strchr(line, '(');
+  if (cursor == nullptr) return false;
+  char *end;
+  long long sec = strtoll(cursor + 1, &end, 10);
+  if (*end != '.') return false;
+  cursor = end + 1;
+  long long usec = strtoll(cursor, &end, 10);
+  if (*end != ')' || end - cursor != 6) return false;
+  time_us = sec * 1000000 + usec;
+
+  cursor = end + 1;
+  while (isspace(*cursor)) cursor++;
+  while (*cursor != '\0' && !isspace(*cursor)) cursor++; // interface
+  while (isspace(*cursor)) cursor++;
+  unsigned long can_id = strtoul(cursor, &end, 16);
+  if (*end != '#' || end[1] == '#' || end[1] == 'R') return false;
+  memset(&frame, 0, sizeof(frame));
+  frame.can_id = end - cursor == 8 ? (can_id & CAN_EFF_MASK) | CAN_EFF_FLAG : can_id & CAN_SFF_MASK;
+
+  cursor = end + 1;
+  while (isxdigit(cursor[0]) && isxdigit(cursor[1])) {
+    if (frame.can_dlc == CAN_MAX_DLEN) return false;
+    char byte[3] = {cursor[0], cursor[1], '\0'};
+    frame.data[frame.can_dlc++] = strtoul(byte, nullptr, 16);
+    cursor += 2;
+    if (*cursor == '.') cursor++;
+  }
+  return *cursor == '\0' || isspace(*cursor);
+}
+
+#endif // CANDUMP_HPP
@@ -0,0 +1,154 @@
+#include <getopt.h>
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+
+#include <Candump.hpp>
+#include <tmotor.hpp>
+#include <tmotor_cli.hpp>
+#include <tmotor_archive.hpp>
+
+void usage() {
+  std::cerr << "Usage: tmotorlog pack [options] <capture.log> <archive>\n"
+               "       tmotorlog stats [options] <archive> [motor_ids]\n"
+               "Packs the servo feedback of a candump log into a columnar archive and summarizes it.\n\n"
+               "pack:\n"
+               "  <capture.log>        candump -l log, '-' for stdin\n"
+               "  -s, --block <n>      samples per block (default 4096)\n\n"
+               "stats:\n"
+               "  [motor_ids]          comma separated hexadecimal IDs or ranges, e.g. 1,2,a-f (default all)\n"
+               "  -F, --from <s>       start of the range, Unix time in seconds\n"
+               "  -T, --to <s>         end of the range, Unix time in seconds\n"
+               "  -t, --hot <C>        temperature counted as hot (default 80)\n\n"
+               "Statistics of whole blocks inside the range are read from the index, only the blocks\n"
+               "crossing the range, or holding faults or hot samples, are decoded.\n";
+}
+
+int pack(const std::string &input, const std::string &output, size_t block_size) {
+  FILE *file = input == "-" ? stdin : fopen(input.c_str(), "r");
+  if (file == nullptr) {
+    std::cerr << "Unable to open " << input << "\n";
+    return 1;
+  }
+  size_t lines = 0;
+  size_t samples = 0;
+  int status = 0;
+  try {
+    TMotor::ArchiveWriter writer(output.c_str(), block_size);
+    char line[256];
+    int64_t time_us;
+    struct can_frame frame;
+    while (fgets(line, sizeof(line), file) != nullptr) {
+      lines++;
+      if (parse_candump_line(line, time_us, frame) && writer.append(time_us, frame)) {
+        samples++;
+      }
+    }
+    writer.close();
+  } catch (std::runtime_error &e) {
+    std::cerr << e.what() << "\n";
+    status = 1;
+  }
+  if (file != stdin) fclose(file);
+  std::cerr << "Packed " << samples << " feedback samples out of " << lines << " lines.\n";
+  return status;
+}
+
+void print_summary(const TMotor::MotorSummary &summary) {
+  printf("motor %02x: %llu samples, %.6f to %.6f s\n", summary.motor_id, (unsigned long long) summary.samples,
+         summary.first_us * 1e-6, summary.last_us * 1e-6);
+  if (summary.samples == 0) return;
+  printf("  position     min %10.1f  max %10.1f  mean %10.2f deg\n",
+         summary.position_min, summary.position_max, summary.position_mean);
+  printf("  velocity     min %10.0f  max %10.0f  mean %10.2f rpm\n",
+         summary.velocity_min, summary.velocity_max, summary.velocity_mean);
+  printf("  current      min %10.2f  max %10.2f  mean %10.3f  rms %.3f A\n",
+         summary.current_min, summary.current_max, summary.current_mean, summary.current_rms);
+  printf("  temperature  peak %d C at %.6f s, %.3f s hot\n",
+         summary.temperature_max, summary.temperature_max_us * 1e-6, summary.hot_seconds);
+  for (const TMotor::FaultInterval &fault : summary.faults) {
+    printf("  fault        %s from %.6f to %.6f s\n", TMotor::fault_to_cstr(fault.fault),
+           fault.start_us * 1e-6, fault.end_us * 1e-6);
+  }
+  printf("  blocks       %llu from the index, %llu decoded\n",
+         (unsigned long long) summary.blocks_scanned, (unsigned long long) summary.blocks_decoded);
+}
+
+int stats(const std::string &archive, const std::vector<uint8_t> &requested, int64_t from_us, int64_t to_us,
+          int hot_threshold) {
+  try {
+    TMotor::ArchiveReader reader(archive.c_str());
+    std::vector<uint8_t> motor_ids = requested.empty() ? reader.motors() : requested;
+    for (uint8_t motor_id : motor_ids) {
+      print_summary(reader.summarize(motor_id, from_us, to_us, hot_threshold));
+    }
+  } catch (std::runtime_error &e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  size_t block_size = 4096;
+  int64_t from_us = INT64_MIN;
+  int64_t to_us = INT64_MAX;
+  int hot_threshold = 80;
+
+  static struct option options[] = {
+    {"block", required_argument, nullptr, 's'},
+    {"from",  required_argument, nullptr, 'F'},
+    {"to",    required_argument, nullptr, 'T'},
+    {"hot",   required_argument, nullptr, 't'},
+    {"help",  no_argument,       nullptr, 'h'},
+    {nullptr, 0,                 nullptr, 0  }
+  };
+  int opt;
+  while ((opt = getopt_long(argc, argv, "s:F:T:t:h", options, nullptr)) != -1) {
+    switch (opt) {
+      case 's':
+        block_size = strtoul(optarg, nullptr, 10);
+        if (block_size == 0) {
+          std::cerr << "Invalid block size, must be a positive number.\n";
+          return 1;
+        }
+        break;
+      case 'F':
+        from_us = (int64_t) (atof(optarg) * 1e6);
+        break;
+      case 'T':
+        to_us = (int64_t) (atof(optarg) * 1e6);
+        break;
+      case 't':
+        hot_threshold = atoi(optarg);
+        break;
+      case 'h':
+        usage();
+        return 0;
+      default:
+        usage();
+        return 1;
+    }
+  }
+  if (argc - optind < 1) {
+    usage();
+    return 1;
+  }
+
+  std::string command(argv[optind]);
+  if (command == "pack" && argc - optind == 3) {
+    return pack(argv[optind+1], argv[optind+2], block_size);
+  }
+  if (command == "stats" && (argc - optind == 2 || argc - optind == 3)) {
+    std::vector<uint8_t> motor_ids;
+    if (argc - optind == 3 && !TMotor::parse_motor_ids(argv[optind+2], motor_ids)) {
+      std::cerr << "Invalid motor IDs, must be a list of hexadecimal IDs or ranges such as 1,2,a-f.\n";
+      return 1;
+    }
+    return stats(argv[optind+1], motor_ids, from_us, to_us, hot_threshold);
+  }
+  usage();
+  return 1;
+}
@@ -2,10 +2,17 @@
 #define COMPONENT_HPP
 
 #include <ncurses.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
 #include <map>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <memory>
+#include <mutex>
 
 // screen_init
 void paint_scr() {
@@ -18,6 +25,26 @@ void paint_scr() {
   refresh();
 }
 
+// ncurses is not thread safe, once a render thread runs every curses call is made with this mutex held.
+std::mutex &curses_mutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+// Reads a key, or ERR after timeout_ms, forever when negative. The terminal is awaited
+// without the curses mutex so the render thread keeps drawing, stdscr must be nodelay.
+int read_key(int timeout_ms) {
+  {
+    std::lock_guard<std::mutex> lock(curses_mutex());
+    int key = getch();                      // keys curses already buffered
+    if (key != ERR) return key;
+  }
+  struct pollfd terminal = {STDIN_FILENO, POLLIN, 0};
+  if (poll(&terminal, 1, timeout_ms) <= 0) return ERR;
+  std::lock_guard<std::mutex> lock(curses_mutex());
+  return getch();
+}
+
 // Colors init
 void init_colors() {
   start_color();
@@ -26,13 +53,50 @@ void init_colors() {
   init_pair(3, COLOR_WHITE, COLOR_GREEN);
 }
 
+// A fixed size text cell that remembers what it last put on screen, so that
+// it is only redrawn when its rendering actually changes. Its buffers are sized
+// once for its width, which may span the whole window.
+struct TextField {
+  int row;
+  int col;
+  int width;
+  std::string text;
+  std::vector<char> value;
+
+  TextField(int row, int col, int width):
+    row(row), col(col), width(width < 0 ? 0 : width), text(), value(this->width + 1, '\0')
+  {
+    text.reserve(this->width);
+  }
+
+  void reset() {
+    text.clear();
+  }
+
+  // Returns true if the window has been modified.
+  bool set(WINDOW *win, const char *fmt, ...) {
+    if (width == 0) return false;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(value.data(), value.size(), fmt, args);
+    va_end(args);
+    size_t length = strlen(value.data());
+    memset(value.data() + length, ' ', width - length); // pads over the previous value
+    if (text.compare(0, std::string::npos, value.data(), width) == 0) return false;
+    text.assign(value.data(), width);
+    mvwaddnstr(win, row, col, text.c_str(), width);
+    return true;
+  }
+};
+
 // Baseline component classes
 struct UpdatePacket {
   enum Type : uint16_t {
     NONE=0,
     BUTTON,
     INPUT,
-    AK
+    AK,
+    STATS
   };
 
   Type type;
@@ -1,7 +1,7 @@
 #ifndef DASHBOARD_HPP
 #define DASHBOARD_HPP
 
-#include <map>
+#include <vector>
 
 #include <tmotor.hpp>
 #include <Component.hpp>
@@ -25,49 +25,28 @@ struct AKPacket : public UpdatePacket {
   {}
 };
 
+const char *fault_to_str(TMotor::MotorFault fault) {
+  static constexpr const char *names[] = {
+    "NONE", "OVERTEMPERATURE", "OVERCURRENT", "OVERVOLTAGE", "UNDERVOLTAGE", "ENCODER", "HARDWARE"
+  };
+  return (unsigned) fault < sizeof(names) / sizeof(names[0]) ? names[fault] : "INVALID";
+}
+
 class Dashboard : public Component {
   bool m_shutdown;
   bool m_mounted;
   std::thread m_thread;
   int m_motor_id;
-
-  std::string _fault_to_str(TMotor::MotorFault fault) {
-    static std::map<TMotor::MotorFault, std::string> dict({
-      {TMotor::MotorFault::NONE,            "NONE"           },
-      {TMotor::MotorFault::OVERTEMPERATURE, "OVERTEMPERATURE"},
-      {TMotor::MotorFault::OVERCURRENT,     "OVERCURRENT"    },
-      {TMotor::MotorFault::OVERVOLTAGE,     "OVERVOLTAGE"    },
-      {TMotor::MotorFault::UNDERVOLTAGE,    "UNDERVOLTAGE"   },
-      {TMotor::MotorFault::ENCODER,         "ENCODER"        },
-      {TMotor::MotorFault::HARDWARE,        "HARDWARE"       }
-    });
-    return dict[fault];
-  }
-
-  std::string _get_empty(size_t len) {
-    std::string empty("");
-    for (size_t i = 0; i < len; i++) {
-      empty += " ";
-    }
-    return empty;
-  }
-
-  void _clear() {
-    mvwprintw(m_win, 2, 2+11, "%s", _get_empty(w-3-11).c_str());
-    mvwprintw(m_win, 3, 2+11, "%s", _get_empty(w-3-11).c_str());
-    mvwprintw(m_win, 4, 2+10, "%s", _get_empty(w-3-10).c_str());
-    mvwprintw(m_win, 5, 2+13, "%s", _get_empty(w-3-13).c_str());
-    mvwprintw(m_win, 6, 2+14, "%s", _get_empty(w-3-14).c_str());
-    mvwprintw(m_win, 7, 2+14, "%s", _get_empty(w-3-14).c_str());
-  }
+  std::vector<TextField> m_fields;
+  bool m_dirty;
 
   void _draw() {
-    mvwprintw(m_win, 2, 2+11, "%.2f", position/gear_ratio);
-    mvwprintw(m_win, 3, 2+11, "%.2f", velocity/gear_ratio);
-    mvwprintw(m_win, 4, 2+10, "%.2f", current);
-    mvwprintw(m_win, 5, 2+13, "%.2f", gear_ratio);
-    mvwprintw(m_win, 6, 2+14, "%.2i", temperature);
-    mvwprintw(m_win, 7, 2+14, "%s", _fault_to_str(motor_fault).c_str());
+    m_dirty |= m_fields[0].set(m_win, "%.2f", position/gear_ratio);
+    m_dirty |= m_fields[1].set(m_win, "%.2f", velocity/gear_ratio);
+    m_dirty |= m_fields[2].set(m_win, "%.2f", current);
+    m_dirty |= m_fields[3].set(m_win, "%.2f", gear_ratio);
+    m_dirty |= m_fields[4].set(m_win, "%.2i", temperature);
+    m_dirty |= m_fields[5].set(m_win, "%s", fault_to_str(motor_fault));
   }
 
 public:
@@ -81,7 +60,9 @@ public:
   Dashboard (int x, int y, int w, int h, int id) :
     Component(x, y, w, h),
     m_shutdown(false),
-    m_motor_id(id)
+    m_motor_id(id),
+    m_fields{{2, 2+11, w-3-11}, {3, 2+11, w-3-11}, {4, 2+10, w-3-10}, {5, 2+13, w-3-13}, {6, 2+14, w-3-14}, {7, 2+14, w-3-14}},
+    m_dirty(false)
   {}
  
   void focus() override {}
@@ -98,13 +79,19 @@ public:
     mvwprintw(m_win, 5, 2, "Gear Ratio: ");
     mvwprintw(m_win, 6, 2, "Temperature: ");
     mvwprintw(m_win, 7, 2, "Motor Fault: ");
+    for (TextField &field : m_fields) {
+      field.reset();
+    }
     wrefresh(m_win);
   }
 
+  /**
+   * Only the changed fields are drawn and the window is staged with wnoutrefresh(),
+   * the render loop is expected to flush all staged windows with a single doupdate().
+   */
   void update(UpdatePacket *packet) override {
     if (packet->type != UpdatePacket::AK) return;
     AKPacket *update = static_cast<AKPacket *>(packet);
-    _clear();
     current = update->current;
     position = update->position;
     velocity = update->velocity;
@@ -112,7 +99,10 @@ public:
     temperature = update->temperature;
     motor_fault = update->motor_fault;
     _draw();
-    wrefresh(m_win);
+    if (m_dirty) {
+      wnoutrefresh(m_win);
+      m_dirty = false;
+    }
   }
 
   void unmount() override {
@@ -0,0 +1,135 @@
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include <vector>
+
+#include <tmotor.hpp>
+#include <Component.hpp>
+#include <Dashboard.hpp>
+
+// Compact, four line variant of the Dashboard used for monitoring many motors at once.
+class MotorPanel : public Component {
+  int m_motor_id;
+  std::vector<TextField> m_fields;
+  bool m_dirty;
+
+public:
+  enum Size : int {
+    WIDTH = 30,
+    HEIGHT = 4
+  };
+
+  MotorPanel(int x, int y, int w, int h, int id) :
+    Component(x, y, w, h),
+    m_motor_id(id),
+    m_fields{{1, 3, 9}, {1, 15, w-16}, {2, 3, 7}, {2, 13, 4}, {2, 18, w-19}},
+    m_dirty(false)
+  {}
+
+  void focus() override {}
+
+  void unfocus() override {}
+
+  void mount() override {
+    box(m_win, 0, 0);
+    mvwprintw(m_win, 0, 2, " AK 0x%02X ", m_motor_id);
+    mvwprintw(m_win, 1, 1, "P");
+    mvwprintw(m_win, 1, 13, "V");
+    mvwprintw(m_win, 2, 1, "I");
+    mvwprintw(m_win, 2, 11, "T");
+    for (TextField &field : m_fields) {
+      field.reset();
+      field.set(m_win, "-");
+    }
+    wnoutrefresh(m_win);
+  }
+
+  // Same contract as Dashboard::update(), the window is only staged for the next doupdate().
+  void update(UpdatePacket *packet) override {
+    if (packet->type != UpdatePacket::AK) return;
+    AKPacket *update = static_cast<AKPacket *>(packet);
+    m_dirty |= m_fields[0].set(m_win, "%.2f", update->position/update->gear_ratio);
+    m_dirty |= m_fields[1].set(m_win, "%.2f", update->velocity/update->gear_ratio);
+    m_dirty |= m_fields[2].set(m_win, "%.2fA", update->current);
+    m_dirty |= m_fields[3].set(m_win, "%iC", update->temperature);
+    m_dirty |= m_fields[4].set(m_win, "%s", fault_to_str(update->motor_fault));
+    if (m_dirty) {
+      wnoutrefresh(m_win);
+      m_dirty = false;
+    }
+  }
+
+  void unmount() override {
+    werase(m_win);
+    wnoutrefresh(m_win);
+  }
+};
+
+// Tiles one MotorPanel per motor ID, all of them fed from a single shared bus.
+class Grid : public Component {
+  typedef std::shared_ptr<MotorPanel> PanelPtr;
+  std::vector<uint8_t> m_motor_ids;
+  std::vector<PanelPtr> m_panels;
+  std::vector<uint32_t> m_sequences;
+  float m_gear_ratio;
+
+public:
+  Grid(int x, int y, int w, int h, const std::vector<uint8_t> &motor_ids, float gear_ratio) :
+    Component(x, y, w, h),
+    m_motor_ids(motor_ids),
+    m_sequences(motor_ids.size(), 0),
+    m_gear_ratio(gear_ratio)
+  {
+    int cols = w / MotorPanel::WIDTH;
+    if (cols < 1) cols = 1;
+    int panel_w = w / cols;
+    for (size_t i = 0; i < m_motor_ids.size(); i++) {
+      int row = i / cols;
+      int col = i % cols;
+      m_panels.push_back(std::make_shared<MotorPanel>(x+col*panel_w, y+row*MotorPanel::HEIGHT, panel_w, MotorPanel::HEIGHT, m_motor_ids[i]));
+    }
+  }
+
+  void focus() override {}
+
+  void unfocus() override {}
+
+  void mount() override {
+    for (PanelPtr &panel : m_panels) {
+      panel->mount();
+    }
+    doupdate();
+  }
+
+  void update(UpdatePacket *) override {}
+
+  /**
+   * Pushes the telemetry of every motor with new feedback to its panel, motors without
+   * new frames since the previous call are not touched at all.
+   */
+  void poll(TMotor::AKBus &bus) {
+    for (size_t i = 0; i < m_motor_ids.size(); i++) {
+      TMotor::MotorState state = bus.getState(m_motor_ids[i]);
+      if (state.sequence == m_sequences[i]) continue;
+      m_sequences[i] = state.sequence;
+      AKPacket motor_packet(
+        state.current,
+        state.position,
+        state.velocity,
+        m_gear_ratio,
+        state.temperature,
+        state.motor_fault
+      );
+      m_panels[i]->update(&motor_packet);
+    }
+  }
+
+  void unmount() override {
+    for (PanelPtr &panel : m_panels) {
+      panel->unmount();
+    }
+    doupdate();
+  }
+};
+
+#endif // GRID_HPP
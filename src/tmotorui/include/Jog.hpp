@@ -0,0 +1,223 @@
+#ifndef JOG_HPP
+#define JOG_HPP
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <tmotor.hpp>
+#include <Component.hpp>
+#include <Input.hpp>
+
+// Keyboard jog mode. Held left/right arrow keys are turned into a continuous velocity
+// or current command sent at a fixed high rate by a dedicated thread. Terminals only
+// report key presses, never releases, so a key counts as held while its autorepeat
+// keeps arriving: a single press only moves the motor for two command periods, once
+// the autorepeat starts the release timeout follows the measured repeat interval, and
+// once it expires the next command period sends zero. Commands the bus refuses, e.g.
+// after an emergency stop or a reflex trip, are shown in the panel.
+class Jog : public Component {
+public:
+  enum Mode : int {
+    VELOCITY,
+    CURRENT
+  };
+
+  enum Refusal : int {
+    NONE,
+    STOPPED,                                // the bus is emergency stopped
+    TRIPPED,                                // a reflex stopped the motor
+    FAILED                                  // the frame could not be sent
+  };
+
+private:
+  typedef TMotor::Clock clock;
+
+  std::shared_ptr<TMotor::AKManager> m_manager;
+  std::shared_ptr<TMotor::Clock> m_clock;
+  float m_gear_ratio;
+  std::chrono::microseconds m_period;
+  std::chrono::milliseconds m_repeat_delay;
+  std::atomic<int> m_mode;
+  std::atomic<float> m_magnitude[2];        // output shaft rpm, A
+  std::atomic<int> m_direction;             // -1, 0 or 1 while a key is held
+  std::atomic<clock::duration::rep> m_release_at;     // the held key counts as released after this time
+  std::atomic<int> m_refusal;               // why the last command was not sent
+  clock::time_point m_last_key;
+  int m_last_direction;                     // of the last arrow key, the command may have stopped since
+  clock::duration m_repeat_interval;
+  std::thread m_command_thread;
+  TMotor::StopToken m_stop;                 // of the command thread, wakes it alone
+  std::vector<TextField> m_fields;
+
+  void _command(int direction) {
+    try {
+      if (m_mode == VELOCITY) {
+        m_manager->sendVelocity(direction * m_magnitude[VELOCITY].load() * m_gear_ratio);
+      } else {
+        m_manager->sendCurrent(direction * m_magnitude[CURRENT].load());
+      }
+      m_refusal = NONE;
+    } catch (TMotor::CANSocketException &e) {
+      // retried on the next period, a stopped bus or tripped motor refuses every one until cleared
+      std::shared_ptr<TMotor::AKBus> bus = m_manager->getBus();
+      if (bus && bus->isStopped()) {
+        m_refusal = STOPPED;
+      } else if (bus && bus->isTripped(m_manager->getMotorID())) {
+        m_refusal = TRIPPED;
+      } else {
+        m_refusal = FAILED;
+      }
+    }
+  }
+
+  void _run() {
+    clock::time_point deadline = m_clock->now();
+    while (!m_stop.stopRequested()) {
+      deadline += m_period;
+      m_clock->sleepUntil(deadline, &m_stop);
+      if (m_stop.stopRequested()) break;
+      if (m_clock->now().time_since_epoch().count() >= m_release_at.load()) {
+        m_direction = 0;
+      }
+      _command(m_direction);
+    }
+    _command(0);
+    m_clock->leave();
+  }
+
+  void _press(int direction) {
+    clock::time_point now = m_clock->now();
+    clock::duration hold;
+    if (direction == m_last_direction && now - m_last_key < m_repeat_delay + m_repeat_interval) {
+      // autorepeat, follow its rate so a release is noticed after about two missed repeats
+      m_repeat_interval = now - m_last_key;
+      hold = 2 * m_repeat_interval;
+      if (hold < std::chrono::milliseconds(20)) hold = std::chrono::milliseconds(20);
+      if (hold > std::chrono::milliseconds(150)) hold = std::chrono::milliseconds(150);
+    } else {
+      // a tap, stop right away unless the autorepeat follows within the delay
+      m_repeat_interval = m_repeat_delay;
+      hold = 2 * m_period;
+    }
+    m_last_key = now;
+    m_last_direction = direction;
+    m_release_at = (now + hold).time_since_epoch().count();
+    m_direction = direction;
+  }
+
+  void _stop() {
+    m_release_at = 0;
+    m_direction = 0;
+    m_last_direction = 0;
+  }
+
+  void _draw() {
+    static const char *modes[2] = {"Velocity", "Current"};
+    static const char *units[2] = {"rpm", "A"};
+    static const char *refusals[4] = {"", " (refused, emergency stopped)", " (refused, reflex tripped)",
+                                      " (refused, send failed)"};
+    int mode = m_mode;
+    int direction = m_direction;
+    int refusal = m_refusal;
+    bool changed = false;
+    changed |= m_fields[0].set(m_win, "Mode      %s", modes[mode]);
+    changed |= m_fields[1].set(m_win, "Setpoint  %.2f %s", m_magnitude[mode].load(), units[mode]);
+    changed |= m_fields[2].set(m_win, "Command   %s%s", direction < 0 ? "<<<" : (direction > 0 ? ">>>" : "stop"),
+                               refusals[refusal]);
+    if (changed) wnoutrefresh(m_win);
+  }
+
+public:
+  Jog(int x, int y, int w, int h, std::shared_ptr<TMotor::AKManager> &manager, float gear_ratio,
+      std::chrono::microseconds period = std::chrono::milliseconds(5),
+      std::chrono::milliseconds repeat_delay = std::chrono::milliseconds(550)) :
+    Component(x, y, w, h),
+    m_manager(manager),
+    m_clock(manager->getBus() ? manager->getBus()->getClock() : TMotor::Clock::system()),
+    m_gear_ratio(gear_ratio),
+    m_period(period),
+    m_repeat_delay(repeat_delay),
+    m_mode(VELOCITY),
+    m_magnitude{{10.0f}, {1.0f}},
+    m_direction(0),
+    m_release_at(0),
+    m_refusal(NONE),
+    m_last_key(),
+    m_last_direction(0),
+    m_repeat_interval(repeat_delay),
+    m_fields{TextField(2, 2, w-4), TextField(3, 2, w-4), TextField(4, 2, w-4)}
+  {}
+
+  ~Jog() {
+    m_clock->requestStop(m_stop);
+    if (m_command_thread.joinable()) m_command_thread.join();
+  }
+
+  // Period of the input loop while jogging, keys are polled at least this often.
+  static int poll_ms() {
+    return 10;
+  }
+
+  void focus() override {
+    m_focused = true;
+  }
+
+  void unfocus() override {
+    m_focused = false;
+  }
+
+  void mount() override {
+    box(m_win, 0, 0);
+    mvwprintw(m_win, 0, 2, " Jog ");
+    mvwprintw(m_win, h-2, 2, "%.*s", w-4, "hold </> to move, ^/v setpoint, m mode, space stop, j exit");
+    for (TextField &field : m_fields) field.reset();
+    _stop();
+    m_stop.reset();
+    m_command_thread = std::thread([this] { _run(); });
+    _draw();
+    wrefresh(m_win);
+  }
+
+  // Input packets carry a key or ERR when the poll timed out without one, so the
+  // screen follows releases even when nothing is typed.
+  void update(UpdatePacket *packet) override {
+    if (packet->type != UpdatePacket::INPUT) return;
+    InputUpdate *update = static_cast<InputUpdate *>(packet);
+    int mode = m_mode;
+    switch (update->key_in) {
+      case KEY_RIGHT:
+        _press(1);
+        break;
+      case KEY_LEFT:
+        _press(-1);
+        break;
+      case KEY_UP:
+        m_magnitude[mode] = m_magnitude[mode] * 1.25f;
+        break;
+      case KEY_DOWN:
+        m_magnitude[mode] = m_magnitude[mode] / 1.25f;
+        break;
+      case 'm':
+        _stop();
+        m_mode = mode == VELOCITY ? CURRENT : VELOCITY;
+        break;
+      case ' ':
+        _stop();
+        break;
+      default:
+        break;
+    }
+    _draw();
+    doupdate();
+  }
+
+  void unmount() override {
+    m_clock->requestStop(m_stop);
+    if (m_command_thread.joinable()) m_command_thread.join();
+    werase(m_win);
+    wrefresh(m_win);
+  }
+};
+
+#endif // JOG_HPP
@@ -15,6 +15,7 @@ class Menu : public Component {
   bool *m_shutdown_ptr;
   bool m_locked;
   std::thread m_command_thread;
+  TMotor::StopToken m_stop;                 // of the command thread, wakes it alone
   float m_gear_ratio;
   
   ComponentPtr _get_curs_button() {
@@ -172,21 +173,25 @@ public:
             if (m_cursor_index[1] == 2) {
               m_manager->setOrigin(TMotor::MotorOriginMode::RESTORE);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            m_manager->getBus()->getClock()->sleepFor(std::chrono::milliseconds(100));
             _get_curs_button()->update(&button_hover);
           }
           if (m_cursor_index[0] == 2) {           // Send
             if (m_locked) {                       // Deactivate send
               m_locked = false;
+              m_manager->getBus()->getClock()->requestStop(m_stop);
               m_command_thread.join();
               _get_curs_button()->update(&button_hover);
             } else {                              // Activate send
               m_locked = true;
+              m_stop.reset();
               m_command_thread = std::thread([this] {
-                while (m_locked) {
+                std::shared_ptr<TMotor::Clock> clock = m_manager->getBus()->getClock();
+                while (!m_stop.stopRequested()) {
                   _delegate_command();
-                  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                  clock->sleepFor(std::chrono::milliseconds(100), &m_stop);
                 }
+                clock->leave();
               });
               _get_curs_button()->update(&button_active);
             }
@@ -201,7 +206,10 @@ public:
 
   void unmount() override {
     m_locked = false;
-    if (m_command_thread.joinable()) m_command_thread.join();
+    if (m_command_thread.joinable()) {
+      m_manager->getBus()->getClock()->requestStop(m_stop);
+      m_command_thread.join();
+    }
     werase(m_win);
     for (int row = 0; row < m_buttons.size(); row++) {
       for (int col = 0; col < m_buttons[row].size(); col++) {
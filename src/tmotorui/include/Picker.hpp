@@ -0,0 +1,84 @@
+#ifndef PICKER_HPP
+#define PICKER_HPP
+
+#include <string>
+#include <vector>
+
+#include <Component.hpp>
+#include <Input.hpp>
+
+// Vertical list of choices, moved through with the arrow keys and confirmed with enter.
+class Picker : public Component {
+  std::string m_title;
+  std::vector<std::string> m_items;
+  int m_cursor;
+  bool m_chosen;
+
+  void _draw() {
+    mvwprintw(m_win, 1, 2, "%s", m_title.c_str());
+    int rows = h - 4;
+    int first = m_cursor < rows ? 0 : m_cursor - rows + 1;
+    for (int row = 0; row < rows; row++) {
+      int idx = first + row;
+      std::string item = idx < (int) m_items.size() ? m_items[idx] : "";
+      item.resize(w - 4, ' ');
+      if (idx == m_cursor) wattron(m_win, COLOR_PAIR(3));
+      mvwprintw(m_win, 3+row, 2, "%s", item.c_str());
+      if (idx == m_cursor) wattroff(m_win, COLOR_PAIR(3));
+    }
+  }
+
+public:
+  Picker(int x, int y, int w, int h, std::string title, std::vector<std::string> items) :
+    Component(x, y, w, h),
+    m_title(title),
+    m_items(items),
+    m_cursor(0),
+    m_chosen(false)
+  {}
+
+  int selected() {
+    return m_cursor;
+  }
+
+  bool chosen() {
+    return m_chosen;
+  }
+
+  void focus() override {}
+
+  void unfocus() override {}
+
+  void mount() override {
+    box(m_win, 0, 0);
+    _draw();
+    wrefresh(m_win);
+  }
+
+  void update(UpdatePacket *packet) override {
+    if (packet->type != UpdatePacket::INPUT) return;
+    InputUpdate *update = static_cast<InputUpdate *>(packet);
+    switch (update->key_in) {
+      case KEY_UP:
+        if (m_cursor > 0) m_cursor--;
+        break;
+      case KEY_DOWN:
+        if (m_cursor < (int) m_items.size() - 1) m_cursor++;
+        break;
+      case '\n':
+        m_chosen = true;
+        break;
+      default:
+        break;
+    }
+    _draw();
+    wrefresh(m_win);
+  }
+
+  void unmount() override {
+    werase(m_win);
+    wrefresh(m_win);
+  }
+};
+
+#endif // PICKER_HPP
@@ -0,0 +1,169 @@
+#ifndef PLOT_HPP
+#define PLOT_HPP
+
+#include <vector>
+#include <chrono>
+
+#include <tmotor.hpp>
+#include <Component.hpp>
+
+// Scrolling min/max history of one signal. Samples are folded into fixed duration
+// buckets, one per plot column, so short spikes survive and the drawing cost only
+// depends on the plot size, never on how fast the samples arrive.
+class Sparkline {
+  std::vector<float> m_min;
+  std::vector<float> m_max;
+  std::vector<bool> m_filled;
+  size_t m_head;
+  std::chrono::steady_clock::duration m_period;
+  std::chrono::steady_clock::time_point m_bucket_end;
+
+  void _advance(std::chrono::steady_clock::time_point timestamp) {
+    if (m_bucket_end.time_since_epoch().count() == 0) {
+      m_bucket_end = timestamp + m_period;
+      return;
+    }
+    size_t steps = 0;
+    while (timestamp >= m_bucket_end && steps++ < m_min.size()) {
+      m_head = (m_head + 1) % m_min.size();
+      m_filled[m_head] = false;
+      m_bucket_end += m_period;
+    }
+    if (timestamp >= m_bucket_end) { // fell behind by more than a whole window
+      m_bucket_end = timestamp + m_period;
+    }
+  }
+
+public:
+  Sparkline(size_t columns, std::chrono::steady_clock::duration window) :
+    m_min(columns < 1 ? 1 : columns, 0.0f),
+    m_max(columns < 1 ? 1 : columns, 0.0f),
+    m_filled(columns < 1 ? 1 : columns, false),
+    m_head(0),
+    m_period(window / (columns < 1 ? 1 : columns)),
+    m_bucket_end()
+  {}
+
+  void push(float value, std::chrono::steady_clock::time_point timestamp) {
+    _advance(timestamp);
+    if (!m_filled[m_head]) {
+      m_min[m_head] = m_max[m_head] = value;
+      m_filled[m_head] = true;
+      return;
+    }
+    if (value < m_min[m_head]) m_min[m_head] = value;
+    if (value > m_max[m_head]) m_max[m_head] = value;
+  }
+
+  // Draws the history as block characters in the given rectangle, newest column on the right.
+  void draw(WINDOW *win, int row, int col, int width, int height) {
+    static const char *blocks[9] = {" ", "▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+    size_t columns = m_min.size();
+    if (width > (int) columns) width = columns;
+    float lo = 0.0f, hi = 0.0f;
+    bool any = false;
+    for (size_t i = 0; i < columns; i++) {
+      if (!m_filled[i]) continue;
+      if (!any || m_min[i] < lo) lo = m_min[i];
+      if (!any || m_max[i] > hi) hi = m_max[i];
+      any = true;
+    }
+    float range = hi - lo > 1e-6f ? hi - lo : 1.0f;
+    std::string line;
+    line.reserve(width * 3);
+    for (int r = 0; r < height; r++) {
+      int base = (height - 1 - r) * 8; // eighths below this text row
+      line.clear();
+      for (int c = 0; c < width; c++) {
+        size_t bucket = (m_head + columns - (width - 1 - c)) % columns;
+        if (!m_filled[bucket]) {
+          line += blocks[0];
+          continue;
+        }
+        int level_lo = (int) ((m_min[bucket] - lo) / range * (height * 8 - 1));
+        int level_hi = (int) ((m_max[bucket] - lo) / range * (height * 8 - 1)) + 1;
+        if (level_hi <= base || level_lo >= base + 8) {
+          line += blocks[0];
+        } else if (level_hi >= base + 8) {
+          line += blocks[8];
+        } else {
+          line += blocks[level_hi - base];
+        }
+      }
+      mvwaddstr(win, row + r, col, line.c_str());
+    }
+  }
+
+  float last() {
+    return m_filled[m_head] ? m_max[m_head] : 0.0f;
+  }
+};
+
+// Plots the recent position, velocity and current history of a motor, pulled
+// from a lock-free sample buffer fed by the bus reader.
+class Plot : public Component {
+  std::shared_ptr<TMotor::SampleBuffer> m_buffer;
+  uint64_t m_cursor;
+  std::vector<TMotor::MotorState> m_batch;
+  Sparkline m_position;
+  Sparkline m_velocity;
+  Sparkline m_current;
+  float m_gear_ratio;
+  int m_rows;
+  std::chrono::steady_clock::time_point m_next_draw;
+
+public:
+  Plot(int x, int y, int w, int h, std::shared_ptr<TMotor::SampleBuffer> buffer, float gear_ratio,
+       std::chrono::steady_clock::duration window = std::chrono::seconds(5)) :
+    Component(x, y, w, h),
+    m_buffer(buffer),
+    m_cursor(buffer->head()),
+    m_batch(256),
+    m_position(w-2, window),
+    m_velocity(w-2, window),
+    m_current(w-2, window),
+    m_gear_ratio(gear_ratio),
+    m_rows((h-2)/3 - 1),
+    m_next_draw()
+  {}
+
+  void focus() override {}
+
+  void unfocus() override {}
+
+  void mount() override {
+    box(m_win, 0, 0);
+    wnoutrefresh(m_win);
+  }
+
+  // Drains the pending samples and redraws at most 30 times a second, the window is
+  // only staged for the next doupdate().
+  void update(UpdatePacket *) override {
+    size_t count;
+    while ((count = m_buffer->pull(m_cursor, m_batch.data(), m_batch.size())) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        TMotor::MotorState &state = m_batch[i];
+        m_position.push(state.position/m_gear_ratio, state.timestamp);
+        m_velocity.push(state.velocity/m_gear_ratio, state.timestamp);
+        m_current.push(state.current, state.timestamp);
+      }
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (m_rows < 1 || now < m_next_draw) return;
+    m_next_draw = now + std::chrono::milliseconds(33);
+    mvwprintw(m_win, 1, 1, "Position %-12.2f", m_position.last());
+    m_position.draw(m_win, 2, 1, w-2, m_rows);
+    mvwprintw(m_win, 2+m_rows, 1, "Velocity %-12.2f", m_velocity.last());
+    m_velocity.draw(m_win, 3+m_rows, 1, w-2, m_rows);
+    mvwprintw(m_win, 3+2*m_rows, 1, "Current  %-12.2f", m_current.last());
+    m_current.draw(m_win, 4+2*m_rows, 1, w-2, m_rows);
+    wnoutrefresh(m_win);
+  }
+
+  void unmount() override {
+    werase(m_win);
+    wrefresh(m_win);
+  }
+};
+
+#endif // PLOT_HPP
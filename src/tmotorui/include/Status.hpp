@@ -0,0 +1,79 @@
+#ifndef STATUS_HPP
+#define STATUS_HPP
+
+#include <chrono>
+
+#include <tmotor.hpp>
+#include <Component.hpp>
+
+struct StatsPacket : public UpdatePacket {
+  TMotor::BusStatistics stats;
+
+  StatsPacket(const TMotor::BusStatistics &stats):
+    UpdatePacket(UpdatePacket::STATS),
+    stats(stats)
+  {}
+};
+
+// Single line summary of the bus traffic, rates are computed between consecutive packets.
+class StatusBar : public Component {
+  int m_motor_id;
+  TMotor::BusStatistics m_previous;
+  bool m_has_previous;
+  TextField m_field;
+
+public:
+  // Updates are expected about twice a second, more often only makes the rates noisier.
+  static std::chrono::milliseconds period() {
+    return std::chrono::milliseconds(500);
+  }
+
+  StatusBar(int x, int y, int w, int motor_id = -1) :
+    Component(x, y, w, 1),
+    m_motor_id(motor_id),
+    m_previous(),
+    m_has_previous(false),
+    m_field(0, 1, w-2)
+  {}
+
+  void focus() override {}
+
+  void unfocus() override {}
+
+  void mount() override {
+    m_field.reset();
+    m_field.set(m_win, "Bus: waiting for traffic statistics");
+    wnoutrefresh(m_win);
+  }
+
+  void update(UpdatePacket *packet) override {
+    if (packet->type != UpdatePacket::STATS) return;
+    const TMotor::BusStatistics &stats = static_cast<StatsPacket *>(packet)->stats;
+    if (m_has_previous) {
+      double elapsed = std::chrono::duration<double>(stats.timestamp - m_previous.timestamp).count();
+      if (elapsed <= 0.0) return;
+      char motor[64] = "";
+      if (m_motor_id >= 0) {
+        const TMotor::TrafficCounters &now = stats.motors[m_motor_id];
+        const TMotor::TrafficCounters &before = m_previous.motors[m_motor_id];
+        snprintf(motor, sizeof(motor), " | ID 0x%02X RX %.0f/s TX %.0f/s", m_motor_id,
+                 (now.rx_frames - before.rx_frames) / elapsed, (now.tx_frames - before.tx_frames) / elapsed);
+      }
+      bool changed = m_field.set(m_win, "Bus load %5.1f%% of %.0f kbit/s | RX %.0f/s TX %.0f/s | dropped %llu | errors %llu | TX failures %llu%s",
+        stats.utilization(m_previous), stats.bitrate / 1000.0,
+        (stats.rx_frames - m_previous.rx_frames) / elapsed, (stats.tx_frames - m_previous.tx_frames) / elapsed,
+        (unsigned long long) stats.rx_dropped, (unsigned long long) stats.error_frames,
+        (unsigned long long) stats.tx_failures, motor);
+      if (changed) wnoutrefresh(m_win);
+    }
+    m_previous = stats;
+    m_has_previous = true;
+  }
+
+  void unmount() override {
+    werase(m_win);
+    wnoutrefresh(m_win);
+  }
+};
+
+#endif // STATUS_HPP
@@ -1,12 +1,12 @@
 #include <getopt.h>
 #include <signal.h>
+#include <locale.h>
 #include <ncurses.h>
 #include <net/if.h>
 
 #include <map>
 #include <string>
 #include <vector>
-#include <sstream>
 #include <iostream>
 
 #include <Component.hpp>
@@ -14,15 +14,29 @@
 #include <Button.hpp>
 #include <Input.hpp>
 #include <Menu.hpp>
+#include <Grid.hpp>
+#include <Plot.hpp>
+#include <Status.hpp>
+#include <Picker.hpp>
+#include <Jog.hpp>
 #include <tmotor.hpp>
+#include <tmotor_cli.hpp>
+
+// Leaves curses before reporting, so that the terminal is usable again.
+int connect_failed(const TMotor::CANSocketException &e) {
+  endwin();
+  std::cout << "Unable to connect: " << e.what() << "\n";
+  return 1;
+}
 
 int main(int argc, char **argv) {
   float gear_ratio;
   std::string can_interface;
+  std::vector<uint8_t> motor_ids;
 
-  if (argc != 3)
+  if (argc != 3 && argc != 4)
   {
-    std::cout << "Usage: tmotorui <reduction> <can_interface>\n";
+    std::cout << "Usage: tmotorui <reduction> <can_interface> [motor_ids]\n";
     return 1;
   }
 
@@ -30,7 +44,7 @@ int main(int argc, char **argv) {
   if (gear_ratio < 0.0f)
   {
     std::cout << "Invalid reduction value, must be a positive number.\n";
-    std::cout << "Usage: tmotorui <reduction> <can_interface>\n";
+    std::cout << "Usage: tmotorui <reduction> <can_interface> [motor_ids]\n";
     return 1;
   }
 
@@ -39,10 +53,18 @@ int main(int argc, char **argv) {
   if (can_idx == 0)
   {
     std::cout << "Invalid can interface value, must be a valid can interface.\n";
-    std::cout << "Usage: tmotorui <reduction> <can_interface>\n";
+    std::cout << "Usage: tmotorui <reduction> <can_interface> [motor_ids]\n";
+    return 1;
+  }
+
+  if (argc == 4 && !TMotor::parse_motor_ids(argv[3], motor_ids))
+  {
+    std::cout << "Invalid motor IDs, must be a list of hexadecimal IDs or ranges such as 1,2,a-f.\n";
+    std::cout << "Usage: tmotorui <reduction> <can_interface> [motor_ids]\n";
     return 1;
   }
 
+  setlocale(LC_CTYPE, ""); // block characters of the plots
   initscr();
   atexit((void (*)()) endwin);
 
@@ -55,8 +77,100 @@ int main(int argc, char **argv) {
   init_colors();
   paint_scr();
 
-  int motor_id = 0;
-  { // Input motor ID
+  int motor_id = -1;
+  if (motor_ids.empty()) { // Discover the motors on the bus and let the operator pick one
+    attron(COLOR_PAIR(2));
+    mvprintw(LINES/2, (COLS-30)/2, "Scanning the bus for motors...");
+    attroff(COLOR_PAIR(2));
+    refresh();
+    std::vector<TMotor::DiscoveredMotor> discovered;
+    try {
+      TMotor::AKBus bus;
+      bus.connect(can_interface.c_str());
+      discovered = bus.discover(std::chrono::milliseconds(200));
+    } catch (TMotor::CANSocketException &e) {
+      return connect_failed(e);
+    }
+    clear();
+    refresh();
+
+    std::vector<std::string> items;
+    for (TMotor::DiscoveredMotor &motor : discovered) {
+      char item[64];
+      snprintf(item, sizeof(item), "AK 0x%02X  %8.2f deg  %3d C  %s", motor.motor_id,
+               motor.state.position/gear_ratio, motor.state.temperature, fault_to_str(motor.state.motor_fault));
+      items.push_back(item);
+    }
+    if (discovered.size() > 1) items.push_back("Monitor all of them");
+    items.push_back("Enter the ID manually");
+
+    int height = items.size() + 5 < (size_t) LINES ? items.size() + 5 : LINES;
+    std::string title = std::to_string(discovered.size()) + " motor(s) found, press enter to select:";
+    Picker picker((COLS-50)/2, (LINES-height)/2, 50, height, title, items);
+    picker.mount();
+    InputUpdate packet('0');
+    while (!picker.chosen()) {
+      if ((packet.key_in = getch()) == 'q') return 0;
+      picker.update(&packet);
+    }
+    picker.unmount();
+    clear();
+    refresh();
+
+    if (picker.selected() < (int) discovered.size()) {
+      motor_id = discovered[picker.selected()].motor_id;
+    } else if (discovered.size() > 1 && picker.selected() == (int) discovered.size()) {
+      for (TMotor::DiscoveredMotor &motor : discovered) {
+        motor_ids.push_back(motor.motor_id);
+      }
+    }
+  }
+
+  if (!motor_ids.empty()) { // Grid mode, monitor every listed motor through one bus
+    std::shared_ptr<TMotor::AKBus> bus = std::make_shared<TMotor::AKBus>();
+    try {
+      bus->connect(can_interface.c_str(), motor_ids);
+    } catch (TMotor::CANSocketException &e) {
+      return connect_failed(e);
+    }
+
+    bool shutdown = false;
+    Grid grid(0, 0, COLS, LINES-1, motor_ids, gear_ratio);
+    StatusBar status(0, LINES-1, COLS);
+    grid.mount();
+    status.mount();
+
+    // Single render thread for every panel, capped to a terminal friendly frame rate.
+    std::thread renderer([&shutdown, &grid, &status, &bus] {
+      std::chrono::steady_clock::time_point next_stats = std::chrono::steady_clock::now();
+      while (!shutdown) {
+        uint32_t sequence = bus->getSequence();
+        {
+          std::lock_guard<std::mutex> lock(curses_mutex());
+          grid.poll(*bus);
+          if (std::chrono::steady_clock::now() >= next_stats) {
+            next_stats = std::chrono::steady_clock::now() + StatusBar::period();
+            StatsPacket stats_packet(bus->getStatistics());
+            status.update(&stats_packet);
+          }
+          doupdate();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        while (!shutdown && bus->waitForUpdate(sequence, std::chrono::milliseconds(100)) == sequence
+               && std::chrono::steady_clock::now() < next_stats);
+      }
+    });
+
+    nodelay(stdscr, TRUE);
+    while (read_key(-1) != 'q');
+    shutdown = true;
+    renderer.join();
+    grid.unmount();
+    status.unmount();
+    return 0;
+  }
+
+  if (motor_id < 0) { // Input motor ID
     InputBufferHex input("Motor ID", (COLS-30)/2, LINES/2, 30, 5);
     attron(COLOR_PAIR(2));
     mvprintw(LINES/2+6, (COLS-54)/2, "Please enter the motor ID using hexadecimal notation.");
@@ -74,40 +188,87 @@ int main(int argc, char **argv) {
 
   { // Main loop
     std::shared_ptr<TMotor::AKManager> manager = std::make_shared<TMotor::AKManager>(motor_id);
-    manager->connect(can_interface.c_str());
+    try {
+      manager->connect(can_interface.c_str());
+    } catch (TMotor::CANSocketException &e) {
+      return connect_failed(e);
+    }
+
+    std::shared_ptr<TMotor::SampleBuffer> samples = std::make_shared<TMotor::SampleBuffer>(4096);
+    manager->getBus()->setSampleBuffer(motor_id, samples);
 
     bool shutdown = false;
     Menu menu(1+COLS/5, 0, 4*COLS/5, (COLS)/(5*2), &shutdown, manager, gear_ratio);
     Dashboard dashboard(0, 0, COLS/5, (COLS)/(5*2), motor_id);
+    Plot plot(0, (COLS)/(5*2), COLS, LINES-1-(COLS)/(5*2), samples, gear_ratio);
+    StatusBar status(0, LINES-1, COLS, motor_id);
+    Jog jog(1+COLS/5, 0, 4*COLS/5, (COLS)/(5*2), manager, gear_ratio);
     
     menu.mount();
     dashboard.mount();
+    plot.mount();
+    status.mount();
     menu.focus();
     dashboard.focus();
 
-    std::thread dashboard_updater([&shutdown, &dashboard, &manager, gear_ratio] {
+    // Single render thread, woken up by new telemetry rather than a fixed poll.
+    std::thread renderer([&shutdown, &dashboard, &plot, &status, &manager, gear_ratio] {
+      std::chrono::steady_clock::time_point next_stats = std::chrono::steady_clock::now();
       while (!shutdown) {
+        TMotor::MotorState state = manager->getState();
         AKPacket motor_packet(
-          manager->getCurrent(),  //current
-          manager->getPosition(),  //position
-          manager->getVelocity(),  //velocity
+          state.current,
+          state.position,
+          state.velocity,
           gear_ratio,
-          manager->getTemperature(),  //temperature
-          manager->getFault()
+          state.temperature,
+          state.motor_fault
         );
-        dashboard.update(&motor_packet);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        {
+          std::lock_guard<std::mutex> lock(curses_mutex());
+          dashboard.update(&motor_packet);
+          plot.update(&motor_packet);
+          if (std::chrono::steady_clock::now() >= next_stats) {
+            next_stats = std::chrono::steady_clock::now() + StatusBar::period();
+            StatsPacket stats_packet(manager->getBus()->getStatistics());
+            status.update(&stats_packet);
+          }
+          doupdate();
+        }
+        while (!shutdown && manager->waitForUpdate(state.sequence, std::chrono::milliseconds(100)) == state.sequence
+               && std::chrono::steady_clock::now() < next_stats);
       }
     });
     
     InputUpdate packet('0');
-    while (((packet.key_in = getch()) != 'q') && (!shutdown)) {
-      menu.update(&packet);
+    bool jogging = false;
+    nodelay(stdscr, TRUE);
+    // Jog mode replaces the menu, keys are polled instead of awaited
+    while (((packet.key_in = read_key(jogging ? Jog::poll_ms() : -1)) != 'q') && (!shutdown)) {
+      std::lock_guard<std::mutex> lock(curses_mutex());
+      if (packet.key_in == 'j') {
+        if (jogging) {
+          jog.unmount();
+          menu.mount();
+          menu.focus();
+        } else {
+          menu.unmount();
+          jog.mount();
+        }
+        jogging = !jogging;
+      } else if (jogging) {
+        jog.update(&packet);
+      } else {
+        menu.update(&packet);
+      }
     }
     shutdown = true;
+    renderer.join();
+    if (jogging) jog.unmount();
     dashboard.unmount();
+    plot.unmount();
+    status.unmount();
     menu.unmount();
-    dashboard_updater.join();
   }
 
   return 0;
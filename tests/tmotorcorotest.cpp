@@ -0,0 +1,192 @@
+#include <sys/socket.h>
+#include <tmotor.hpp>
+#include <tmotor_coro.hpp>
+#include <gtest/gtest.h>
+
+#include "tmotortest.hpp"
+
+#include <thread>
+#include <vector>
+
+static struct can_frame feedback_frame(uint8_t motor_id, int16_t pos)
+{
+  struct can_frame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.can_id = CAN_EFF_FLAG | TMOTOR_AK_FEEDBACK_ID | motor_id;
+  frame.can_dlc = 8;
+  frame.data[0] = (pos >> 8) & 0xFF;
+  frame.data[1] = pos & 0xFF;
+  return frame;
+}
+
+static TMotor::MotionTask move_twice(TMotor::CoroutineBus &bus, TMotor::AKManager &motor, std::vector<float> &log)
+{
+  TMotor::MotorState state = co_await bus.moveTo(motor, 90.0f, 1.0f);
+  log.push_back(state.position);
+  state = co_await bus.moveTo(motor, 0.0f, 1.0f);
+  log.push_back(state.position);
+}
+
+TEST_F(BusTest, moveToResumesOnFeedback)
+{
+  TMotor::CoroutineBus coroutines(bus);
+  TMotor::BusOptions options;
+  options.reader_thread = false;
+  bus->open(fds[0], options);
+  TMotor::AKManager motor(0x01);
+  motor.connect(bus);
+
+  std::vector<float> log;
+  TMotor::MotionTask task = move_twice(coroutines, motor, log);
+  struct can_frame frame;
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::POSITION | 0x01);
+
+  int16_t positions[] = {100, 500, 895};
+  for (int16_t position : positions) {
+    frame = feedback_frame(0x01, position);
+    ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    ASSERT_EQ(bus->processIncoming(), 1u);
+  }
+  ASSERT_EQ(log.size(), 1u);
+  ASSERT_FLOAT_EQ(log[0], 89.5f);
+  ASSERT_FALSE(task.done());
+
+  // the second move was commanded from the resumed coroutine
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::POSITION | 0x01);
+  frame = feedback_frame(0x01, -5);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->processIncoming(), 1u);
+  ASSERT_TRUE(task.done());
+  ASSERT_EQ(log.size(), 2u);
+  task.rethrow();
+
+  // a destroyed sequence is never resumed
+  {
+    TMotor::MotionTask pending = move_twice(coroutines, motor, log);
+    ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  }
+  frame = feedback_frame(0x01, 900);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->processIncoming(), 1u);
+  ASSERT_EQ(log.size(), 2u);
+};
+
+static TMotor::MotionTask count_samples(TMotor::CoroutineBus &bus, uint8_t motor_id, int samples,
+                                        std::atomic<int> &resumed, std::thread::id &thread)
+{
+  for (int i = 0; i < samples; i++) {
+    co_await bus.nextSample(motor_id);
+    resumed++;
+  }
+  thread = std::this_thread::get_id();
+}
+
+TEST_F(BusTest, manySequencesOnTheReader)
+{
+  TMotor::CoroutineBus coroutines(bus);
+  bus->open(fds[0]);
+
+  std::atomic<int> resumed(0);
+  std::vector<std::thread::id> threads(256);
+  std::vector<TMotor::MotionTask> tasks;
+  for (int i = 0; i < 256; i++) {
+    tasks.push_back(count_samples(coroutines, i % 4, 3, resumed, threads[i]));
+  }
+  for (int i = 0; i < 3; i++) {
+    for (uint8_t motor_id = 0; motor_id < 4; motor_id++) {
+      struct can_frame frame = feedback_frame(motor_id, i);
+      ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    }
+    // the next frames wait until every sequence has seen these, a wakeup resumes a motor's waiters once
+    for (int j = 0; j < 1000 && resumed < 256 * (i + 1); j++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  ASSERT_EQ(resumed, 3 * 256);
+  for (int i = 0; i < 256; i++) {
+    ASSERT_TRUE(tasks[i].done());
+    ASSERT_NE(threads[i], std::this_thread::get_id());
+  }
+};
+
+static TMotor::MotionTask wait_samples(TMotor::CoroutineBus &bus, uint8_t motor_id, int samples, int &resumed)
+{
+  for (int i = 0; i < samples; i++) {
+    co_await bus.nextSample(motor_id);
+    resumed++;
+  }
+}
+
+static TMotor::MotionTask cancel_others(TMotor::CoroutineBus &bus, uint8_t motor_id,
+                                        std::vector<TMotor::MotionTask> &others, int &resumed)
+{
+  co_await bus.nextSample(motor_id);
+  resumed++;
+  others.clear();
+}
+
+TEST_F(BusTest, cancelFromAResumedSequence)
+{
+  TMotor::CoroutineBus coroutines(bus);
+  TMotor::BusOptions options;
+  options.reader_thread = false;
+  bus->open(fds[0], options);
+
+  // the newest waiter is resumed first, so the canceller runs between the two halves of the others
+  int resumed = 0;
+  int cancels = 0;
+  std::vector<TMotor::MotionTask> others;
+  for (int i = 0; i < 8; i++) {
+    others.push_back(wait_samples(coroutines, 0x01, 2, resumed));
+  }
+  TMotor::MotionTask canceller = cancel_others(coroutines, 0x01, others, cancels);
+  std::vector<TMotor::MotionTask> later;
+  for (int i = 0; i < 8; i++) {
+    later.push_back(wait_samples(coroutines, 0x01, 2, resumed));
+  }
+  for (TMotor::MotionTask &task : later) {
+    others.push_back(std::move(task));
+  }
+
+  struct can_frame frame = feedback_frame(0x01, 10);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->processIncoming(), 1u);
+  ASSERT_EQ(cancels, 1);
+  ASSERT_EQ(resumed, 8);
+  ASSERT_TRUE(canceller.done());
+  ASSERT_TRUE(others.empty());
+
+  frame = feedback_frame(0x01, 20);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->processIncoming(), 1u);
+  ASSERT_EQ(resumed, 8);
+};
+
+TEST_F(BusTest, cancelWhileTheReaderResumes)
+{
+  TMotor::CoroutineBus coroutines(bus);
+  bus->open(fds[0]);
+
+  std::atomic<bool> feeding(true);
+  std::thread feeder([&] {
+    for (int16_t i = 0; feeding; i++) {
+      struct can_frame frame = feedback_frame(0x01, i);
+      if (write(fds[1], &frame, sizeof(frame)) != (ssize_t) sizeof(frame)) break;
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+  });
+  int resumed = 0; // only written by the reader, read once the tasks are gone
+  for (int round = 0; round < 200; round++) {
+    std::vector<TMotor::MotionTask> tasks;
+    for (int i = 0; i < 16; i++) {
+      tasks.push_back(wait_samples(coroutines, 0x01, 1000, resumed));
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    // destroyed here, off the reader, while it may be resuming them
+  }
+  feeding = false;
+  feeder.join();
+  ASSERT_GT(resumed, 0);
+};
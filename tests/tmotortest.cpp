@@ -1,7 +1,57 @@
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <linux/can/error.h>
 #include <tmotor.hpp>
+#include <tmotor_controller.hpp>
+#include <tmotor_poller.hpp>
+#include <tmotor_planner.hpp>
+#include <tmotor_sim.hpp>
+#include <tmotor_archive.hpp>
+#include <tmotor_metrics.hpp>
+#include <tmotor_trace.hpp>
+#include <tmotor_models.hpp>
+#include <tmotor_sysid.hpp>
 #include <gtest/gtest.h>
 
+#include "tmotortest.hpp"
+
+#include <dlfcn.h>
+#include <new>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+// Allocation hook, counts every heap allocation of the process while enabled.
+static std::atomic<bool> count_allocations(false);
+static std::atomic<uint64_t> allocations(0);
+
+void *operator new(size_t size) {
+  if (count_allocations.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  void *ptr = malloc(size ? size : 1);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+// The runtime allocates thrown exceptions with malloc rather than operator new, they are counted here.
+extern "C" void *__cxa_allocate_exception(size_t size) noexcept {
+  static void *(*allocate)(size_t) = (void *(*)(size_t)) dlsym(RTLD_NEXT, "__cxa_allocate_exception");
+  if (count_allocations.load(std::memory_order_relaxed)) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  }
+  return allocate(size);
+}
+
 TEST(ThreadSafety, constructDestruct)
 {
   TMotor::AKManager motor(0x01);
@@ -23,4 +73,1219 @@ TEST(SetGet, setMotorID)
   TMotor::AKManager motor(0x01);
   motor.setMotorID(0x02);
   ASSERT_EQ(motor.getMotorID(), 0x02);
-};
\ No newline at end of file
+};
+
+TEST(Defaults, state)
+{
+  TMotor::AKManager motor(0x01);
+  TMotor::MotorState state = motor.getState();
+  ASSERT_EQ(state.current, 0.0f);
+  ASSERT_EQ(state.velocity, 0.0f);
+  ASSERT_EQ(state.position, 0.0f);
+  ASSERT_EQ(state.temperature, 0);
+  ASSERT_EQ(state.motor_fault, TMotor::MotorFault::NONE);
+  ASSERT_EQ(state.sequence, 0u);
+};
+
+TEST(Events, waitForUpdateTimeout)
+{
+  TMotor::AKManager motor(0x01);
+  ASSERT_EQ(motor.waitForUpdate(0, std::chrono::milliseconds(10)), 0u);
+};
+
+TEST_F(BusTest, waitForUpdateWithoutBus)
+{
+  // without a bus the wait sleeps on the injected clock, an hour passes in no time
+  std::shared_ptr<TMotor::VirtualClock> clock = std::make_shared<TMotor::VirtualClock>();
+  TMotor::AKManager motor(0x01);
+  motor.setClock(clock);
+  std::thread waiter([&motor] { ASSERT_EQ(motor.waitForUpdate(7, std::chrono::hours(1)), 7u); });
+  ASSERT_TRUE(clock->waitForSleepers(1, std::chrono::milliseconds(1000)));
+  clock->advance(std::chrono::hours(1));
+  waiter.join();
+
+  // and attaching a bus ends it early
+  std::atomic<bool> woken(false);
+  waiter = std::thread([&motor, &woken] {
+    motor.waitForUpdate(7, std::chrono::hours(1));
+    woken = true;
+  });
+  ASSERT_TRUE(clock->waitForSleepers(1, std::chrono::milliseconds(1000)));
+  ASSERT_FALSE(woken);
+  bus->open(fds[0]);
+  motor.connect(bus);
+  waiter.join();
+  ASSERT_TRUE(woken);
+};
+
+static struct can_frame feedback_frame(uint8_t motor_id, int16_t pos, int16_t vel, int16_t cur, int8_t temp, uint8_t fault)
+{
+  struct can_frame frame;
+  memset(&frame, 0, sizeof(frame));
+  frame.can_id = CAN_EFF_FLAG | TMOTOR_AK_FEEDBACK_ID | motor_id;
+  frame.can_dlc = 8;
+  frame.data[0] = (pos >> 8) & 0xFF;
+  frame.data[1] = pos & 0xFF;
+  frame.data[2] = (vel >> 8) & 0xFF;
+  frame.data[3] = vel & 0xFF;
+  frame.data[4] = (cur >> 8) & 0xFF;
+  frame.data[5] = cur & 0xFF;
+  frame.data[6] = temp;
+  frame.data[7] = fault;
+  return frame;
+}
+
+TEST_F(BusTest, decodesEveryMotor)
+{
+  bus->open(fds[0]);
+
+  struct can_frame frame = feedback_frame(0x01, 123, 456, -250, 40, TMotor::MotorFault::NONE);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  frame = feedback_frame(0x20, -10, -20, 30, 50, TMotor::MotorFault::OVERCURRENT);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->waitForUpdate(0x20, 0, std::chrono::milliseconds(1000)), 1u);
+
+  TMotor::MotorState state = bus->getState(0x01);
+  ASSERT_FLOAT_EQ(state.position, 12.3f);
+  ASSERT_FLOAT_EQ(state.velocity, 456.0f);
+  ASSERT_FLOAT_EQ(state.current, -2.5f);
+  ASSERT_EQ(state.temperature, 40);
+  ASSERT_EQ(state.sequence, 1u);
+  state = bus->getState(0x20);
+  ASSERT_FLOAT_EQ(state.position, -1.0f);
+  ASSERT_EQ(state.motor_fault, TMotor::MotorFault::OVERCURRENT);
+  ASSERT_EQ(bus->getSequence(), 2u);
+  ASSERT_EQ(bus->getState(0x02).sequence, 0u);
+};
+
+TEST_F(BusTest, ignoresOtherFrames)
+{
+  bus->open(fds[0]);
+
+  struct can_frame frame = feedback_frame(0x01, 1, 1, 1, 1, 0);
+  frame.can_id = CAN_EFF_FLAG | TMotor::MotorModeID::VELOCITY | 0x01;
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  frame = feedback_frame(0x01, 1, 1, 1, 1, 0);
+  frame.can_dlc = 4;
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->waitForUpdate(0, std::chrono::milliseconds(200)), 0u);
+};
+
+TEST_F(BusTest, sharedBetweenManagers)
+{
+  bus->open(fds[0]);
+  TMotor::AKManager first(0x01), second(0x02);
+  first.connect(bus);
+  second.connect(bus);
+
+  struct can_frame frame = feedback_frame(0x02, 0, 0, 100, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(second.waitForUpdate(0, std::chrono::milliseconds(1000)), 1u);
+  ASSERT_FLOAT_EQ(second.getCurrent(), 1.0f);
+  ASSERT_EQ(first.getState().sequence, 0u);
+
+  first.sendVelocity(10.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::VELOCITY | 0x01);
+  ASSERT_EQ(frame.can_dlc, 4);
+};
+
+TEST(Samples, pullInOrder)
+{
+  TMotor::SampleBuffer buffer(5);
+  ASSERT_EQ(buffer.capacity(), 8u);
+  uint64_t cursor = buffer.head();
+  TMotor::MotorState state = TMotor::MotorState();
+  for (int i = 0; i < 3; i++) {
+    state.sequence = i;
+    buffer.push(state);
+  }
+  TMotor::MotorState out[8];
+  ASSERT_EQ(buffer.pull(cursor, out, 8), 3u);
+  ASSERT_EQ(out[0].sequence, 0u);
+  ASSERT_EQ(out[2].sequence, 2u);
+  ASSERT_EQ(buffer.pull(cursor, out, 8), 0u);
+};
+
+TEST(Samples, overflowSkipsOldest)
+{
+  TMotor::SampleBuffer buffer(4);
+  uint64_t cursor = 0;
+  TMotor::MotorState state = TMotor::MotorState();
+  for (int i = 0; i < 10; i++) {
+    state.sequence = i;
+    buffer.push(state);
+  }
+  TMotor::MotorState out[8];
+  ASSERT_EQ(buffer.pull(cursor, out, 8), 4u);
+  ASSERT_EQ(out[0].sequence, 6u);
+  ASSERT_EQ(out[3].sequence, 9u);
+  ASSERT_EQ(cursor, 10u);
+};
+
+TEST_F(BusTest, recordedByBus)
+{
+  std::shared_ptr<TMotor::SampleBuffer> buffer = std::make_shared<TMotor::SampleBuffer>(16);
+  bus->setSampleBuffer(0x03, buffer);
+  bus->open(fds[0]);
+  for (int16_t i = 0; i < 5; i++) {
+    struct can_frame frame = feedback_frame(0x03, i, 0, 0, 0, 0);
+    ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  }
+  uint32_t sequence = 0;
+  while (sequence < 5 && (sequence = bus->waitForUpdate(0x03, sequence, std::chrono::milliseconds(1000))) != 0);
+  uint64_t cursor = 0;
+  TMotor::MotorState out[16];
+  ASSERT_EQ(buffer->pull(cursor, out, 16), 5u);
+  ASSERT_FLOAT_EQ(out[4].position, 0.4f);
+  ASSERT_LE(out[0].timestamp, out[4].timestamp);
+};
+
+TEST(Statistics, frameBits)
+{
+  ASSERT_EQ(TMotor::frameBits(true, 8), 160u);
+  ASSERT_EQ(TMotor::frameBits(false, 8), 135u);
+  ASSERT_EQ(TMotor::frameBits(true, 4), 120u);
+};
+
+TEST_F(BusTest, countsTraffic)
+{
+  bus->open(fds[0]);
+  TMotor::AKManager motor(0x05);
+  motor.connect(bus);
+  TMotor::BusStatistics before = bus->getStatistics();
+
+  struct can_frame frame = feedback_frame(0x05, 0, 0, 0, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  frame.can_id = CAN_ERR_FLAG | CAN_ERR_BUSOFF;
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(motor.waitForUpdate(0, std::chrono::milliseconds(1000)), 1u);
+  motor.sendCurrent(1.0f);
+  motor.sendPositionVelocityAcceleration(10.0f, 100, 10);
+
+  TMotor::BusStatistics stats = bus->getStatistics();
+  ASSERT_EQ(stats.rx_frames, 1u);
+  ASSERT_EQ(stats.rx_bytes, 8u);
+  ASSERT_EQ(stats.tx_frames, 2u);
+  ASSERT_EQ(stats.tx_bytes, 12u);
+  ASSERT_EQ(stats.error_frames, 1u);
+  ASSERT_EQ(stats.motors[0x05].rx_frames, 1u);
+  ASSERT_EQ(stats.motors[0x05].tx_frames, 2u);
+  ASSERT_EQ(stats.bits, 160u + 120u + 160u);
+  ASSERT_GT(stats.utilization(before), 0.0f);
+};
+
+class OverflowBus : public TMotor::AKBus {
+public:
+  using TMotor::AKBus::__count_dropped;
+};
+
+TEST(Statistics, countsKernelDrops)
+{
+  OverflowBus bus;
+  uint32_t reported = 0;
+  bus.setDropCallback([&reported](uint32_t dropped) { reported += dropped; });
+  bus.__count_dropped(0);
+  bus.__count_dropped(3);
+  bus.__count_dropped(3);
+  bus.__count_dropped(10);
+  ASSERT_EQ(reported, 10u);
+  ASSERT_EQ(bus.getStatistics().rx_dropped, 10u);
+};
+
+TEST(Defaults, busOptions)
+{
+  TMotor::BusOptions options;
+  ASSERT_EQ(options.receive_buffer, 0);
+  ASSERT_EQ(options.send_buffer, 0);
+};
+
+TEST_F(BusTest, findsRespondingMotors)
+{
+  bus->open(fds[0]);
+  std::thread motors([this] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 0; i < 3; i++) {
+      struct can_frame frame = feedback_frame(0x07, 70 + i, 0, 0, 30, 0);
+      write(fds[1], &frame, sizeof(frame));
+      frame = feedback_frame(0x03, 30 + i, 0, 0, 30, 0);
+      write(fds[1], &frame, sizeof(frame));
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  });
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<TMotor::DiscoveredMotor> discovered = bus->discover(std::chrono::milliseconds(200));
+  std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+  motors.join();
+
+  ASSERT_EQ(discovered.size(), 2u);
+  ASSERT_EQ(discovered[0].motor_id, 0x03);
+  ASSERT_FLOAT_EQ(discovered[0].state.position, 3.0f);
+  ASSERT_EQ(discovered[1].motor_id, 0x07);
+  ASSERT_FLOAT_EQ(discovered[1].state.position, 7.0f);
+  ASSERT_GE(elapsed, std::chrono::milliseconds(200));
+  ASSERT_LT(elapsed, std::chrono::milliseconds(400));
+};
+
+TEST(Connect, failsFastWithBackoff)
+{
+  TMotor::AKManager motor(0x01);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::future<void> connected = motor.connectAsync("tmotortest0");
+  ASSERT_THROW(connected.get(), TMotor::CANSocketException);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+  ASSERT_EQ(motor.getBus(), nullptr);
+};
+
+TEST(Connect, rejectsLongInterfaceName)
+{
+  TMotor::AKBus bus;
+  ASSERT_THROW(bus.connect("an_interface_name_longer_than_ifnamsiz"), TMotor::CANSocketException);
+  ASSERT_FALSE(bus.isConnected());
+};
+
+TEST(Controller, mailboxRoundTrip)
+{
+  TMotor::Mailbox<TMotor::ImpedanceTarget> mailbox;
+  mailbox.store(TMotor::ImpedanceTarget{1.0f, 2.0f, 3.0f});
+  TMotor::ImpedanceTarget target = mailbox.load();
+  ASSERT_EQ(target.position, 1.0f);
+  ASSERT_EQ(target.velocity, 2.0f);
+  ASSERT_EQ(target.feedforward, 3.0f);
+};
+
+TEST_F(BusTest, commandsImpedanceCurrent)
+{
+  bus->open(fds[0]);
+  struct can_frame frame = feedback_frame(0x04, 0, 0, 0, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->waitForUpdate(0x04, 0, std::chrono::milliseconds(1000)), 1u);
+
+  TMotor::ImpedanceController controller(bus, std::chrono::microseconds(500));
+  controller.setFeedbackTimeout(std::chrono::seconds(10));
+  controller.addMotor(0x04, TMotor::ImpedanceGains{0.5f, 0.0f, 2.0f});
+  controller.setTarget(0x04, TMotor::ImpedanceTarget{10.0f, 0.0f, 0.25f});
+  controller.start();
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  controller.stop();
+
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x04);
+  int32_t current = frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24;
+  ASSERT_EQ(current, 200); // 0.5*10 + 0.25 clamped to 2 A
+  TMotor::LoopStatistics stats = controller.getStatistics();
+  ASSERT_GE(stats.ticks, 1u);
+  ASSERT_GE(stats.latency_max_us, stats.latency_mean_us);
+};
+
+TEST_F(BusTest, zeroCurrentOnStaleFeedback)
+{
+  bus->open(fds[0]);
+  TMotor::ImpedanceController controller(bus);
+  controller.addMotor(0x04, TMotor::ImpedanceGains{1.0f, 0.0f, 10.0f});
+  controller.setTarget(0x04, TMotor::ImpedanceTarget{10.0f, 0.0f, 0.0f});
+  controller.start();
+  struct can_frame frame;
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  controller.stop();
+  ASSERT_EQ(frame.data[0] | frame.data[1] | frame.data[2] | frame.data[3], 0);
+  ASSERT_GE(controller.getStatistics().stale, 1u);
+};
+
+TEST(MIT, codecRoundTrip)
+{
+  TMotor::MITCodec codec;
+  TMotor::MITCommand command{1.0f, -2.0f, 100.0f, 1.5f, 3.0f};
+  struct can_frame frame;
+  codec.pack(0x05, command, frame);
+  ASSERT_EQ(frame.can_id, 0x05u);
+  ASSERT_EQ(frame.can_dlc, 8);
+
+  // a reply carries the position, velocity and torque fields one byte later
+  struct can_frame reply_frame;
+  reply_frame.can_dlc = 8;
+  reply_frame.data[0] = 0x05;
+  reply_frame.data[1] = frame.data[0];
+  reply_frame.data[2] = frame.data[1];
+  reply_frame.data[3] = frame.data[2];
+  reply_frame.data[4] = (frame.data[3] & 0xF0) | (frame.data[6] & 0x0F);
+  reply_frame.data[5] = frame.data[7];
+  reply_frame.data[6] = 30;
+  reply_frame.data[7] = 0;
+  TMotor::MITReply reply;
+  ASSERT_TRUE(codec.unpack(reply_frame, reply));
+  ASSERT_EQ(reply.motor_id, 0x05);
+  ASSERT_NEAR(reply.position, 1.0f, 25.0f / 65535);
+  ASSERT_NEAR(reply.velocity, -2.0f, 100.0f / 4095);
+  ASSERT_NEAR(reply.torque, 3.0f, 36.0f / 4095);
+  ASSERT_EQ(reply.temperature, 30);
+
+  command.position = 100.0f;
+  command.kp = -1.0f;
+  codec.pack(0x05, command, frame);
+  ASSERT_EQ(frame.data[0], 0xFF);
+  ASSERT_EQ(frame.data[1], 0xFF);
+  ASSERT_EQ(frame.data[3] & 0x0F, 0);
+  ASSERT_EQ(frame.data[4], 0);
+};
+
+TEST_F(BusTest, repliesUpdateState)
+{
+  TMotor::BusOptions options;
+  options.mit_reply_id = 0x00;
+  bus->open(fds[0], options);
+  TMotor::AKManager motor(0x03);
+  TMotor::MITLimits limits;
+  limits.torque_constant = 0.5f;
+  motor.setMITLimits(limits);
+  motor.connect(bus);
+
+  motor.enterMITMode();
+  struct can_frame frame;
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, 0x03u);
+  ASSERT_EQ(frame.data[0], 0xFF);
+  ASSERT_EQ(frame.data[7], 0xFC);
+
+  frame.can_id = 0x00;
+  frame.can_dlc = 8;
+  frame.data[0] = 0x03;
+  frame.data[1] = 0x80; frame.data[2] = 0x00;                 // ~0 rad
+  frame.data[3] = 0x7F; frame.data[4] = 0x8F; frame.data[5] = 0xFF; // ~0 rad/s, 18 Nm
+  frame.data[6] = 45;
+  frame.data[7] = TMotor::MotorFault::OVERVOLTAGE;
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(motor.waitForUpdate(0, std::chrono::milliseconds(1000)), 1u);
+  TMotor::MotorState state = motor.getState();
+  ASSERT_NEAR(state.position, 0.0f, 0.05f);
+  ASSERT_NEAR(state.current, 36.0f, 0.01f);
+  ASSERT_EQ(state.temperature, 45);
+  ASSERT_EQ(state.motor_fault, TMotor::MotorFault::OVERVOLTAGE);
+};
+
+TEST_F(BusTest, pipelinesRequests)
+{
+  bus->open(fds[0]);
+  std::atomic<bool> done(false);
+  std::thread responder([&] {
+    struct can_frame frame;
+    while (!done && read(fds[1], &frame, sizeof(frame)) == (ssize_t) sizeof(frame)) {
+      uint8_t motor_id = frame.can_id & 0xFF;
+      if (motor_id == 0x03) continue; // never replies
+      frame = feedback_frame(motor_id, 0, 0, 0, 0, 0);
+      if (write(fds[1], &frame, sizeof(frame)) != (ssize_t) sizeof(frame)) break;
+    }
+  });
+
+  TMotor::RoundRobinPoller poller(bus, 3, std::chrono::milliseconds(2));
+  for (uint8_t motor_id : {0x01, 0x02, 0x03}) {
+    poller.addMotor(motor_id, [](TMotor::AKManager &motor) { motor.sendCurrent(0.0f); });
+  }
+  poller.start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  poller.stop();
+  done = true;
+  shutdown(fds[1], SHUT_RDWR);
+  responder.join();
+
+  TMotor::PollerStatistics stats = poller.getStatistics();
+  ASSERT_GE(stats.cycles, 10u);
+  ASSERT_EQ(stats.motors.size(), 3u);
+  ASSERT_GE(stats.motors[0].replies, 10u);
+  ASSERT_GE(stats.motors[1].replies, 10u);
+  ASSERT_LE(stats.motors[0].replies, stats.motors[0].requests);
+  ASSERT_EQ(stats.motors[2].replies, 0u);
+  ASSERT_GE(stats.motors[2].timeouts, 1u);
+  ASSERT_GE(stats.window, 1u);
+  ASSERT_LE(stats.window, 3u);
+};
+
+TEST(Planner, utilizationFromCodecDLCs)
+{
+  ASSERT_EQ(TMotor::commandDLC(TMotor::CommandType::VELOCITY), 4);
+  ASSERT_EQ(TMotor::commandDLC(TMotor::CommandType::PVA), 8);
+  TMotor::BusPlanner planner(1000000);
+  TMotor::BusPlan plan = planner.evaluate({
+    TMotor::MotorLoad(0x01, TMotor::CommandType::VELOCITY, 1000.0f, 1000.0f),
+    TMotor::MotorLoad(0x02, TMotor::CommandType::PVA, 500.0f)
+  });
+  ASSERT_NEAR(plan.utilization, (120 + 160) * 1000e-6f + 160 * 500e-6f, 1e-4f);
+  ASSERT_TRUE(plan.schedulable);
+  ASSERT_EQ(plan.latency_us.size(), 2u);
+  ASSERT_GE(plan.latency_us[1], 160.0f);
+  ASSERT_GE(plan.max_latency_us, plan.latency_us[0]);
+};
+
+TEST(Planner, rejectsOrDownRates)
+{
+  TMotor::BusPlanner planner(1000000, 0.7f);
+  TMotor::MotorLoad first(0x01, TMotor::CommandType::CURRENT, 1000.0f, 1000.0f);
+  TMotor::MotorLoad second(0x02, TMotor::CommandType::CURRENT, 1000.0f, 1000.0f);
+  ASSERT_TRUE(planner.admit(first));
+  ASSERT_TRUE(planner.admit(second));
+  ASSERT_NEAR(planner.plan().utilization, 0.56f, 1e-4f);
+
+  // the firmware set feedback alone overloads the bus, there is no command rate that fits
+  TMotor::MotorLoad third(0x03, TMotor::CommandType::CURRENT, 1000.0f, 1000.0f);
+  ASSERT_FALSE(planner.admit(third));
+  ASSERT_FALSE(planner.admit(third, TMotor::AdmissionPolicy::DOWN_RATE));
+  ASSERT_EQ(planner.loads().size(), 2u);
+  ASSERT_EQ(third.rate, 1000.0f);
+
+  TMotor::MotorLoad fourth(0x04, TMotor::CommandType::CURRENT, 1000.0f, 400.0f);
+  ASSERT_FALSE(planner.admit(fourth));
+  ASSERT_TRUE(planner.admit(fourth, TMotor::AdmissionPolicy::DOWN_RATE));
+  ASSERT_LT(fourth.rate, 1000.0f);
+  ASSERT_GT(fourth.rate, 300.0f);
+  ASSERT_EQ(fourth.feedback_rate, 400.0f);
+  ASSERT_LE(planner.plan().utilization, 0.7f);
+  planner.release(0x04);
+
+  // MIT replies follow the commands, they are lowered with the rate
+  TMotor::MotorLoad mit(0x05, TMotor::CommandType::MIT, 1000.0f);
+  ASSERT_TRUE(planner.admit(mit, TMotor::AdmissionPolicy::DOWN_RATE));
+  ASSERT_LT(mit.rate, 1000.0f);
+  ASSERT_LE(planner.plan().utilization, 0.7f);
+  planner.release(0x05);
+
+  ASSERT_EQ(planner.loads().size(), 2u);
+  ASSERT_FALSE(planner.evaluate({TMotor::MotorLoad(0x01, TMotor::CommandType::MIT, 4000.0f)}).schedulable);
+};
+
+TEST(Realtime, faultNames)
+{
+  static_assert(TMotor::fault_to_cstr(TMotor::MotorFault::ENCODER)[0] == 'E', "constexpr fault lookup");
+  TMotor::MotorFault fault = TMotor::MotorFault::OVERCURRENT;
+  ASSERT_EQ(TMotor::fault_to_string(fault), "Overcurrent");
+  ASSERT_STREQ(TMotor::fault_to_cstr((TMotor::MotorFault) 42), "INVALID FAULT");
+};
+
+TEST_F(BusTest, noAllocationsOnHotPaths)
+{
+  TMotor::BusOptions options;
+  options.prefault_stack = 64 * 1024;
+  bus->open(fds[0], options);
+  bus->setSampleBuffer(0x01, std::make_shared<TMotor::SampleBuffer>(64));
+  TMotor::AKManager motor(0x01);
+  motor.connect(bus);
+  TMotor::ImpedanceController controller(bus);
+  controller.setFeedbackTimeout(std::chrono::seconds(10));
+  controller.addMotor(0x02, TMotor::ImpedanceGains{1.0f, 0.0f, 1.0f});
+
+  // warm up every path once before counting
+  struct can_frame frame = feedback_frame(0x01, 0, 0, 0, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->waitForUpdate(0x01, 0, std::chrono::milliseconds(1000)), 1u);
+  motor.sendCurrent(0.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  controller.start();
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+
+  count_allocations = true;
+  uint32_t sequence = 1;
+  for (int i = 0; i < 50; i++) {
+    frame = feedback_frame(i % 2 ? 0x01 : 0x02, i, i, i, 0, 0);
+    write(fds[1], &frame, sizeof(frame));
+    motor.sendVelocity(i);
+    read(fds[1], &frame, sizeof(frame));
+    sequence = bus->waitForUpdate(sequence, std::chrono::milliseconds(1000));
+  }
+  controller.stop();
+  count_allocations = false;
+
+  ASSERT_EQ(allocations.load(), 0u);
+  ASSERT_GE(controller.getStatistics().ticks, 1u);
+  ASSERT_EQ(bus->getSequence(), 51u);
+
+  // on a stopped bus the loops skip the refused commands instead of throwing
+  TMotor::RoundRobinPoller poller(bus, 1, std::chrono::milliseconds(1));
+  poller.addMotor(0x03, [](TMotor::AKManager &manager) { manager.sendCurrent(0.0f); });
+  while (recv(fds[1], &frame, sizeof(frame), MSG_DONTWAIT) == (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->emergencyStop(), 3);
+  controller.start();
+  poller.start();
+  // both loops run for a while before counting, so the trace buffers of their threads exist
+  while (controller.getStatistics().ticks < 10) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  count_allocations = true;
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  count_allocations = false;
+  poller.stop();
+  controller.stop();
+
+  ASSERT_EQ(allocations.load(), 0u);
+  ASSERT_GE(controller.getStatistics().ticks, 20u);
+  ASSERT_EQ(poller.getStatistics().motors[0].requests, 0u);
+};
+
+TEST(VirtualTime, sleepersWakeInOrder)
+{
+  TMotor::VirtualClock clock;
+  TMotor::Clock::time_point start = clock.now();
+  std::vector<int> order;
+  std::thread first([&] { clock.sleepFor(std::chrono::seconds(2)); order.push_back(2); clock.leave(); });
+  std::thread second([&] { clock.sleepFor(std::chrono::seconds(1)); order.push_back(1); clock.leave(); });
+  ASSERT_TRUE(clock.waitForSleepers(2, std::chrono::milliseconds(1000)));
+  clock.advance(std::chrono::hours(1));
+  first.join();
+  second.join();
+  ASSERT_EQ(order, std::vector<int>({1, 2}));
+  ASSERT_TRUE(clock.now() - start == std::chrono::hours(1));
+};
+
+TEST(VirtualTime, stopWakesOnlyItsLoop)
+{
+  std::shared_ptr<TMotor::Clock> clock = std::make_shared<TMotor::SystemClock>();
+  TMotor::StopToken token;
+  std::atomic<bool> other_done(false);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::thread stopped([&] { clock->sleepFor(std::chrono::seconds(10), &token); });
+  std::thread other([&] { clock->sleepFor(std::chrono::milliseconds(200)); other_done = true; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  clock->requestStop(token);
+  stopped.join();
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(150));
+  ASSERT_FALSE(other_done);
+  other.join();
+  ASSERT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(200));
+
+  TMotor::VirtualClock virtual_clock;
+  TMotor::StopToken virtual_token;
+  std::thread sleeper([&] { virtual_clock.sleepFor(std::chrono::seconds(1), &virtual_token); });
+  std::thread bystander([&] { virtual_clock.sleepFor(std::chrono::seconds(1)); virtual_clock.leave(); });
+  ASSERT_TRUE(virtual_clock.waitForSleepers(2, std::chrono::milliseconds(1000)));
+  virtual_clock.requestStop(virtual_token);
+  sleeper.join();
+  ASSERT_TRUE(virtual_clock.waitForSleepers(1, std::chrono::milliseconds(1000)));
+  virtual_clock.advance(std::chrono::seconds(1));
+  bystander.join();
+};
+
+static float simulate_impedance(std::chrono::seconds duration, uint64_t &ticks) {
+  std::shared_ptr<TMotor::AKBus> bus = std::make_shared<TMotor::AKBus>();
+  TMotor::Simulation simulation(bus);
+  TMotor::SimulatedMotor &motor = simulation.addMotor(0x01);
+  TMotor::ImpedanceController controller(bus);
+  controller.addMotor(0x01, TMotor::ImpedanceGains{0.05f, 0.002f, 5.0f});
+  controller.setTarget(0x01, TMotor::ImpedanceTarget{90.0f, 0.0f, 0.0f});
+  simulation.step(std::chrono::milliseconds(1)); // feedback before the first tick
+  controller.start();
+  simulation.getClock()->waitForSleepers(1, std::chrono::milliseconds(1000));
+  simulation.run(duration, std::chrono::milliseconds(1));
+  controller.stop();
+  ticks = controller.getStatistics().ticks;
+  return motor.getPosition();
+}
+
+TEST(VirtualTime, controllerFasterThanRealTime)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  uint64_t ticks, ticks_again;
+  float position = simulate_impedance(std::chrono::seconds(20), ticks);
+  ASSERT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(20));
+  ASSERT_EQ(ticks, 20000u);
+  ASSERT_NEAR(position, 90.0f, 1.0f);
+
+  // lockstep makes the run reproducible down to the last bit
+  ASSERT_EQ(simulate_impedance(std::chrono::seconds(20), ticks_again), position);
+  ASSERT_EQ(ticks_again, ticks);
+};
+
+TEST(Archive, codecRoundTrip)
+{
+  std::vector<std::vector<int64_t>> columns = {
+    {42},
+    {7, 7, 7, 7},
+    {-32768, 32767, -32768, 0, 1, -1},
+    {INT64_MIN, INT64_MAX, 0, INT64_MIN / 3, INT64_MAX},
+  };
+  std::vector<int64_t> times;
+  for (int i = 0; i < 1000; i++) times.push_back(1700000000000000 + i * 1000 + (i % 7));
+  columns.push_back(times);
+  // every packing width, through both the grouped and the straddling decode
+  for (int width = 1; width <= 64; width++) {
+    std::vector<int64_t> values(101);
+    uint64_t seed = width;
+    for (size_t i = 1; i < values.size(); i++) {
+      seed = seed * 6364136223846793005u + 1442695040888963407u;
+      uint64_t delta = width < 64 ? (seed >> (64 - width)) | (uint64_t) 1 << (width - 1) : seed;
+      values[i] = (int64_t) ((uint64_t) values[i-1] + (uint64_t) ((int64_t) (delta >> 1) ^ -(int64_t) (delta & 1)));
+    }
+    columns.push_back(values);
+  }
+  for (const std::vector<int64_t> &values : columns) {
+    std::vector<uint8_t> encoded(TMotor::maxEncodedSize(values.size()));
+    std::vector<int64_t> decoded(values.size());
+    size_t size = TMotor::encodeColumn(values.data(), values.size(), encoded.data());
+    ASSERT_LE(size, encoded.size());
+    ASSERT_EQ(TMotor::decodeColumn(encoded.data(), values.size(), decoded.data()), size);
+    ASSERT_EQ(decoded, values);
+  }
+  // regularly sampled times pack into a few bits each
+  std::vector<uint8_t> encoded(TMotor::maxEncodedSize(times.size()));
+  ASSERT_LT(TMotor::encodeColumn(times.data(), times.size(), encoded.data()), times.size() * 2);
+};
+
+TEST(Archive, summaryMatchesSamples)
+{
+  char path[] = "/tmp/tmotortest_archive_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+
+  const int64_t start = 1700000000000000;
+  std::vector<int16_t> currents;
+  {
+    TMotor::ArchiveWriter writer(path, 100);
+    for (int i = 0; i < 1000; i++) {
+      int16_t current = (i * 37) % 2001 - 1000;
+      int8_t temperature = i >= 500 && i < 520 ? 90 : 40 + i / 100;
+      uint8_t fault = i >= 300 && i < 310 ? (uint8_t) TMotor::MotorFault::OVERCURRENT : 0;
+      currents.push_back(current);
+      ASSERT_TRUE(writer.append(start + i * 1000, feedback_frame(0x01, i, -i, current, temperature, fault)));
+      ASSERT_TRUE(writer.append(start + i * 1000, feedback_frame(0x02, 0, 0, 0, 30, 0)));
+    }
+    struct can_frame other = feedback_frame(0x01, 0, 0, 0, 0, 0);
+    other.can_id = CAN_EFF_FLAG | 0x0101;
+    ASSERT_FALSE(writer.append(start, other));
+  }
+
+  // the index is little-endian on every host: 2 motors, the first with ID 0x01, 10 blocks and 1000 samples
+  std::vector<uint8_t> file(1 << 20);
+  FILE *archive = fopen(path, "rb");
+  ASSERT_NE(archive, nullptr);
+  file.resize(fread(file.data(), 1, file.size(), archive));
+  fclose(archive);
+  ASSERT_GT(file.size(), 16u);
+  uint64_t index_offset = 0;
+  for (int i = 7; i >= 0; i--) index_offset = index_offset << 8 | file[file.size() - 16 + i];
+  ASSERT_LT(index_offset + 20, file.size());
+  const uint8_t *index = file.data() + index_offset;
+  ASSERT_EQ(std::vector<uint8_t>(index, index + 20),
+            std::vector<uint8_t>({2, 0, 0, 0, 0x01, 0, 0, 0, 10, 0, 0, 0, 0xE8, 0x03, 0, 0, 0, 0, 0, 0}));
+
+  TMotor::ArchiveReader reader(path);
+  ASSERT_EQ(reader.motors(), std::vector<uint8_t>({0x01, 0x02}));
+
+  TMotor::MotorSummary summary = reader.summarize(0x01);
+  ASSERT_EQ(summary.samples, 1000u);
+  ASSERT_EQ(summary.first_us, start);
+  ASSERT_EQ(summary.last_us, start + 999000);
+  ASSERT_NEAR(summary.position_max, 99.9f, 1e-3f);
+  ASSERT_NEAR(summary.position_mean, 49.95f, 1e-3f);
+  ASSERT_FLOAT_EQ(summary.velocity_min, -999.0f);
+  double sum = 0.0, sum_sq = 0.0;
+  for (int16_t current : currents) {
+    sum += current * 0.01;
+    sum_sq += current * 0.01 * current * 0.01;
+  }
+  ASSERT_NEAR(summary.current_mean, sum / 1000, 1e-4);
+  ASSERT_NEAR(summary.current_rms, std::sqrt(sum_sq / 1000), 1e-4);
+  ASSERT_EQ(summary.temperature_max, 90);
+  ASSERT_EQ(summary.temperature_max_us, start + 500000);
+  ASSERT_NEAR(summary.hot_seconds, 0.020, 1e-9);
+  ASSERT_EQ(summary.faults.size(), 1u);
+  ASSERT_EQ(summary.faults[0].fault, TMotor::MotorFault::OVERCURRENT);
+  ASSERT_EQ(summary.faults[0].start_us, start + 300000);
+  ASSERT_EQ(summary.faults[0].end_us, start + 310000);
+  // only the block with the fault and the one with hot samples are decoded
+  ASSERT_EQ(summary.blocks_decoded, 2u);
+  ASSERT_EQ(summary.blocks_scanned, 8u);
+
+  // a peak found in the statistics still gets its time
+  summary = reader.summarize(0x01, start + 600000, start + 999000);
+  ASSERT_EQ(summary.blocks_decoded, 0u);
+  ASSERT_EQ(summary.temperature_max, 49);
+  ASSERT_EQ(summary.temperature_max_us, start + 900000);
+
+  // a range crossing block limits matches a brute-force scan
+  summary = reader.summarize(0x01, start + 150500, start + 849000);
+  ASSERT_EQ(summary.samples, 699u);
+  ASSERT_EQ(summary.first_us, start + 151000);
+  int16_t current_min = INT16_MAX;
+  for (int i = 151; i <= 849; i++) current_min = std::min(current_min, currents[i]);
+  ASSERT_NEAR(summary.current_min, current_min * 0.01f, 1e-4f);
+
+  ASSERT_THROW(reader.summarize(0x03), std::runtime_error);
+  unlink(path);
+};
+
+TEST_F(BusTest, filtersFeedback)
+{
+  std::shared_ptr<TMotor::VirtualClock> clock = std::make_shared<TMotor::VirtualClock>();
+  bus->setClock(clock);
+  TMotor::DerivedConfig config;
+  config.torque_constant = 0.1f;
+  config.resistance = 0.2f;
+  bus->setDerivedConfig(0x01, config);
+  bus->open(fds[0]);
+
+  // 500 rpm/s ramp and a temperature rising 1 C every 2 s, sampled at 1 kHz
+  for (int i = 0; i < 20000; i++) {
+    struct can_frame frame = feedback_frame(0x01, 0, i / 2, 200, 30 + i / 2000, TMotor::MotorFault::NONE);
+    ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    ASSERT_EQ(bus->waitForUpdate(0x01, i, std::chrono::milliseconds(1000)), (uint32_t) i + 1);
+    clock->advance(std::chrono::milliseconds(1));
+  }
+
+  TMotor::MotorState state = bus->getState(0x01);
+  ASSERT_NEAR(state.derived.velocity, 9999.5f - 500.0f / (2.0f * M_PI * 20.0f), 1.0f);
+  ASSERT_NEAR(state.derived.acceleration, 500.0f, 5.0f);
+  ASSERT_NEAR(state.derived.temperature_rate, 0.5f, 0.1f);
+  float shaft_speed = state.derived.velocity / TMOTOR_RADS_TO_RPM;
+  ASSERT_NEAR(state.derived.power, 0.1f * 2.0f * shaft_speed + 0.2f * 2.0f * 2.0f, 1e-2f);
+};
+
+TEST(Metrics, histogramBuckets)
+{
+  TMotor::LatencyHistogram histogram;
+  histogram.record(3.0);
+  histogram.record(5.0);
+  histogram.record(700.0);
+  histogram.record(1e9);
+  TMotor::HistogramSnapshot snapshot = histogram.snapshot();
+  ASSERT_EQ(snapshot.count, 4u);
+  ASSERT_EQ(snapshot.buckets[0], 2u);
+  ASSERT_EQ(snapshot.buckets[7], 1u); // (500, 1000]
+  ASSERT_EQ(snapshot.buckets[TMotor::histogram_buckets - 1], 1u);
+  ASSERT_DOUBLE_EQ(snapshot.sum_us, 1e9 + 708.0);
+  histogram.reset();
+  ASSERT_EQ(histogram.snapshot().count, 0u);
+};
+
+TEST_F(BusTest, servesPrometheusText)
+{
+  bus->open(fds[0]);
+  struct can_frame frame = feedback_frame(0x05, 123, 456, -250, 40, TMotor::MotorFault::NONE);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(bus->waitForUpdate(0x05, 0, std::chrono::milliseconds(1000)), 1u);
+  ASSERT_EQ(bus->peekState(0x05).sequence, 1u);
+
+  std::shared_ptr<TMotor::LatencyHistogram> rtt = std::make_shared<TMotor::LatencyHistogram>();
+  rtt->record(150.0);
+  TMotor::MetricsExporter exporter(bus);
+  exporter.addHistogram("tmotor_poll_rtt_seconds", "Poll round-trip time.", "motor=\"0x05\"", rtt);
+
+  char path[] = "/tmp/tmotortest_metrics.sock";
+  exporter.listenUnix(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  ASSERT_EQ(connect(fd, (struct sockaddr *) &addr, sizeof(addr)), 0);
+  const char request[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  ASSERT_EQ(write(fd, request, strlen(request)), (ssize_t) strlen(request));
+  std::string response;
+  char buffer[4096];
+  ssize_t received;
+  while ((received = read(fd, buffer, sizeof(buffer))) > 0) {
+    response.append(buffer, received);
+  }
+  close(fd);
+
+  ASSERT_EQ(response.compare(0, 15, "HTTP/1.0 200 OK"), 0);
+  ASSERT_NE(response.find("tmotor_bus_rx_frames_total 1\n"), std::string::npos);
+  ASSERT_NE(response.find("tmotor_motor_position_degrees{motor=\"0x05\"} 12.3"), std::string::npos);
+  ASSERT_NE(response.find("tmotor_motor_temperature_celsius{motor=\"0x05\"} 40\n"), std::string::npos);
+  ASSERT_NE(response.find("tmotor_poll_rtt_seconds_bucket{motor=\"0x05\",le=\"0.0001\"} 0\n"), std::string::npos);
+  ASSERT_NE(response.find("tmotor_poll_rtt_seconds_bucket{motor=\"0x05\",le=\"0.00025\"} 1\n"), std::string::npos);
+  ASSERT_NE(response.find("tmotor_poll_rtt_seconds_count{motor=\"0x05\"} 1\n"), std::string::npos);
+  exporter.stop();
+  ASSERT_NE(access(path, F_OK), 0);
+};
+
+TEST(Trace, writesChromeTrace)
+{
+  TMotor::Tracer::clear();
+  std::thread worker([] {
+    TMotor::Tracer::nameThread("worker");
+    {
+      TMotor::TraceScope scope("work");
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    TMotor::Tracer::record("mark", TMotor::Tracer::now(), 0);
+  });
+  worker.join();
+
+  char path[] = "/tmp/tmotortest_trace_XXXXXX";
+  int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  ASSERT_EQ(TMotor::Tracer::write(path), 2u);
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  std::string trace = contents.str();
+  ASSERT_EQ(trace.compare(0, 15, "{\"displayTimeUn"), 0);
+  ASSERT_NE(trace.find("\"ph\":\"M\""), std::string::npos);
+  ASSERT_NE(trace.find("\"args\":{\"name\":\"worker\"}"), std::string::npos);
+  size_t work = trace.find("{\"name\":\"work\",\"ph\":\"X\"");
+  ASSERT_NE(work, std::string::npos);
+  double duration = atof(trace.c_str() + trace.find("\"dur\":", work) + 6);
+  ASSERT_GE(duration, 1000.0);
+  ASSERT_NE(trace.find("{\"name\":\"mark\",\"ph\":\"i\""), std::string::npos);
+
+  // the buffer of the exited thread is dropped
+  TMotor::Tracer::clear();
+  ASSERT_EQ(TMotor::Tracer::write(path), 0u);
+  unlink(path);
+};
+
+TEST_F(BusTest, stopsEveryMotor)
+{
+  ASSERT_EQ(bus->emergencyStop(), -1);
+  bus->clearStop();
+  bus->open(fds[0]);
+  TMotor::AKManager first(0x01), second(0x02), third(0x40);
+  TMotor::MITLimits limits;
+  limits.position_max = 95.5f;
+  limits.velocity_max = 30.0f;
+  limits.torque_max = 7.0f;
+  second.setMITLimits(limits);
+  first.connect(bus);
+  second.connect(bus);
+  third.connect(bus);
+  second.enterMITMode();
+  struct can_frame frame;
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+
+  bus->setStopAction(TMotor::StopAction::BRAKE, 2.5f);
+  // from a thread that never recorded a trace event, as a signal may interrupt any thread, nothing is allocated
+  int stopped = 0;
+  allocations = 0;
+  std::thread handler([&] {
+    count_allocations = true;
+    stopped = bus->emergencyStop();
+    count_allocations = false;
+  });
+  handler.join();
+  ASSERT_EQ(stopped, 3);
+  ASSERT_EQ(allocations.load(), 0u);
+  ASSERT_TRUE(bus->isStopped());
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTBREAK | 0x01);
+  ASSERT_EQ(frame.can_dlc, 4);
+  int32_t brake = frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24;
+  ASSERT_EQ(brake, 2500);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  struct can_frame mit;
+  TMotor::MITCodec(limits).pack(0x02, TMotor::MITCommand{0.0f, 0.0f, 0.0f, 0.0f, 0.0f}, mit);
+  ASSERT_EQ(frame.can_id, mit.can_id);
+  ASSERT_EQ(frame.can_dlc, 8);
+  ASSERT_EQ(memcmp(frame.data, mit.data, mit.can_dlc), 0);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTBREAK | 0x40);
+  TMotor::BusStatistics stats = bus->getStatistics();
+  ASSERT_EQ(stats.tx_frames, 4u);
+  // the MIT frames have standard IDs
+  ASSERT_EQ(stats.bits, 2 * TMotor::frameBits(false, 8) + 2 * TMotor::frameBits(true, 4));
+
+  // commands are refused until the stop is cleared
+  ASSERT_THROW(first.sendCurrent(1.0f), TMotor::CANSocketException);
+  bus->clearStop();
+  first.sendCurrent(1.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x01);
+};
+
+TEST_F(BusTest, stopOutlivesConcurrentSender)
+{
+  bus->open(fds[0]);
+  TMotor::AKManager motor(0x01);
+  motor.connect(bus);
+
+  for (int round = 0; round < 50; round++) {
+    std::atomic<bool> sending(true);
+    std::atomic<bool> draining(true);
+    struct can_frame last;
+    memset(&last, 0, sizeof(last));
+    std::thread peer([&] {
+      struct can_frame frame;
+      while (true) {
+        // read before the recv, so the frames written before the flag cleared are all received
+        bool done = !draining;
+        ssize_t received = recv(fds[1], &frame, sizeof(frame), MSG_DONTWAIT);
+        if (received == (ssize_t) sizeof(frame)) {
+          last = frame;
+        } else if (done) {
+          break;
+        }
+      }
+    });
+    std::thread sender([&] {
+      while (sending) {
+        try {
+          motor.sendCurrent(5.0f);
+        } catch (TMotor::CANSocketException &e) {
+        }
+      }
+    });
+    std::this_thread::sleep_for(std::chrono::microseconds(100 + 10 * round));
+    ASSERT_EQ(bus->emergencyStop(), 1);
+    sending = false;
+    sender.join();
+    draining = false;
+    peer.join();
+
+    // whichever command raced the stop, the last frame the motor receives stops it
+    ASSERT_EQ(last.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x01);
+    ASSERT_EQ(last.data[0] | last.data[1] | last.data[2] | last.data[3], 0);
+    bus->clearStop();
+  }
+};
+
+TEST_F(BusTest, batchedLatency)
+{
+  bus->open(fds[0]);
+  std::vector<TMotor::AKManager> motors;
+  for (uint8_t motor_id = 1; motor_id <= 32; motor_id++) {
+    motors.emplace_back(motor_id);
+  }
+  for (TMotor::AKManager &motor : motors) {
+    motor.connect(bus);
+  }
+
+  // time from the call until the peer has read the frame of the last motor
+  struct can_frame frame;
+  double batched_us = 1e9;
+  double looped_us = 1e9;
+  for (int run = 0; run < 20; run++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ASSERT_EQ(bus->emergencyStop(), 32);
+    for (int i = 0; i < 32; i++) {
+      ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    }
+    batched_us = std::min(batched_us, std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count());
+    ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 32);
+    bus->clearStop();
+
+    start = std::chrono::steady_clock::now();
+    for (TMotor::AKManager &motor : motors) {
+      motor.sendCurrent(0.0f);
+    }
+    for (int i = 0; i < 32; i++) {
+      ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    }
+    looped_us = std::min(looped_us, std::chrono::duration<double, std::micro>(
+      std::chrono::steady_clock::now() - start).count());
+  }
+  RecordProperty("batched_us", std::to_string(batched_us));
+  RecordProperty("looped_us", std::to_string(looped_us));
+  // one sendmmsg() is never slower than a write per motor, the margin absorbs the scheduling noise
+  ASSERT_LE(batched_us, 2.0 * looped_us);
+};
+
+TEST_F(BusTest, tripsOnSustainedCurrent)
+{
+  std::atomic<int> trips(0);
+  std::atomic<int> trigger(-1);
+  bus->setReflexCallback([&](uint8_t motor_id, TMotor::ReflexTrigger reason) {
+    if (motor_id == 0x01) trigger = (int) reason;
+    trips++;
+  });
+  bus->open(fds[0]);
+  TMotor::AKManager first(0x01), second(0x02);
+  first.connect(bus);
+  second.connect(bus);
+  TMotor::ReflexConfig config;
+  config.current_limit = 5.0f;
+  config.current_samples = 3;
+  config.action = TMotor::StopAction::BRAKE;
+  config.brake_current = 1.5f;
+  bus->setReflex(0x01, config);
+
+  // two samples above the limit, then one below restarts the count
+  int16_t currents[] = {600, -700, 100, 600, 650};
+  uint32_t sequence = 0;
+  for (int16_t current : currents) {
+    struct can_frame frame = feedback_frame(0x01, 0, 0, current, 30, 0);
+    ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    sequence = bus->waitForUpdate(0x01, sequence, std::chrono::milliseconds(1000));
+  }
+  ASSERT_FALSE(bus->isTripped(0x01));
+  first.sendCurrent(1.0f);
+  struct can_frame frame;
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+
+  frame = feedback_frame(0x01, 0, 0, -800, 30, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTBREAK | 0x01);
+  int32_t brake = frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24;
+  ASSERT_EQ(brake, 1500);
+  ASSERT_TRUE(bus->isTripped(0x01));
+  bus->waitForUpdate(0x01, sequence, std::chrono::milliseconds(1000));
+  for (int i = 0; i < 100 && trips == 0; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  ASSERT_EQ(trigger, (int) TMotor::ReflexTrigger::CURRENT);
+
+  // only the tripped motor is latched
+  ASSERT_THROW(first.sendCurrent(1.0f), TMotor::CANSocketException);
+  second.sendCurrent(1.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x02);
+  bus->clearReflex(0x01);
+  first.sendCurrent(1.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(trips, 1);
+};
+
+TEST_F(BusTest, faultStopsBus)
+{
+  bus->open(fds[0]);
+  TMotor::AKManager first(0x01), second(0x02);
+  first.connect(bus);
+  second.connect(bus);
+  TMotor::ReflexConfig config;
+  config.on_fault = true;
+  config.stop_bus = true;
+  bus->setReflex(0x02, config);
+
+  struct can_frame frame = feedback_frame(0x02, 0, 0, 0, 30, TMotor::MotorFault::OVERTEMPERATURE);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x01);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x02);
+  ASSERT_TRUE(bus->isStopped());
+  ASSERT_TRUE(bus->isTripped(0x02));
+  ASSERT_FALSE(bus->isTripped(0x01));
+};
+
+TEST_F(BusTest, processIncomingDecodes)
+{
+  TMotor::BusOptions options;
+  options.reader_thread = false;
+  bus->open(fds[0], options);
+  ASSERT_EQ(bus->getFd(), fds[0]);
+  ASSERT_EQ(bus->processIncoming(), 0u);
+
+  struct can_frame frame = feedback_frame(0x01, 100, 0, 0, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  frame = feedback_frame(0x01, 200, 0, 0, 0, 0);
+  ASSERT_EQ(write(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  struct pollfd pfd = {bus->getFd(), POLLIN, 0};
+  ASSERT_EQ(poll(&pfd, 1, 1000), 1);
+  ASSERT_EQ(bus->getSequence(), 0u);
+  ASSERT_EQ(bus->processIncoming(), 2u);
+  ASSERT_EQ(bus->getSequence(), 2u);
+  ASSERT_FLOAT_EQ(bus->getState(0x01).position, 20.0f);
+  ASSERT_EQ(poll(&pfd, 1, 0), 0);
+
+  // a bus with a reader thread refuses
+  TMotor::AKBus threaded;
+  threaded.open(fds[1]);
+  fds[1] = -1;
+  ASSERT_THROW(threaded.processIncoming(), std::runtime_error);
+};
+
+TEST_F(BusTest, commandsUseModelLimits)
+{
+  static_assert(TMotor::ModelCodec<TMotor::AKGeneric>::current(100.0f) == 6000, "generic current clamp");
+  static_assert(TMotor::ModelCodec<TMotor::AK60_6>::current(100.0f) == 1900, "AK60-6 current clamp");
+  static_assert(TMotor::ModelCodec<TMotor::AK60_6>::erpm(100.0f) == 1400, "AK60-6 pole pairs");
+  static_assert(TMotor::ModelCodec<TMotor::AK80_9>::erpm(-10000.0f) == -100000, "ERPM clamp");
+  static_assert(TMotor::ModelCodec<TMotor::AK80_64>::brake(-1.0f) == 0, "brake clamp");
+
+  bus->open(fds[0]);
+  TMotor::AKMotor<TMotor::AK60_6> small(0x01);
+  TMotor::AKMotor<TMotor::AK80_64> large(0x02);
+  TMotor::AKManager generic(0x03);
+  small.connect(bus);
+  large.connect(bus);
+  generic.connect(bus);
+
+  struct can_frame frame;
+  small.sendVelocity(100.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::VELOCITY | 0x01);
+  ASSERT_EQ(frame.data[0] << 24 | frame.data[1] << 16 | frame.data[2] << 8 | frame.data[3], 1400);
+  generic.sendVelocity(100.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.data[0] << 24 | frame.data[1] << 16 | frame.data[2] << 8 | frame.data[3], 2100);
+  large.sendCurrent(-30.0f);
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ(frame.can_id, CAN_EFF_FLAG | TMotor::MotorModeID::CURRENTLOOP | 0x02);
+  ASSERT_EQ((int32_t) (frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24), -1400);
+
+  // the MIT ranges come from the model
+  large.sendMIT(TMotor::MITCommand{0.0f, 0.0f, 0.0f, 0.0f, 144.0f});
+  ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+  ASSERT_EQ((frame.data[6] & 0x0F) << 8 | frame.data[7], 4095);
+
+  // so do the commands sent through a plain manager, or a channel of a controller adopting the bus limits
+  TMotor::AKManager &reference = small;
+  TMotor::AKManager channel(0x01);
+  channel.connect(bus);
+  for (TMotor::AKManager *manager : {&reference, &channel}) {
+    manager->sendCurrent(100.0f);
+    ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    ASSERT_EQ((int32_t) (frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24), 1900);
+  }
+  ASSERT_EQ(channel.getServoLimits().pole_pairs, 14);
+
+  // and the brake of an emergency stop
+  bus->setStopAction(TMotor::StopAction::BRAKE, 50.0f);
+  ASSERT_EQ(bus->emergencyStop(), 3);
+  int32_t brakes[3] = {19000, 14000, 50000};
+  for (int32_t brake : brakes) {
+    ASSERT_EQ(read(fds[1], &frame, sizeof(frame)), (ssize_t) sizeof(frame));
+    ASSERT_EQ((int32_t) (frame.data[0] | frame.data[1] << 8 | frame.data[2] << 16 | frame.data[3] << 24), brake);
+  }
+};
+
+TEST(Identification, fitsSimulatedFleet)
+{
+  TMotor::ExcitationConfig prbs;
+  prbs.type = TMotor::ExcitationType::PRBS;
+  prbs.amplitude = 2.0f;
+  prbs.bit_time = 0.05f;
+  prbs.duration = std::chrono::seconds(3);
+  TMotor::ExcitationSignal signal(prbs);
+  ASSERT_FLOAT_EQ(std::fabs(signal.at(0.5)), 2.0f);
+  ASSERT_FLOAT_EQ(signal.at(3.0), 0.0f);
+  TMotor::ExcitationConfig chirp;
+  chirp.amplitude = 2.0f;
+  chirp.duration = std::chrono::seconds(3);
+  ASSERT_FLOAT_EQ(TMotor::ExcitationSignal(chirp).at(0.0), 0.0f);
+  ASSERT_LE(std::fabs(TMotor::ExcitationSignal(chirp).at(1.7)), 2.0f);
+
+  std::shared_ptr<TMotor::AKBus> bus = std::make_shared<TMotor::AKBus>();
+  TMotor::Simulation simulation(bus);
+  std::vector<TMotor::MotorModel> models(4);
+  TMotor::SystemIdentifier identifier(bus);
+  for (int i = 0; i < 4; i++) {
+    models[i].inertia = 1e-4f * (i + 1);
+    models[i].damping = 5e-4f * (i + 1);
+    models[i].friction = 0.005f * i;
+    models[i].torque_constant = 0.1f;
+    simulation.addMotor(i + 1, models[i]);
+    identifier.addMotor(i + 1, i % 2 == 0 ? chirp : prbs, models[i].torque_constant);
+  }
+  simulation.step(std::chrono::milliseconds(1));
+  identifier.start();
+  simulation.getClock()->waitForSleepers(1, std::chrono::milliseconds(1000));
+  simulation.run(std::chrono::milliseconds(3100), std::chrono::milliseconds(1));
+  ASSERT_TRUE(identifier.isDone());
+  identifier.stop();
+
+  std::vector<TMotor::IdentifiedModel> fits = identifier.fit();
+  ASSERT_EQ(fits.size(), 4u);
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(fits[i].motor_id, i + 1);
+    ASSERT_GE(fits[i].samples, 3000u);
+    ASSERT_NEAR(fits[i].inertia, models[i].inertia, 0.02 * models[i].inertia);
+    ASSERT_NEAR(fits[i].damping, models[i].damping, 0.02 * models[i].damping);
+    ASSERT_NEAR(fits[i].friction, models[i].friction, 0.0005);
+    ASSERT_NEAR(fits[i].bandwidth_hz, 5.0 / (2.0 * M_PI), 0.01);
+    ASSERT_GT(fits[i].r_squared, 0.999);
+  }
+
+  // the fit does not depend on the number of threads accumulating it
+  TMotor::IdentifiedModel single = TMotor::fitModel(identifier.getSamples(1), 10, 1, 0.1f);
+  TMotor::IdentifiedModel parallel = TMotor::fitModel(identifier.getSamples(1), 10, 3, 0.1f);
+  ASSERT_NEAR(single.inertia, parallel.inertia, 1e-9);
+};
@@ -0,0 +1,34 @@
+#ifndef H_TMOTORTEST_HPP
+#define H_TMOTORTEST_HPP
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <tmotor.hpp>
+#include <gtest/gtest.h>
+
+/**
+ * @brief A bus and a connected socket pair, the test plays the motors on fds[1] once it opens the bus on fds[0].
+ *
+ * Both ends are closed when the test ends, including when an assertion returns early. A test handing fds[1] to
+ * another owner sets it to -1.
+ */
+class BusTest : public ::testing::Test {
+protected:
+  int fds[2] = {-1, -1};
+  std::shared_ptr<TMotor::AKBus> bus;
+
+  void SetUp() override {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds), 0);
+    bus = std::make_shared<TMotor::AKBus>();
+  }
+
+  void TearDown() override {
+    // an opened bus owns fds[0] and closes it itself
+    bool opened = bus && bus->getFd() == fds[0];
+    bus.reset();
+    if (!opened && fds[0] > -1) close(fds[0]);
+    if (fds[1] > -1) close(fds[1]);
+  }
+};
+
+#endif // H_TMOTORTEST_HPP